@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Measures how expensive generated code is for downstream compiler.
+
+For each emission mode (see `emission_mode` in flex_squarets_plugin.conf)
+runs flextool over `tests/code_generation` inputs and synthetic corpus
+(see generate_corpus.py), then compiles each `.generated` file
+with clang `-ftime-trace` and reports frontend/backend time
+and object size.
+
+Usually started by `flex_squarets_plugin_compile_time_benchmark` target
+(requires `-DENABLE_TESTS=ON -DENABLE_BENCHMARKS=ON`).
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+import generate_corpus
+
+
+def read_lines(path):
+    """Reads arguments stored one per line."""
+    with open(path) as args_file:
+        return [line for line in args_file.read().splitlines() if line]
+
+
+def write_plugin_copy(plugin, plugin_conf, mode, plugin_dir, settings=None):
+    """Copies plugin near its configuration file with given emission mode.
+
+    Plugin reads configuration from file placed near plugin library.
+    `settings` is optional dict of other `key=value` pairs to override.
+    """
+    os.makedirs(plugin_dir, exist_ok=True)
+    plugin_copy = os.path.join(plugin_dir, os.path.basename(plugin))
+    shutil.copy2(plugin, plugin_copy)
+
+    with open(plugin_conf) as conf_file:
+        conf = conf_file.read()
+    overrides = {"emission_mode": mode}
+    overrides.update(settings or {})
+    for key, value in overrides.items():
+        conf, replaced = re.subn(
+            r"^%s=.*$" % re.escape(key), "%s=%s" % (key, value), conf,
+            flags=re.M)
+        if not replaced:
+            conf += "\n%s=%s\n" % (key, value)
+    conf_name = os.path.splitext(os.path.basename(plugin))[0] + ".conf"
+    if conf_name.startswith("lib"):
+        conf_name = conf_name[len("lib"):]
+    with open(os.path.join(plugin_dir, conf_name), "w") as conf_file:
+        conf_file.write(conf)
+    return plugin_copy
+
+
+def run_flextool(args, plugin_copy, indir, outdir, input_file):
+    command = [args.flextool]
+    command += read_lines(args.flextool_args_file)
+    command += [
+        "--indir=" + indir,
+        "--outdir=" + outdir,
+        "--load_plugin=" + args.reflect_plugin,
+        "--load_plugin=" + plugin_copy,
+        input_file,
+    ]
+    started = time.monotonic()
+    subprocess.run(command, check=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    return time.monotonic() - started
+
+
+def trace_totals(trace_path):
+    """Returns (frontend, backend) seconds from `-ftime-trace` file."""
+    with open(trace_path) as trace_file:
+        trace = json.load(trace_file)
+    totals = {}
+    for event in trace.get("traceEvents", []):
+        name = event.get("name")
+        if name in ("Total Frontend", "Total Backend"):
+            totals[name] = event.get("dur", 0) / 1e6
+    return totals.get("Total Frontend", 0.0), totals.get("Total Backend", 0.0)
+
+
+def compile_generated(args, generated_file, object_file):
+    command = [args.compiler, "-x", "c++", "-std=c++17", "-c",
+               "-ftime-trace", "-O" + args.opt_level]
+    command += args.compile_arg
+    command += [generated_file, "-o", object_file]
+    started = time.monotonic()
+    subprocess.run(command, check=True)
+    wall = time.monotonic() - started
+    # clang writes trace near object file
+    trace_path = os.path.splitext(object_file)[0] + ".json"
+    frontend, backend = trace_totals(trace_path)
+    return {
+        "wall_s": wall,
+        "frontend_s": frontend,
+        "backend_s": backend,
+        "object_bytes": os.path.getsize(object_file),
+        "generated_bytes": os.path.getsize(generated_file),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--flextool", required=True)
+    parser.add_argument("--flextool-args-file", required=True,
+                        help="extra flextool arguments, one per line")
+    parser.add_argument("--plugin", required=True)
+    parser.add_argument("--plugin-conf", required=True)
+    parser.add_argument("--reflect-plugin", required=True)
+    parser.add_argument("--compiler", default="clang++")
+    parser.add_argument("--compile-arg", action="append", default=[])
+    parser.add_argument("--opt-level", default="2")
+    parser.add_argument("--input", action="append", default=[],
+                        help="existing input file (like tests/code_generation/main.cc)")
+    parser.add_argument("--modes", default="append,table")
+    parser.add_argument("--template-sizes", default="4096,65536,1048576")
+    parser.add_argument("--annotations", type=int, default=16)
+    parser.add_argument("--workdir", required=True)
+    parser.add_argument("--output", required=True, help="results in JSON")
+    args = parser.parse_args()
+
+    corpus_dir = os.path.join(args.workdir, "corpus")
+    os.makedirs(corpus_dir, exist_ok=True)
+    inputs = [(os.path.abspath(path), "input") for path in args.input]
+    for size in [int(size) for size in args.template_sizes.split(",")]:
+        inputs.append((
+            os.path.abspath(generate_corpus.generate(
+                corpus_dir, size, args.annotations)),
+            "synthetic_%d" % size))
+
+    results = []
+    for mode in args.modes.split(","):
+        mode_dir = os.path.join(args.workdir, mode)
+        plugin_copy = write_plugin_copy(
+            args.plugin, args.plugin_conf, mode,
+            os.path.join(mode_dir, "plugin"))
+        for input_file, kind in inputs:
+            outdir = os.path.join(mode_dir, "out", kind)
+            os.makedirs(outdir, exist_ok=True)
+            codegen_s = run_flextool(
+                args, plugin_copy, os.path.dirname(input_file),
+                outdir, input_file)
+            for generated_file in glob.glob(
+                    os.path.join(outdir, "**", "*.generated"),
+                    recursive=True):
+                object_file = generated_file + ".o"
+                result = compile_generated(
+                    args, generated_file, object_file)
+                result.update({
+                    "mode": mode,
+                    "input": kind,
+                    "file": os.path.basename(generated_file),
+                    "codegen_s": codegen_s,
+                })
+                results.append(result)
+
+    with open(args.output, "w") as output_file:
+        json.dump(results, output_file, indent=2)
+
+    columns = ["mode", "input", "file", "generated_bytes", "codegen_s",
+               "frontend_s", "backend_s", "wall_s", "object_bytes"]
+    print("\t".join(columns))
+    for result in results:
+        print("\t".join(
+            ("%.3f" % result[column]) if isinstance(result[column], float)
+            else str(result[column])
+            for column in columns))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
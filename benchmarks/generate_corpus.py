@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""Generates synthetic translation units.
+
+By default writes `_squaretsFile` annotations: each annotation
+uses own template file of given size, template mixes literal text
+with `[[+ ... +]]` and `[[~ ... ~]]` tags.
+
+With `--mix` writes translation unit with many small annotations
+of different kinds (see MIXED_KINDS), used by scalability_benchmark.py.
+
+Usage:
+  generate_corpus.py --outdir DIR --template-size 65536 --annotations 16
+  generate_corpus.py --outdir DIR --annotations 10000 \
+    --mix squarets=4,file=2,code=1,interpret=1
+"""
+
+import argparse
+import os
+
+HEADER = """#include <string>
+#include <string_view>
+
+#define _squaretsFile(...) \\
+  __attribute__((annotate("{gen};{squaretsFile};CXTPL;" __VA_ARGS__)))
+
+"""
+
+FUNCTION = """std::string render_{index}()
+{{
+  _squaretsFile("{template_path}")
+  std::string out;
+  return out;
+}}
+
+"""
+
+MIXED_HEADER = """#include <string>
+
+#define _squarets(...) \\
+  __attribute__((annotate("{gen};{squarets};CXTPL;" #__VA_ARGS__ )))
+
+#define _squaretsFile(...) \\
+  __attribute__((annotate("{gen};{squaretsFile};CXTPL;" __VA_ARGS__)))
+
+#define _squaretsCodeAndReplace(...) \\
+  __attribute__((annotate("{gen};{squaretsCodeAndReplace};CXTPL;" #__VA_ARGS__)))
+
+#define _interpretSquarets(...) \\
+  __attribute__((annotate("{gen};{interpretSquarets};CXTPL;" __VA_ARGS__ )))
+
+"""
+
+# one annotation of each kind, `{index}` is unique in translation unit
+MIXED_KINDS = {
+    "squarets": """void squarets_{index}()
+{{
+  _squarets(
+    int a_{index} = 1;
+    [[~ for(int i = 0; i < 2; ++i) {{ ~]] a_{index} += [[+ std::to_string(i) +]];[[~ }} ~]]
+  )
+  std::string out{{""}};
+}}
+
+""",
+    "file": """void file_{index}()
+{{
+  _squaretsFile("{template_path}")
+  std::string out{{""}};
+}}
+
+""",
+    "code": """void code_{index}()
+{{
+  _squaretsCodeAndReplace(
+    [squaretsOutput]() {{
+      *squaretsOutput = "int c_{index} = [[+ std::to_string({index}) +]];";
+    }}();
+  )
+  std::string out{{""}};
+}}
+
+""",
+    "interpret": """struct
+_interpretSquarets(
+  R"raw(struct [[+ classInfoPtr->name +]] {{ int field = {index}; }};)raw"
+)
+Interpreted_{index}
+{{}};
+
+""",
+}
+
+DEFAULT_MIX = "squarets=4,file=2,code=1,interpret=1"
+
+# literal text between tags, looks like generated C++ code
+LINE = "  int field_{index} = {index}; // some literal text of template\n"
+
+
+def make_template_parts(size, seed):
+    """Returns template of about `size` bytes as list of (kind, text),
+    kind is `code` (`[[~ ~]]` tag), `expr` (`[[+ +]]` tag) or `text`."""
+    parts = [("code", " int counter = %d; " % seed), ("text", "\n")]
+    written = len(make_template_from_parts(parts))
+    line_index = 0
+    while written < size:
+        line = [("text", LINE.format(index=line_index))]
+        # dynamic part every 16 lines
+        if line_index % 16 == 15:
+            line += [("text", "  int dynamic = "),
+                     ("expr", " std::to_string(++counter) "),
+                     ("text", ";\n")]
+        parts += line
+        written += len(make_template_from_parts(line))
+        line_index += 1
+    return parts
+
+
+def make_template_from_parts(parts):
+    """Joins parts returned by make_template_parts into template."""
+    tags = {"code": "[[~%s~]]", "expr": "[[+%s+]]", "text": "%s"}
+    return "".join(tags[kind] % text for kind, text in parts)
+
+
+def make_template(size, seed):
+    """Returns template of about `size` bytes."""
+    return make_template_from_parts(make_template_parts(size, seed))
+
+
+def generate(outdir, template_size, annotations):
+    """Writes `corpus_<size>.cc` and its templates, returns path of .cc"""
+    templates_dir = os.path.join(outdir, "templates_%d" % template_size)
+    os.makedirs(templates_dir, exist_ok=True)
+
+    source = [HEADER]
+    for index in range(annotations):
+        template_path = os.path.abspath(
+            os.path.join(templates_dir, "template_%d.cxtpl" % index))
+        with open(template_path, "w") as template_file:
+            template_file.write(make_template(template_size, index))
+        source.append(FUNCTION.format(
+            index=index, template_path=template_path))
+
+    source_path = os.path.join(outdir, "corpus_%d.cc" % template_size)
+    with open(source_path, "w") as source_file:
+        source_file.write("".join(source))
+    return source_path
+
+
+def parse_mix(mix):
+    """Parses `kind=weight,...` into list of (kind, weight)."""
+    result = []
+    for item in mix.split(","):
+        kind, _, weight = item.partition("=")
+        kind = kind.strip()
+        if kind not in MIXED_KINDS:
+            raise ValueError("unknown annotation kind: " + kind)
+        result.append((kind, int(weight or "1")))
+    return result
+
+
+def generate_mixed(outdir, annotations, mix=DEFAULT_MIX):
+    """Writes `mixed_<annotations>.cc` with annotations of kinds
+    from `mix` in proportion to their weights, returns path of .cc"""
+    weights = [(kind, weight) for kind, weight in parse_mix(mix) if weight]
+    # kinds are interleaved, so cost of each kind is spread over file
+    pattern = []
+    for kind, weight in weights:
+        pattern += [kind] * weight
+
+    # all `_squaretsFile` annotations share small template,
+    # so file I/O does not dominate
+    template_path = os.path.abspath(
+        os.path.join(outdir, "mixed_template.cxtpl"))
+    with open(template_path, "w") as template_file:
+        template_file.write(make_template(512, 0))
+
+    source_path = os.path.join(outdir, "mixed_%d.cc" % annotations)
+    with open(source_path, "w") as source_file:
+        source_file.write(MIXED_HEADER)
+        for index in range(annotations):
+            source_file.write(MIXED_KINDS[pattern[index % len(pattern)]].format(
+                index=index, template_path=template_path))
+    return source_path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--outdir", required=True)
+    parser.add_argument("--template-size", type=int, default=64 * 1024)
+    parser.add_argument("--annotations", type=int, default=16)
+    parser.add_argument("--mix",
+                        help="weights of annotation kinds, like " + DEFAULT_MIX)
+    args = parser.parse_args()
+
+    os.makedirs(args.outdir, exist_ok=True)
+    if args.mix:
+        print(generate_mixed(args.outdir, args.annotations, args.mix))
+    else:
+        print(generate(args.outdir, args.template_size, args.annotations))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Measures speed of generated render code at runtime.
+
+For each emission mode (see `emission_mode` in flex_squarets_plugin.conf)
+and literal minification (see `minify_literals`) runs flextool over
+`tests/code_generation/main.cc` (annotated blocks append their output
+to shared sink) and synthetic corpus (see generate_corpus.py),
+links `.generated` file with runtime_benchmark_main.cc
+and reports render throughput, allocations per render
+and instructions per byte.
+
+Results are compared with baselines:
+  copy         appends precomputed output of same input (lower bound)
+  handwritten  (synthetic corpus only) same templates written by hand,
+               one `reserve` and one append per literal run
+
+Usually started by `flex_squarets_plugin_runtime_benchmark` target
+(requires `-DENABLE_TESTS=ON -DENABLE_BENCHMARKS=ON`).
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+import compile_time_benchmark
+import generate_corpus
+
+RENDER_FUNCTION = \
+    "void squarets_benchmark_render(std::string& squarets_sink)"
+
+HARNESS = os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "runtime_benchmark_main.cc")
+
+# `std::string out ...;` declaration followed by end of block,
+# generated code is inserted right after declaration
+OUT_BLOCK_END = re.compile(r"(\n([ \t]*)std::string out\b[^;\n]*;\n)(\s*\})")
+
+# upper bound of `std::to_string(int)` length
+MAX_NUMBER_LENGTH = 11
+
+
+def make_main_input(main_cc, outdir):
+    """Makes render function from `somefunc` of `main.cc`."""
+    with open(main_cc) as main_file:
+        source = main_file.read()
+    source, replaced = re.subn(
+        r"^static void somefunc\(\)$", RENDER_FUNCTION, source, flags=re.M)
+    if replaced != 1:
+        raise RuntimeError("somefunc not found in " + main_cc)
+    source, replaced = OUT_BLOCK_END.subn(
+        r"\1\2squarets_sink += out;\n\3", source)
+    if not replaced:
+        raise RuntimeError("no `std::string out` found in " + main_cc)
+    os.makedirs(outdir, exist_ok=True)
+    path = os.path.join(outdir, os.path.basename(main_cc))
+    with open(path, "w") as input_file:
+        input_file.write(source)
+    return path
+
+
+def write_corpus_adapter(path, annotations):
+    """Appends result of each `render_<index>` (see generate_corpus.py)."""
+    source = ["#include <string>\n\n"]
+    source += ["std::string render_%d();\n" % index
+               for index in range(annotations)]
+    source += ["\n", RENDER_FUNCTION, "\n{\n"]
+    source += ["  squarets_sink += render_%d();\n" % index
+               for index in range(annotations)]
+    source += ["}\n"]
+    with open(path, "w") as adapter_file:
+        adapter_file.write("".join(source))
+    return path
+
+
+def write_handwritten(path, size, annotations):
+    """Writes synthetic corpus templates as hand-written C++."""
+    source = ["#include <string>\n\n"]
+    for index in range(annotations):
+        parts = generate_corpus.make_template_parts(size, index)
+        literal_bytes = sum(len(text.encode()) for kind, text in parts
+                            if kind == "text")
+        expressions = sum(1 for kind, _ in parts if kind == "expr")
+        source.append("static std::string handwritten_render_%d()\n{\n"
+                      "  std::string out;\n  out.reserve(%d);\n"
+                      % (index, literal_bytes
+                         + expressions * MAX_NUMBER_LENGTH))
+        literal = ""
+        for kind, text in parts + [("code", "")]:
+            if kind == "text":
+                literal += text
+                continue
+            if literal:
+                # json escapes are valid in C++ string literal
+                source.append("  out.append(%s, %d);\n"
+                              % (json.dumps(literal),
+                                 len(literal.encode())))
+                literal = ""
+            if kind == "expr":
+                source.append("  out += %s;\n" % text.strip())
+            elif text.strip():
+                source.append("  %s\n" % text.strip())
+        source.append("  return out;\n}\n\n")
+    source += [RENDER_FUNCTION, "\n{\n"]
+    source += ["  squarets_sink += handwritten_render_%d();\n" % index
+               for index in range(annotations)]
+    source += ["}\n"]
+    with open(path, "w") as handwritten_file:
+        handwritten_file.write("".join(source))
+    return path
+
+
+def find_generated(outdir, input_file):
+    prefix = os.path.basename(input_file)
+    for generated_file in glob.glob(
+            os.path.join(outdir, "**", "*.generated"), recursive=True):
+        if os.path.basename(generated_file).startswith(prefix):
+            return generated_file
+    raise RuntimeError("flextool did not generate code for " + input_file)
+
+
+def build(args, sources, executable):
+    command = [args.compiler, "-std=c++17", "-O" + args.opt_level]
+    command += args.compile_arg
+    command += [HARNESS, "-x", "c++"] + sources + ["-o", executable]
+    subprocess.run(command, check=True)
+    return executable
+
+
+def measure(args, executable, copy=False):
+    command = [executable, "--min-seconds=%s" % args.min_seconds]
+    if copy:
+        command.append("--copy")
+    completed = subprocess.run(
+        command, check=True, stdout=subprocess.PIPE, universal_newlines=True)
+    return json.loads(completed.stdout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--flextool", required=True)
+    parser.add_argument("--flextool-args-file", required=True,
+                        help="extra flextool arguments, one per line")
+    parser.add_argument("--plugin", required=True)
+    parser.add_argument("--plugin-conf", required=True)
+    parser.add_argument("--reflect-plugin", required=True)
+    parser.add_argument("--compiler", default="c++")
+    parser.add_argument("--compile-arg", action="append", default=[])
+    parser.add_argument("--opt-level", default="2")
+    parser.add_argument("--main-input", action="append", default=[],
+                        help="file like tests/code_generation/main.cc"
+                             " with `static void somefunc()`")
+    parser.add_argument("--modes", default="append,table")
+    parser.add_argument("--minify-literals", default="none",
+                        help="comma-separated values of `minify_literals`")
+    parser.add_argument("--template-sizes", default="4096,65536")
+    parser.add_argument("--annotations", type=int, default=16)
+    parser.add_argument("--min-seconds", default="1.0",
+                        help="minimal measurement time of each variant")
+    parser.add_argument("--workdir", required=True)
+    parser.add_argument("--output", required=True, help="results in JSON")
+    args = parser.parse_args()
+
+    inputs_dir = os.path.join(args.workdir, "inputs")
+    os.makedirs(inputs_dir, exist_ok=True)
+    # (kind, input file, extra sources, hand-written baseline or None)
+    inputs = []
+    for main_cc in args.main_input:
+        inputs.append(("input", make_main_input(
+            os.path.abspath(main_cc), inputs_dir), [], None))
+    for size in [int(size) for size in args.template_sizes.split(",")]:
+        kind = "synthetic_%d" % size
+        inputs.append((
+            kind,
+            os.path.abspath(generate_corpus.generate(
+                inputs_dir, size, args.annotations)),
+            [write_corpus_adapter(
+                os.path.join(inputs_dir, kind + "_adapter.cc"),
+                args.annotations)],
+            write_handwritten(
+                os.path.join(inputs_dir, kind + "_handwritten.cc"),
+                size, args.annotations)))
+
+    variants = []
+    for mode in args.modes.split(","):
+        for minification in args.minify_literals.split(","):
+            name = mode if minification == "none" \
+                else "%s+%s" % (mode, minification)
+            variants.append((name, mode, minification))
+
+    results = []
+    for kind, input_file, extra_sources, handwritten in inputs:
+        input_results = []
+        for name, mode, minification in variants:
+            variant_dir = os.path.join(args.workdir, name)
+            plugin_copy = compile_time_benchmark.write_plugin_copy(
+                args.plugin, args.plugin_conf, mode,
+                os.path.join(variant_dir, "plugin"),
+                {"minify_literals": minification})
+            outdir = os.path.join(variant_dir, "out", kind)
+            os.makedirs(outdir, exist_ok=True)
+            compile_time_benchmark.run_flextool(
+                args, plugin_copy, os.path.dirname(input_file),
+                outdir, input_file)
+            executable = build(
+                args, [find_generated(outdir, input_file)] + extra_sources,
+                os.path.join(outdir, "runtime_benchmark"))
+            if not input_results:
+                input_results.append(
+                    dict(measure(args, executable, copy=True),
+                         variant="baseline_copy"))
+            input_results.append(
+                dict(measure(args, executable), variant=name))
+        if handwritten:
+            executable = build(
+                args, [handwritten],
+                os.path.join(inputs_dir, kind + "_handwritten"))
+            input_results.append(
+                dict(measure(args, executable),
+                     variant="baseline_handwritten"))
+
+        baseline = input_results[-1] if handwritten else input_results[0]
+        for result in input_results:
+            result["input"] = kind
+            result["vs_baseline"] = \
+                result["bytes_per_s"] / baseline["bytes_per_s"]
+            if result["bytes_per_render"] != baseline["bytes_per_render"] \
+                    and "+" not in result["variant"]:
+                print("warning: %s/%s renders %d bytes, baseline renders %d"
+                      % (kind, result["variant"], result["bytes_per_render"],
+                         baseline["bytes_per_render"]), file=sys.stderr)
+        results += input_results
+
+    with open(args.output, "w") as output_file:
+        json.dump(results, output_file, indent=2)
+
+    columns = ["input", "variant", "bytes_per_render", "ns_per_render",
+               "bytes_per_s", "allocations_per_render",
+               "instructions_per_byte", "vs_baseline"]
+    print("\t".join(columns))
+    for result in results:
+        print("\t".join(
+            ("%.3f" % result[column]) if isinstance(result[column], float)
+            else str(result[column])
+            for column in columns))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
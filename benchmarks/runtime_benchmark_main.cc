@@ -0,0 +1,212 @@
+// Measures speed of render code generated by flex_squarets_plugin,
+// see runtime_benchmark.py
+//
+// Linked with translation unit that defines |squarets_benchmark_render|.
+// Usage: runtime_benchmark [--copy] [--min-seconds=1.0]
+//   --copy measures append of precomputed output (lower bound)
+// Prints results as JSON object.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif // __linux__
+
+// appends output of all rendered templates to |sink|
+void squarets_benchmark_render(std::string& sink);
+
+namespace {
+
+// renders between checks of elapsed time
+static const size_t kRendersPerBatch = 16;
+
+static const char kCopyArg[] = "--copy";
+
+static const char kMinSecondsArg[] = "--min-seconds=";
+
+// number of `operator new` calls while |isCountingAllocations|
+static size_t allocations = 0;
+
+static bool isCountingAllocations = false;
+
+// counts instructions executed by current thread in user space
+/// \note perf events may be disabled
+/// (see `/proc/sys/kernel/perf_event_paranoid`)
+class InstructionCounter {
+public:
+  InstructionCounter()
+  {
+#if defined(__linux__)
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif // __linux__
+  }
+
+  ~InstructionCounter()
+  {
+#if defined(__linux__)
+    if(fd_ >= 0) {
+      close(fd_);
+    }
+#endif // __linux__
+  }
+
+  bool IsValid() const
+  {
+    return fd_ >= 0;
+  }
+
+  void Start()
+  {
+#if defined(__linux__)
+    if(fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif // __linux__
+  }
+
+  // returns number of instructions since |Start|
+  long long Stop()
+  {
+    long long count = 0;
+#if defined(__linux__)
+    if(fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if(read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+#endif // __linux__
+    return count;
+  }
+
+private:
+  int fd_ = -1;
+
+  InstructionCounter(const InstructionCounter&) = delete;
+  void operator=(const InstructionCounter&) = delete;
+};
+
+} // namespace
+
+// counts allocations of generated code
+// (`std::string` grows via `operator new`)
+void* operator new(std::size_t size)
+{
+  if(isCountingAllocations) {
+    ++allocations;
+  }
+  void* result = std::malloc(size ? size : 1);
+  if(!result) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+int main(int argc, char* argv[])
+{
+  bool isCopy = false;
+  double minSeconds = 1.0;
+  for(int i = 1; i < argc; ++i) {
+    if(std::strcmp(argv[i], kCopyArg) == 0) {
+      isCopy = true;
+    } else if(std::strncmp(argv[i], kMinSecondsArg
+                , sizeof(kMinSecondsArg) - 1) == 0)
+    {
+      minSeconds = std::atof(argv[i] + sizeof(kMinSecondsArg) - 1);
+    } else {
+      std::fprintf(stderr, "unknown argument: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // also sets capacity of |sink|,
+  // so measured allocations are made by rendered code
+  std::string sink;
+  squarets_benchmark_render(sink);
+  const std::string output = sink;
+  if(output.empty()) {
+    std::fprintf(stderr, "rendered output is empty\n");
+    return EXIT_FAILURE;
+  }
+
+  auto render = [&sink, &output, isCopy]() {
+    sink.clear();
+    if(isCopy) {
+      sink.append(output);
+    } else {
+      squarets_benchmark_render(sink);
+    }
+  };
+
+  InstructionCounter instructionCounter;
+
+  size_t renders = 0;
+  allocations = 0;
+  isCountingAllocations = true;
+  instructionCounter.Start();
+  const auto started = std::chrono::steady_clock::now();
+  double elapsed = 0.0;
+  do {
+    for(size_t i = 0; i < kRendersPerBatch; ++i) {
+      render();
+    }
+    renders += kRendersPerBatch;
+    elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - started).count();
+  } while(elapsed < minSeconds);
+  const long long instructions = instructionCounter.Stop();
+  isCountingAllocations = false;
+
+  if(sink != output) {
+    std::fprintf(stderr, "output of render changed between calls\n");
+    return EXIT_FAILURE;
+  }
+
+  const double bytes
+    = static_cast<double>(output.size()) * renders;
+  std::printf(
+    "{\"renders\": %zu, \"bytes_per_render\": %zu"
+    ", \"ns_per_render\": %.1f, \"bytes_per_s\": %.0f"
+    ", \"allocations_per_render\": %.2f"
+    , renders
+    , output.size()
+    , elapsed * 1e9 / renders
+    , bytes / elapsed
+    , static_cast<double>(allocations) / renders);
+  if(instructionCounter.IsValid()) {
+    std::printf(", \"instructions_per_byte\": %.3f"
+      , instructions / bytes);
+  } else {
+    std::printf(", \"instructions_per_byte\": null");
+  }
+  std::printf("}\n");
+  return EXIT_SUCCESS;
+}
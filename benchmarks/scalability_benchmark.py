@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Measures how flextool with this plugin scales with number
+of annotations in one translation unit.
+
+For each annotation count generates synthetic translation unit
+with mix of `_squarets`, `_squaretsFile`, `_squaretsCodeAndReplace`
+and `_interpretSquarets` annotations (see generate_corpus.py),
+runs flextool over it and records wall time and peak RSS.
+
+Growth between neighbouring counts is compared with growth of count:
+time or memory that grows faster than `--max-growth` times count
+is reported as superlinear (exit code 1 with `--fail-on-superlinear`).
+
+Usually started by `flex_squarets_plugin_scalability_benchmark` target
+(requires `-DENABLE_TESTS=ON -DENABLE_BENCHMARKS=ON`).
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import compile_time_benchmark
+import generate_corpus
+
+
+def run_flextool(args, plugin_copy, input_file, outdir):
+    """Returns (wall seconds, peak RSS in bytes) of flextool process."""
+    command = [args.flextool]
+    command += compile_time_benchmark.read_lines(args.flextool_args_file)
+    command += [
+        "--indir=" + os.path.dirname(input_file),
+        "--outdir=" + outdir,
+        "--load_plugin=" + args.reflect_plugin,
+        "--load_plugin=" + plugin_copy,
+        input_file,
+    ]
+    # stderr may be large, so it is not kept in memory
+    with tempfile.TemporaryFile() as stderr_file:
+        started = time.monotonic()
+        process = subprocess.Popen(
+            command, stdout=subprocess.DEVNULL, stderr=stderr_file)
+        # rusage of this process only (not of all children)
+        _, status, rusage = os.wait4(process.pid, 0)
+        wall = time.monotonic() - started
+        process.returncode = os.waitstatus_to_exitcode(status)
+        if process.returncode != 0:
+            stderr_file.seek(0)
+            sys.stderr.write(stderr_file.read()[-10000:].decode(
+                errors="replace"))
+            raise subprocess.CalledProcessError(process.returncode, command)
+    # `ru_maxrss` is in kilobytes on Linux
+    return wall, rusage.ru_maxrss * 1024
+
+
+def growth_report(results, max_growth):
+    """Returns descriptions of superlinear growth between neighbours."""
+    problems = []
+    for previous, current in zip(results, results[1:]):
+        count_growth = current["annotations"] / previous["annotations"]
+        for metric in ("wall_s", "peak_rss_bytes"):
+            if previous[metric] <= 0:
+                continue
+            growth = current[metric] / previous[metric]
+            current[metric + "_growth"] = growth
+            if growth > max_growth * count_growth:
+                problems.append(
+                    "%s grows %.1f times for %d -> %d annotations"
+                    " (count grows %.1f times)" % (
+                        metric, growth, previous["annotations"],
+                        current["annotations"], count_growth))
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--flextool", required=True)
+    parser.add_argument("--flextool-args-file", required=True,
+                        help="extra flextool arguments, one per line")
+    parser.add_argument("--plugin", required=True)
+    parser.add_argument("--plugin-conf", required=True)
+    parser.add_argument("--reflect-plugin", required=True)
+    parser.add_argument("--mode", default="append",
+                        help="emission_mode of plugin")
+    parser.add_argument("--annotations", default="1000,10000,100000",
+                        help="annotation counts, in increasing order")
+    parser.add_argument("--mix", default=generate_corpus.DEFAULT_MIX,
+                        help="weights of annotation kinds")
+    parser.add_argument("--max-growth", type=float, default=2.0,
+                        help="allowed growth of time or memory"
+                             " relative to growth of count")
+    parser.add_argument("--fail-on-superlinear", action="store_true")
+    parser.add_argument("--workdir", required=True)
+    parser.add_argument("--output", required=True, help="results in JSON")
+    args = parser.parse_args()
+
+    corpus_dir = os.path.join(args.workdir, "corpus")
+    os.makedirs(corpus_dir, exist_ok=True)
+    plugin_copy = compile_time_benchmark.write_plugin_copy(
+        args.plugin, args.plugin_conf, args.mode,
+        os.path.join(args.workdir, "plugin"))
+
+    results = []
+    for count in [int(count) for count in args.annotations.split(",")]:
+        input_file = os.path.abspath(generate_corpus.generate_mixed(
+            corpus_dir, count, args.mix))
+        outdir = os.path.join(args.workdir, "out", str(count))
+        os.makedirs(outdir, exist_ok=True)
+        wall, peak_rss = run_flextool(args, plugin_copy, input_file, outdir)
+        results.append({
+            "annotations": count,
+            "mix": args.mix,
+            "source_bytes": os.path.getsize(input_file),
+            "wall_s": wall,
+            "peak_rss_bytes": peak_rss,
+            "us_per_annotation": wall * 1e6 / count,
+        })
+
+    problems = growth_report(results, args.max_growth)
+
+    with open(args.output, "w") as output_file:
+        json.dump({"results": results, "superlinear": problems},
+                  output_file, indent=2)
+
+    columns = ["annotations", "source_bytes", "wall_s",
+               "us_per_annotation", "peak_rss_bytes"]
+    print("\t".join(columns))
+    for result in results:
+        print("\t".join(
+            ("%.3f" % result[column]) if isinstance(result[column], float)
+            else str(result[column])
+            for column in columns))
+
+    for problem in problems:
+        print("superlinear: " + problem)
+
+    if problems and args.fail_on_superlinear:
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,4 +6,39 @@ list(APPEND flex_squarets_plugin_SOURCES
   ${flex_squarets_plugin_src_DIR}/EventHandler.cc
   ${flex_squarets_plugin_include_DIR}/Tooling.hpp
   ${flex_squarets_plugin_src_DIR}/Tooling.cc
+  ${flex_squarets_plugin_include_DIR}/Settings.hpp
+  ${flex_squarets_plugin_src_DIR}/Settings.cc
+  ${flex_squarets_plugin_include_DIR}/Hash.hpp
+  ${flex_squarets_plugin_src_DIR}/Hash.cc
+  ${flex_squarets_plugin_include_DIR}/PureResultCache.hpp
+  ${flex_squarets_plugin_src_DIR}/PureResultCache.cc
+  ${flex_squarets_plugin_include_DIR}/Stats.hpp
+  ${flex_squarets_plugin_src_DIR}/Stats.cc
+  ${flex_squarets_plugin_include_DIR}/TemplatePrefetcher.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplatePrefetcher.cc
+  ${flex_squarets_plugin_include_DIR}/TemplateScan.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateScan.cc
+  ${flex_squarets_plugin_include_DIR}/GeneratedCode.hpp
+  ${flex_squarets_plugin_src_DIR}/GeneratedCode.cc
+  ${flex_squarets_plugin_include_DIR}/TemplateParser.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateParser.cc
+  ${flex_squarets_plugin_include_DIR}/TemplateCache.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateCache.cc
+  ${flex_squarets_plugin_include_DIR}/TemplateEngines.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateEngines.cc
+  ${flex_squarets_plugin_include_DIR}/ForkedWorkers.hpp
+  ${flex_squarets_plugin_src_DIR}/ForkedWorkers.cc
+  ${flex_squarets_plugin_include_DIR}/AotRenderCache.hpp
+  ${flex_squarets_plugin_src_DIR}/AotRenderCache.cc
+  ${flex_squarets_plugin_include_DIR}/TemplateFile.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateFile.cc
+  ${flex_squarets_plugin_include_DIR}/TranslationUnitRegistry.hpp
+  ${flex_squarets_plugin_include_DIR}/TemplateSearchIndex.hpp
+  ${flex_squarets_plugin_src_DIR}/TemplateSearchIndex.cc
+  ${flex_squarets_plugin_include_DIR}/AllocationProfiler.hpp
+  ${flex_squarets_plugin_src_DIR}/AllocationProfiler.cc
+  ${flex_squarets_plugin_include_DIR}/HeaderAnnotationCache.hpp
+  ${flex_squarets_plugin_src_DIR}/HeaderAnnotationCache.cc
+  ${flex_squarets_plugin_include_DIR}/PerfMap.hpp
+  ${flex_squarets_plugin_src_DIR}/PerfMap.cc
 )
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <base/macros.h>
+
+#include <cstddef>
+
+namespace plugin {
+
+// parts of annotation processing measured by |AllocationProfiler|,
+// allocation is counted in innermost phase
+enum class AllocationPhase {
+  // code of annotation outside of other phases
+  // (like queries of clang AST)
+  kOther = 0,
+  // removes template engine prefix from annotation
+  kPrefix,
+  // converts annotation and templates between UTF-8 and UTF-16
+  kTranscode,
+  // reads template file
+  kReadFile,
+  // generates C++ code from template
+  kParse,
+  // builds code that passes clang objects into Cling
+  kPrelude,
+  // collects reflection of annotated class for Cling
+  kReflection,
+  // executes code in Cling interpreter
+  kInterpret,
+  // inserts generated code into rewritten source
+  kRewrite,
+  kTotal
+};
+
+struct AllocationCounters {
+  size_t allocations = 0;
+
+  size_t bytes = 0;
+};
+
+// counts allocations of annotation per |AllocationPhase|
+// using allocator shim of chromium `base`
+// (hook is called for each `malloc` and `new` of process).
+/// \note requires plugin built with `ENABLE_ALLOCATION_PROFILING`
+/// and `base` built with allocator shim
+/// \note counters are kept per thread, so annotations
+/// processed in parallel are counted separately
+/// \note without `ENABLE_ALLOCATION_PROFILING` methods do nothing
+/// (plugin has no thread-local storage for counters)
+class AllocationProfiler {
+public:
+  // installs allocator hook once per process,
+  // returns false if allocator shim is not available
+  /// \note hook can not be removed,
+  /// so plugin library is not unloaded after that call
+  static bool Install();
+
+  // resets counters of current thread and starts counting
+  static void BeginThreadCounting();
+
+  // stops counting and stores counters of current thread
+  // in |counters| (|AllocationPhase::kTotal| elements)
+  static void EndThreadCounting(AllocationCounters* counters);
+
+  // returns previous phase of current thread
+  static AllocationPhase SetThreadPhase(AllocationPhase phase);
+
+private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(AllocationProfiler);
+};
+
+// sets phase of current thread
+// from construction to destruction
+class ScopedAllocationPhase {
+public:
+  explicit ScopedAllocationPhase(AllocationPhase phase);
+
+  ~ScopedAllocationPhase();
+
+private:
+  const AllocationPhase previousPhase_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedAllocationPhase);
+};
+
+} // namespace plugin
@@ -0,0 +1,111 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/native_library.h>
+#include <base/strings/string_piece.h>
+#include <base/synchronization/lock.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// caches machine code of `{interpretSquarets};` annotations
+// between runs: source of each unique render function is compiled
+// by system compiler into shared library, so next runs
+// load library instead of JIT-compiling same code in Cling.
+/// \note library is found by hash of code and ABI of interpreter
+/// (see |Configure|), so changed headers or compiler
+/// produce new libraries
+/// \note thread-safe
+class AotRenderCache {
+public:
+  explicit AotRenderCache(
+    const base::FilePath& cacheDir);
+
+  // unloads libraries,
+  // functions returned by |FindFunction| become invalid
+  ~AotRenderCache();
+
+  // name of function that must be defined
+  // by source passed to |ScheduleBuild|
+  static std::string FunctionName(
+    const std::string& key);
+
+  // |compileCommand| is compiler followed by flags
+  // (must produce code compatible with current process),
+  // |abi| is description of interpreter (version, target, prelude).
+  // Runs compiler to find its version, returns false if compiler
+  // can not be used (cache stays disabled)
+  bool Configure(
+    std::vector<std::string> compileCommand
+    , const std::string& abi);
+
+  bool IsConfigured() const;
+
+  // key of library for |code| (empty if not configured)
+  std::string KeyFor(
+    const base::StringPiece& code) const;
+
+  // returns function built for |key| by previous runs,
+  // nullptr if library not built yet or can not be loaded
+  /// \note result is remembered, so library is looked up
+  /// once per process (until |BuildPending| builds it)
+  void* FindFunction(
+    const std::string& key);
+
+  // stores |source| that defines |FunctionName(key)|,
+  // library is built by |BuildPending|
+  void ScheduleBuild(
+    const std::string& key
+    , std::string source);
+
+  // compiles libraries scheduled by |ScheduleBuild|
+  // using up to |maxProcesses| compilers in parallel
+  void BuildPending(
+    size_t maxProcesses);
+
+private:
+  base::FilePath libraryPath(
+    const std::string& key) const;
+
+  // returns false if library can not be built,
+  // errors of compiler are logged
+  bool buildLibrary(
+    const std::vector<std::string>& compileCommand
+    , const std::string& key
+    , const std::string& source) const;
+
+  const base::FilePath cacheDir_;
+
+  // guards members below
+  mutable base::Lock lock_;
+
+  std::vector<std::string> compileCommand_;
+
+  // hash of interpreter ABI and compiler version,
+  // empty if not configured
+  std::string abiHash_;
+
+  std::map<std::string, base::NativeLibrary> libraries_;
+
+  // nullptr if library does not exist or can not be loaded
+  std::map<std::string, void*> functions_;
+
+  // keys of |functions_| without library,
+  // forgotten when |BuildPending| builds library
+  std::set<std::string> missing_;
+
+  // key to source of library
+  std::map<std::string, std::string> pending_;
+
+  // for report in |BuildPending|
+  size_t hits_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(AotRenderCache);
+};
+
+} // namespace plugin
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include <flex_squarets_plugin/Tooling.hpp>
+#include <flex_squarets_plugin/Settings.hpp>
+#include <flex_squarets_plugin/TemplateEngines.hpp>
 
 #include <flexlib/ToolPlugin.hpp>
 #if defined(CLING_IS_ON)
@@ -10,13 +12,17 @@
 #include <base/logging.h>
 #include <base/sequenced_task_runner.h>
 
+#include <string>
+#include <vector>
+
 namespace plugin {
 
 /// \note class name must not collide with
 /// class names from other loaded plugins
 class FlexSquaretsEventHandler {
 public:
-  FlexSquaretsEventHandler();
+  explicit FlexSquaretsEventHandler(
+    const SquaretsSettings& settings);
 
   ~FlexSquaretsEventHandler();
 
@@ -31,9 +37,33 @@ public:
   void RegisterAnnotationMethods(
     const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event);
 
+  // called when plugin unloads,
+  // writes files generated by |SquaretsTooling|
+  void Unload();
+
+  // same as |SquaretsTooling::RegisterTemplateEngine|,
+  // engine is kept for all next runs
+  /// \note |SquaretsTooling| may be created again on each run
+  /// (if server mode is off), so engines must be registered here
+  void RegisterTemplateEngine(
+    const std::string& prefix
+    , TemplateEngineCallback generate);
+
 private:
+  // registers |templateEngines_| in new |tooling_|
+  void RegisterTemplateEngines();
+
   std::unique_ptr<SquaretsTooling> tooling_;
 
+  const SquaretsSettings settings_;
+
+  // keep |tooling_| between runs,
+  // changed by `/squarets_server on|off`
+  bool serverMode_;
+
+  // engines added by |RegisterTemplateEngine|, in order of registration
+  std::vector<TemplateEngine> templateEngines_;
+
 #if defined(CLING_IS_ON)
   ::cling_utils::ClingInterpreter* clingInterpreter_;
 #endif // CLING_IS_ON
@@ -43,4 +73,14 @@ private:
   DISALLOW_COPY_AND_ASSIGN(FlexSquaretsEventHandler);
 };
 
+// adds template engine to loaded `FlexSquarets` plugin
+// (see |FlexSquaretsEventHandler::RegisterTemplateEngine|),
+// returns false if |toolPlugin| is not `FlexSquarets`
+/// \note defined by plugin library, so caller must link it
+/// or find symbol in loaded plugin
+bool RegisterSquaretsTemplateEngine(
+  ::plugin::ToolPlugin& toolPlugin
+  , const std::string& prefix
+  , TemplateEngineCallback generate);
+
 } // namespace plugin
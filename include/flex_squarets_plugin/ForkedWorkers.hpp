@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+#include <build/build_config.h>
+
+#include <string>
+
+namespace plugin {
+
+// status of task executed by |ForkedWorkers|
+enum class WorkerStatus {
+  // task finished and wrote |output|
+  kOk = 0,
+  // task finished without result (|output| is empty)
+  kNoResult = 1,
+  // task failed (for example, code can not be compiled)
+  kFailed = 2,
+  // worker process crashed, was killed
+  // (for example, by memory limit) or can not be started
+  kCrashed = 3,
+};
+
+// runs tasks in child processes created by `fork()`,
+// so each worker starts with snapshot of current process
+// (warmed Cling interpreter, AST, reflection data)
+// and crash or memory leak of task does not affect host process.
+/// \note host must not run other threads while tasks are forked:
+/// worker may inherit lock held by other thread at time of fork
+/// and hang on it (worker that does not send result in time
+/// is killed, but caller must avoid that case)
+/// \note changes made by task to memory of worker process
+/// (including interpreter state) are not visible to host,
+/// only |output| is sent back
+/// \note thread-safe, up to |maxWorkers| tasks run at the same time
+class ForkedWorkers {
+public:
+  // |memoryLimitInBytes| is max. memory allocated by each worker
+  // in addition to snapshot of host process (0 means no limit),
+  // worker is killed if result is not received in |timeout|
+  // (zero means no limit)
+  ForkedWorkers(
+    size_t maxWorkers
+    , size_t memoryLimitInBytes
+    , base::TimeDelta timeout);
+
+  ~ForkedWorkers();
+
+  // returns true if workers can be used on current platform
+  static bool IsSupported();
+
+  using Task = base::OnceCallback<WorkerStatus(std::string* output)>;
+
+  // waits for free worker slot and runs |task| in child process,
+  // blocks until child exits.
+  // |forkLock| is held only while process is forked,
+  // so state shared with other threads (like interpreter)
+  // is not modified during snapshot
+  WorkerStatus Run(
+    base::Lock* forkLock
+    , Task task
+    , std::string* output);
+
+private:
+  const size_t maxWorkers_;
+
+  const size_t memoryLimitInBytes_;
+
+  const base::TimeDelta timeout_;
+
+  // guards |activeWorkers_|
+  base::Lock lock_;
+
+  // signaled when worker exits
+  base::ConditionVariable workerExited_;
+
+  size_t activeWorkers_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(ForkedWorkers);
+};
+
+} // namespace plugin
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <flex_squarets_plugin/Settings.hpp>
+
+#include <base/strings/string_piece.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// part of code generated by squarets
+struct GeneratedSegment {
+  enum class Kind {
+    // C++ code from template tags
+    kCode,
+    // text appended by `out += R"raw(...)raw";`
+    kLiteral
+  };
+
+  Kind kind;
+
+  // code or contents of literal (without quotes)
+  std::string text;
+};
+
+// appends `R"raw(text)raw"` to |output|, delimiter is chosen
+// so that it does not occur in |text|
+void appendRawStringLiteral(
+  const base::StringPiece& text
+  , std::string* output);
+
+// same as |appendRawStringLiteral|
+std::string makeRawStringLiteral(
+  const base::StringPiece& text);
+
+// splits generated code into literal appends to |outputName|
+// and other code, concatenated segments are equal to |code|
+/// \note adjacent literals separated only by whitespace are merged,
+/// strings and comments in code are skipped
+std::vector<GeneratedSegment> splitGeneratedCode(
+  const base::StringPiece& code
+  , const base::StringPiece& outputName);
+
+// removes whitespace from literals of |segments| according to |mode|,
+// literals that became empty are removed
+/// \note output of code segments is unknown, so text after code
+/// is treated as continuation of line
+/// (but `#` after code may start directive)
+void minifyLiterals(
+  std::vector<GeneratedSegment>* segments
+  , LiteralMinification mode);
+
+// joins |segments| back into code,
+// each literal is appended by single statement
+std::string joinGeneratedCode(
+  const std::vector<GeneratedSegment>& segments
+  , const base::StringPiece& outputName);
+
+// largest prefix of |text| that fits into |chunkSize|
+// and does not split UTF-8 sequence (used by |emitLiteralTable|)
+size_t chunkLength(
+  const base::StringPiece& text
+  , size_t chunkSize);
+
+// stores literals of |segments| in static array of `std::string_view`
+// chunks (each at most |chunkSize| bytes) named |tableName|,
+// literal is replaced by loop over its range of chunks
+/// \note generated code requires `<string_view>`
+std::string emitLiteralTable(
+  const std::vector<GeneratedSegment>& segments
+  , const base::StringPiece& outputName
+  , size_t chunkSize
+  , const std::string& tableName);
+
+} // namespace plugin
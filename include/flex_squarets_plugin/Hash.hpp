@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include <initializer_list>
+#include <string>
+
+namespace plugin {
+
+// returns MD5 of |parts| (each prefixed by its length,
+// so `{"ab", "c"}` and `{"a", "bc"}` differ) as hex string,
+// result is same between runs (can be used as key in persistent caches)
+std::string hashToHex(
+  std::initializer_list<llvm::StringRef> parts);
+
+} // namespace plugin
@@ -0,0 +1,151 @@
+﻿#pragma once
+
+#include <base/containers/mru_cache.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+
+#include <clang/Basic/SourceLocation.h>
+
+#include <llvm/ADT/StringRef.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+class Rewriter;
+} // namespace clang
+
+namespace plugin {
+
+// change of rewritten source made by annotation,
+// |offset| is relative to start of annotated file
+struct AnnotationEdit {
+  enum class Kind {
+    // `rewriter.InsertText(loc, text, InsertAfter=true)`
+    kInsertAfter,
+    // `rewriter.ReplaceText(loc, length, text)`
+    kReplace
+  };
+
+  Kind kind;
+
+  unsigned offset = 0;
+
+  // size of replaced text (only |Kind::kReplace|)
+  unsigned length = 0;
+
+  std::string text;
+
+  // name of render helper declared by edit
+  // (see |insertRenderHelper|), empty for other edits
+  std::string renderHelper;
+};
+
+// render helpers already inserted into translation unit,
+// stores pairs of (file id, helper name)
+using RenderHelperSet = std::set<std::pair<unsigned, std::string>>;
+
+// edits made while annotation is expanded
+struct AnnotationEditRecorder {
+  // file that contains annotation
+  clang::FileID fileID;
+
+  std::vector<AnnotationEdit> edits;
+
+  // false if annotation changed other file,
+  // so its edits can not be replayed
+  bool isReplayable = true;
+};
+
+// `rewriter.InsertText(loc, text, InsertAfter=true)`,
+// edit is added to |recorder| if not null
+void insertTextAfter(
+  clang::Rewriter& rewriter
+  , clang::SourceLocation loc
+  , llvm::StringRef text
+  , AnnotationEditRecorder* recorder);
+
+// same as |insertTextAfter| for declaration of render helper
+// |helperName|, so replayed edit is skipped if translation unit
+// already has that helper
+void insertRenderHelper(
+  clang::Rewriter& rewriter
+  , clang::SourceLocation loc
+  , llvm::StringRef text
+  , const std::string& helperName
+  , AnnotationEditRecorder* recorder);
+
+// `rewriter.ReplaceText(range, text)`,
+// edit is added to |recorder| if not null
+void replaceText(
+  clang::Rewriter& rewriter
+  , clang::SourceRange range
+  , llvm::StringRef text
+  , AnnotationEditRecorder* recorder);
+
+// applies |edits| recorded by |AnnotationEditRecorder|
+// to file |fileID| of other translation unit,
+// render helpers of |edits| are added to |renderHelpers|
+// (helper that is already there is not inserted again)
+void replayEdits(
+  clang::Rewriter& rewriter
+  , clang::FileID fileID
+  , const std::vector<AnnotationEdit>& edits
+  , RenderHelperSet* renderHelpers);
+
+// keeps edits of annotations placed in headers, so header
+// included by many translation units is expanded once per run
+// (see |SquaretsSettings::headerAnnotationCache|)
+/// \note thread-safe, returned values stay valid
+/// even if entry is evicted by other thread
+class HeaderAnnotationCache {
+public:
+  explicit HeaderAnnotationCache(
+    size_t maxEntries);
+
+  ~HeaderAnnotationCache();
+
+  // annotation is identified by its file (path and hash of contents),
+  // offset in that file, name of output variable
+  // and annotation text (macros of annotation may expand
+  // differently in other translation unit)
+  static std::string MakeKey(
+    const std::string& filePath
+    , const std::string& contentHash
+    , unsigned offset
+    , const std::string& outputName
+    , const std::string& processedAnnotation);
+
+  // returns null if annotation was not expanded yet
+  std::shared_ptr<const std::vector<AnnotationEdit>> Find(
+    const std::string& key);
+
+  void Store(
+    const std::string& key
+    , std::vector<AnnotationEdit> edits);
+
+  // logs number of reused annotations, does nothing if cache is empty
+  void ReportStatus() const;
+
+  void Clear();
+
+private:
+  // guards all members below
+  mutable base::Lock lock_;
+
+  base::MRUCache<
+      std::string
+      , std::shared_ptr<const std::vector<AnnotationEdit>>
+    > entries_;
+
+  size_t hits_ = 0;
+
+  size_t misses_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(HeaderAnnotationCache);
+};
+
+} // namespace plugin
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <base/macros.h>
+#include <base/strings/string_piece.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace plugin {
+
+// appends entries to `/tmp/perf-<pid>.map`
+// (see `tools/perf/Documentation/jit-interface.txt` of Linux),
+// so `perf report` names code JIT-compiled by Cling
+// instead of showing anonymous addresses
+/// \note file is chosen by pid of calling process,
+/// so forked workers (see |ForkedWorkers|) write own file
+/// \note entries are never removed, perf may attribute samples
+/// to stale entry if memory of unloaded code is reused
+class PerfMap {
+public:
+  // appends `<start> <size> <name>` line,
+  // returns false if file can not be written
+  static bool AddEntry(
+    uintptr_t start
+    , size_t size
+    , base::StringPiece name);
+
+private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(PerfMap);
+};
+
+} // namespace plugin
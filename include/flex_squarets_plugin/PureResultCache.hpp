@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/optional.h>
+#include <base/strings/string_piece.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// removes `PURE(input_file_1,input_file_2);` prefix from |contents|
+// example before:
+// contents == "PURE(a.txt);CXTPL;code"
+// example after:
+// contents == "CXTPL;code" and inputFiles == {"a.txt"}
+// returns false if |contents| has no `PURE(...);` prefix
+bool removePureDirective(
+  base::StringPiece16& contents
+  , std::vector<base::FilePath>* inputFiles);
+
+// returns per-user cache directory inside of temporary directory,
+// created with owner-only permissions.
+// Returns empty path if directory can not be created
+// or may be written by other users
+// (cached results are inserted into generated code)
+base::FilePath defaultPureCacheDir();
+
+// caches on disk results of code executed by Cling.
+// Code must be pure function of its own text
+// and of its declared input files.
+/// \note cache entry becomes invalid if contents
+/// of any declared input file changed
+/// \note thread-safe, entries are written atomically
+class PureResultCache {
+public:
+  explicit PureResultCache(
+    const base::FilePath& cacheDir);
+
+  ~PureResultCache();
+
+  // returns result previously stored by |Put|
+  // for same |code| and same (resolved) |inputFiles|
+  base::Optional<std::string> Get(
+    const base::StringPiece& code
+    , const std::vector<base::FilePath>& inputFiles);
+
+  void Put(
+    const base::StringPiece& code
+    , const std::vector<base::FilePath>& inputFiles
+    , const std::string& result);
+
+private:
+  // same code with different input files
+  // (like relative paths resolved against other directory)
+  // uses other entry
+  base::FilePath entryPath(
+    const base::StringPiece& code
+    , const std::vector<base::FilePath>& inputFiles) const;
+
+  const base::FilePath cacheDir_;
+
+  DISALLOW_COPY_AND_ASSIGN(PureResultCache);
+};
+
+} // namespace plugin
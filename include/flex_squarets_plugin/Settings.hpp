@@ -0,0 +1,185 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Corrade {
+namespace Utility {
+class ConfigurationGroup;
+} // namespace Utility
+} // namespace Corrade
+
+namespace plugin {
+
+// shape of code generated for literal text of templates
+enum class EmissionMode {
+  // `out += R"raw(...)raw";` per literal (as squarets generates)
+  kAppend,
+  // literals are stored in static array of `std::string_view` chunks,
+  // compiles faster for large templates
+  kTable
+};
+
+// whitespace removed from literal text of templates
+// at generation time, code in template tags is not changed
+enum class LiteralMinification {
+  // literal text is emitted as is
+  kNone,
+  // indentation (spaces and tabs) at start of each line is removed
+  kIndent,
+  // |kIndent|, also trailing spaces and blank lines are removed
+  kLines,
+  // each run of whitespace (including newlines) becomes single space,
+  // except newlines that end `//` comments or preprocessor directives
+  kAll
+};
+
+// options that change shape of generated code,
+// see `[configuration]` in `flex_squarets_plugin.conf`
+struct SquaretsSettings {
+  // reads options from plugin-specific configuration,
+  // missing keys keep default values
+  static SquaretsSettings FromConfiguration(
+    const Corrade::Utility::ConfigurationGroup& configuration);
+
+  // emit one `inline` render function per unique
+  // (template, type of output variable) and
+  // call it from each annotated variable
+  /// \note helper is placed into global namespace,
+  /// so template must use only names that are visible
+  /// at global scope (no local variables),
+  /// code is inserted into variable if type of variable
+  /// is not defined before helper
+  bool renderHelpers = false;
+
+  // if not empty, then generated code will be moved
+  // into `<file name>.<path hash>.squarets.cc` files inside of that
+  // directory (hash of full path, so same file names do not collide)
+  // and annotated variable will only call generated function
+  /// \note template must use only names that are visible
+  /// at global scope (no local variables)
+  std::string outOfLineDir;
+
+  // `#include` directives for files
+  // generated by |outOfLineDir| (like `<string>`)
+  std::vector<std::string> outOfLineIncludes;
+
+  // directory that stores results of `PURE(...);` annotations
+  // (see |PureResultCache|), uses |defaultPureCacheDir| if empty
+  std::string pureCacheDir;
+
+  // warns if processing of single annotation
+  // (parsing and Cling execution) took longer,
+  // zero disables check
+  int annotationBudgetMs = 0;
+
+  // fail instead of warning if |annotationBudgetMs| exceeded
+  bool annotationBudgetStrict = false;
+
+  // number of slowest annotations reported at the end of run,
+  // zero disables report
+  int slowAnnotationsReport = 10;
+
+  // count allocations of each annotation per phase
+  // (see |AllocationProfiler|), report is limited
+  // by |slowAnnotationsReport|
+  /// \note requires plugin built with `ENABLE_ALLOCATION_PROFILING`
+  bool allocationProfiling = false;
+
+  // number of threads that load and parse
+  // `{squaretsFile};` templates in background
+  // at start of each translation unit, zero disables prefetching
+  int prefetchThreads = 0;
+
+  // keep caches between runs of long-lived process
+  // (see `/squarets_server` command),
+  // template files are watched for changes
+  bool serverMode = false;
+
+  // limits size (in megabytes) of code generated from templates
+  // and kept between runs by |serverMode|,
+  // least recently used code is evicted
+  int serverCacheMb = 64;
+
+  // expand annotation placed in header once per run and
+  // reuse its edits in other translation units that include header
+  // (see |HeaderAnnotationCache|)
+  /// \note code executed by Cling must not depend on
+  /// translation unit, edits made by that code
+  /// via `clangRewriter` are not reused
+  /// \note ignored if |outOfLineDir| is used
+  bool headerAnnotationCache = false;
+
+  EmissionMode emissionMode = EmissionMode::kAppend;
+
+  // max. size in bytes of string literal
+  // generated by |EmissionMode::kTable|
+  /// \note MSVC does not support string literals
+  /// longer than 16380 bytes
+  int literalChunkSize = 16000;
+
+  // applied to literals of emitted code (not to code executed by
+  // `_interpretSquarets`), see |minifyLiterals|
+  /// \note whitespace may be significant for generated text
+  /// (like Python or Makefile), so minification is opt-in
+  LiteralMinification literalMinification = LiteralMinification::kNone;
+
+  // unload code of each annotation from Cling interpreter
+  // after its result is captured, so memory of interpreter
+  // grows slower with number of annotations
+  /// \note opt-in: unloaded code must not be referenced
+  /// by later annotations (like functions or global variables
+  /// declared by interpreted code)
+  bool clingUnloadTransactions = false;
+
+  // max. number of worker processes that execute code of annotations
+  // (see |ForkedWorkers|), 0 means code is executed
+  // by interpreter of host process
+  /// \note ignored with |prefetchThreads| and while translation units
+  /// are processed by several threads (fork of multithreaded
+  /// process is not safe), code is executed by host process then
+  int clingWorkers = 0;
+
+  // max. memory in megabytes allocated by each worker process,
+  // 0 means no limit
+  int clingWorkerMemoryMb = 0;
+
+  // worker process that does not send result in that time
+  // is killed (for example, endless loop of interpreted code),
+  // 0 means no limit
+  int clingWorkerTimeoutMs = 60000;
+
+  // name code JIT-compiled for each annotation after its location
+  // in `/tmp/perf-<pid>.map` (see |PerfMap|),
+  // so Linux `perf` can attribute samples to templates
+  bool clingPerfMap = false;
+
+  // where machine code of `{interpretSquarets};` annotations
+  // is cached between runs (see |AotRenderCache|),
+  // empty means code is always JIT-compiled by Cling
+  std::string aotCacheDir;
+
+  // compiler that builds shared libraries for |aotCacheDir|,
+  // must be ABI-compatible with flextool
+  std::string aotCompiler = "c++";
+
+  // passed to |aotCompiler| before include paths
+  // and macros of Cling interpreter
+  std::string aotFlags = "-std=c++17 -O2";
+
+  // header included by each library built for |aotCacheDir|,
+  // usually same as file passed to `--cling_scripts`
+  std::string aotPrelude;
+
+  // build libraries for |aotCacheDir| when plugin unloads
+  // instead of end of each run, so runs of long-lived process
+  // (see |serverMode|) do not wait for compiler
+  bool aotDeferredBuild = false;
+
+  // directories where relative paths of `{squaretsFile};`
+  // templates are searched (see |TemplateSearchIndex|),
+  // in order of priority
+  std::vector<std::string> templateSearchPaths;
+};
+
+} // namespace plugin
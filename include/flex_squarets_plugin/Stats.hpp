@@ -0,0 +1,204 @@
+﻿#pragma once
+
+#include <flex_squarets_plugin/AllocationProfiler.hpp>
+
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/platform_thread.h>
+#include <base/time/time.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// parts of annotation processing measured by |SquaretsStats|
+enum class AnnotationPhase {
+  // reads template file
+  kReadFile = 0,
+  // generates C++ code from template
+  kParse,
+  // executes code in Cling interpreter
+  kInterpret,
+  kTotal
+};
+
+// collects time spent on each annotation,
+// checks per-annotation time budget
+// and reports slowest annotations
+/// \note thread-safe, each thread has own current annotation
+class SquaretsStats {
+public:
+  struct AnnotationRecord {
+    // annotation method, like `squaretsFile`
+    std::string method;
+
+    // source location of annotated declaration
+    std::string location;
+
+    base::TimeDelta phases[static_cast<size_t>(AnnotationPhase::kTotal)];
+
+    // zero if allocation profiling is disabled
+    AllocationCounters allocations[
+      static_cast<size_t>(AllocationPhase::kTotal)];
+
+    // sum of all phases
+    base::TimeDelta Total() const;
+
+    // sum of |allocations| of all phases
+    AllocationCounters TotalAllocations() const;
+  };
+
+  // |budget| is zero if annotations are not limited in time,
+  // |allocationProfiling| counts allocations of each annotation
+  // (see |AllocationProfiler|)
+  SquaretsStats(
+    base::TimeDelta budget
+    , bool strictBudget
+    , bool allocationProfiling = false);
+
+  ~SquaretsStats();
+
+  void BeginAnnotation(
+    const std::string& method
+    , const std::string& location);
+
+  // checks time budget of annotation
+  // started by |BeginAnnotation| on same thread
+  void EndAnnotation();
+
+  void AddPhaseTime(
+    AnnotationPhase phase
+    , base::TimeDelta elapsed);
+
+  // logs |limit| slowest annotations with time spent on each phase
+  void ReportSlowest(size_t limit) const;
+
+  // records state of Cling interpreter after annotation code executed:
+  // heap memory in use (see |HeapBytesInUse|), memory allocated by AST,
+  // number of transactions (JIT modules)
+  // and number of transactions unloaded after execution
+  /// \note AST memory is arena that is not shrunk by unload
+  void AddInterpreterSample(
+    size_t heapBytes
+    , size_t astBytes
+    , size_t liveTransactions
+    , size_t unloadedTransactions);
+
+  // bytes allocated by `malloc` of process and not freed yet,
+  // zero if allocator does not report it
+  /// \note includes allocations of other threads
+  static size_t HeapBytesInUse();
+
+  // logs growth of interpreter memory, does nothing if
+  // |AddInterpreterSample| was not called
+  void ReportInterpreterMemory() const;
+
+  // records template file decompressed by |readTemplateFile|,
+  // |elapsed| includes reading of compressed file
+  void AddDecompressedFile(
+    size_t compressedBytes
+    , size_t decompressedBytes
+    , base::TimeDelta elapsed);
+
+  // logs allocations of each |AllocationPhase| and |limit| annotations
+  // that allocated most bytes, does nothing if allocation profiling
+  // is disabled
+  void ReportAllocations(size_t limit) const;
+
+  // logs compression ratio and time spent on decompression,
+  // does nothing if |AddDecompressedFile| was not called
+  void ReportDecompression() const;
+
+  // forgets reported annotations, interpreter samples
+  // and decompressed files
+  void Clear();
+
+private:
+  const base::TimeDelta budget_;
+
+  const bool strictBudget_;
+
+  // true if |AllocationProfiler| is installed
+  const bool allocationProfiling_;
+
+  mutable base::Lock lock_;
+
+  // annotations between |BeginAnnotation| and |EndAnnotation|,
+  // guarded by |lock_|
+  std::map<base::PlatformThreadId, AnnotationRecord> currentRecords_;
+
+  // finished annotations, guarded by |lock_|
+  std::vector<AnnotationRecord> records_;
+
+  // state of Cling interpreter, guarded by |lock_|
+  struct InterpreterMemory {
+    size_t samples = 0;
+
+    size_t firstHeapBytes = 0;
+
+    size_t lastHeapBytes = 0;
+
+    size_t peakHeapBytes = 0;
+
+    size_t lastAstBytes = 0;
+
+    size_t lastTransactions = 0;
+
+    size_t unloadedTransactions = 0;
+  };
+  InterpreterMemory interpreterMemory_;
+
+  // compressed template files, guarded by |lock_|
+  struct Decompression {
+    size_t files = 0;
+
+    size_t compressedBytes = 0;
+
+    size_t decompressedBytes = 0;
+
+    base::TimeDelta elapsed;
+  };
+  Decompression decompression_;
+
+  DISALLOW_COPY_AND_ASSIGN(SquaretsStats);
+};
+
+// measures annotation from construction to destruction
+class ScopedAnnotationRecord {
+public:
+  ScopedAnnotationRecord(
+    SquaretsStats* stats
+    , const std::string& method
+    , const std::string& location);
+
+  ~ScopedAnnotationRecord();
+
+private:
+  SquaretsStats* stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedAnnotationRecord);
+};
+
+// measures phase of current annotation
+// from construction to destruction
+class ScopedAnnotationPhase {
+public:
+  ScopedAnnotationPhase(
+    SquaretsStats* stats
+    , AnnotationPhase phase);
+
+  ~ScopedAnnotationPhase();
+
+private:
+  SquaretsStats* stats_;
+
+  const AnnotationPhase phase_;
+
+  const base::TimeTicks startTime_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedAnnotationPhase);
+};
+
+} // namespace plugin
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#include <base/containers/mru_cache.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/strings/string16.h>
+#include <base/strings/string_piece.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+#include <build/build_config.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// reports template files changed since previous check,
+// uses inotify on Linux and modification time elsewhere
+/// \note changed file is not watched anymore,
+/// call |Watch| again after file reloaded
+/// \note not thread-safe, guarded by lock of |TemplateCache|
+class TemplateFileWatcher {
+public:
+  TemplateFileWatcher();
+
+  ~TemplateFileWatcher();
+
+  void Watch(const base::FilePath& path);
+
+  // returns files changed since previous call
+  // (does not block)
+  std::vector<base::FilePath> TakeChangedFiles();
+
+private:
+  // used if inotify is not available
+  struct FileStamp {
+    bool exists = false;
+
+    base::Time lastModified;
+
+    int64_t size = 0;
+
+    bool operator==(const FileStamp& other) const;
+  };
+
+  static FileStamp GetFileStamp(const base::FilePath& path);
+
+  void unwatch(const base::FilePath& path);
+
+  // inotify watch descriptor of each watched file,
+  // -1 if file is checked by |FileStamp|
+  std::map<base::FilePath, int> watchDescriptors_;
+
+  std::map<base::FilePath, FileStamp> fileStamps_;
+
+#if defined(OS_LINUX)
+  // -1 if inotify is not available
+  int inotifyFd_ = -1;
+
+  // one inode may be watched by many paths
+  std::multimap<int, base::FilePath> watchedPaths_;
+#endif // OS_LINUX
+
+  DISALLOW_COPY_AND_ASSIGN(TemplateFileWatcher);
+};
+
+// keeps loaded and parsed templates between runs
+// of long-lived process (see |SquaretsSettings::serverMode|)
+/// \note thread-safe, returned values stay valid
+/// even if entry is evicted by other thread
+class TemplateCache {
+public:
+  // |maxGeneratedBytes| limits total size of stored
+  // results of |parseTemplate|, least recently used are evicted
+  /// \note result larger than limit is not stored
+  explicit TemplateCache(
+    size_t maxGeneratedBytes);
+
+  ~TemplateCache();
+
+  // forgets template files changed since previous call
+  void InvalidateChangedFiles();
+
+  // same as |FindFile|, but does not change hit rate
+  bool HasFile(
+    const base::FilePath& path) const;
+
+  // returns nullptr if file was not loaded or changed
+  std::shared_ptr<const base::string16> FindFile(
+    const base::FilePath& path);
+
+  // must be called before file is read,
+  // so changes made during read are not lost
+  void WatchFile(
+    const base::FilePath& path);
+
+  // remembers contents of template file until file changes
+  /// \note file must be watched by |WatchFile|
+  std::shared_ptr<const base::string16> StoreFile(
+    const base::FilePath& path
+    , base::string16 contents);
+
+  // returns nullptr if |templateContents| was not parsed
+  // by engine |enginePrefix| for output variable |outputName|
+  std::shared_ptr<const std::string> FindGenerated(
+    const std::string& enginePrefix
+    , const std::string& outputName
+    , const base::StringPiece16& templateContents);
+
+  void StoreGenerated(
+    const std::string& enginePrefix
+    , const std::string& outputName
+    , const base::StringPiece16& templateContents
+    , std::string generatedCode);
+
+  // forgets results of |StoreGenerated|
+  // (template engine was replaced)
+  void ClearGenerated();
+
+  // logs number and size of cached templates and hit rate
+  void ReportStatus() const;
+
+private:
+  static std::string generatedKey(
+    const std::string& enginePrefix
+    , const std::string& outputName
+    , const base::StringPiece16& templateContents);
+
+  // guards all members below
+  mutable base::Lock lock_;
+
+  TemplateFileWatcher watcher_;
+
+  std::map<base::FilePath, std::shared_ptr<const base::string16>> files_;
+
+  // maps hash of (engine, output name, template) to generated code,
+  // evicted by |StoreGenerated| (not limited by number of entries)
+  base::MRUCache<std::string, std::shared_ptr<const std::string>>
+    generated_;
+
+  const size_t maxGeneratedBytes_;
+
+  // total size of values of |generated_|
+  size_t generatedBytes_ = 0;
+
+  size_t fileHits_ = 0;
+
+  size_t fileMisses_ = 0;
+
+  size_t generatedHits_ = 0;
+
+  size_t generatedMisses_ = 0;
+
+  size_t invalidatedFiles_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(TemplateCache);
+};
+
+} // namespace plugin
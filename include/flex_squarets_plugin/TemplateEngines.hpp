@@ -0,0 +1,94 @@
+﻿#pragma once
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/strings/string_piece.h>
+#include <base/synchronization/lock.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// generates C++ code that appends rendered template
+// to variable |outputName|,
+// returns false and sets |errorMessage| (if not null)
+// if template can not be parsed
+using TemplateEngineCallback
+  = base::RepeatingCallback<
+      bool(
+        const std::string& outputName
+        , const base::StringPiece16& templateContents
+        , std::string* generatedCode
+        , std::string* errorMessage)>;
+
+struct TemplateEngine {
+  // annotation prefix that selects engine, like `CXTPL;`
+  std::string prefix;
+
+  TemplateEngineCallback generate;
+};
+
+// maps annotation prefix (like `CXTPL;` or `RAW;`)
+// to template engine, see `{squarets};CXTPL;...`
+/// \note thread-safe
+class TemplateEngineRegistry {
+public:
+  // registers built-in engines:
+  // `CXTPL;` (squarets) and `RAW;` (text without tags)
+  TemplateEngineRegistry();
+
+  ~TemplateEngineRegistry();
+
+  // replaces engine with same prefix
+  /// \note |prefix| compared case-insensitive
+  /// and must end with `;`
+  void Register(
+    const std::string& prefix
+    , TemplateEngineCallback generate);
+
+  // removes prefix of registered engine from |contents|,
+  // returns nullptr (|contents| not changed) if no engine found
+  /// \note result is valid until registry destroyed,
+  /// even if engine is replaced by |Register|
+  const TemplateEngine* Find(
+    base::StringPiece16& contents) const;
+
+  // true if |engine| is built-in `CXTPL;` engine,
+  // i.e. prefetched code can be used for it
+  /// \note engine that replaced `CXTPL;` by |Register|
+  /// is not built-in
+  bool IsBuiltinCXTPL(
+    const TemplateEngine& engine) const;
+
+  // true if |engine| is built-in `RAW;` engine,
+  // i.e. its text must be emitted as is
+  bool IsBuiltinRAW(
+    const TemplateEngine& engine) const;
+
+  // list of registered prefixes, for logging
+  std::string DescribePrefixes() const;
+
+private:
+  // set by constructor, not changed by |Register|
+  const TemplateEngine* builtinCXTPL_ = nullptr;
+
+  // set by constructor, not changed by |Register|
+  const TemplateEngine* builtinRAW_ = nullptr;
+
+  // guards all members below
+  mutable base::Lock lock_;
+
+  // all registered engines, including replaced ones
+  std::vector<std::unique_ptr<const TemplateEngine>> storage_;
+
+  // key is lowercase prefix, value is stored in |storage_|
+  std::map<std::string, const TemplateEngine*> engines_;
+
+
+  DISALLOW_COPY_AND_ASSIGN(TemplateEngineRegistry);
+};
+
+} // namespace plugin
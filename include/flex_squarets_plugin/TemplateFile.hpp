@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+
+#include <string>
+
+namespace plugin {
+
+class SquaretsStats;
+
+// returns true if template file is decompressed by |readTemplateFile|
+/// \note `.zst` files are supported only if plugin
+/// is built with zstd (see `SQUARETS_HAS_ZSTD`)
+bool isCompressedTemplateFile(
+  const base::FilePath& path);
+
+// reads template file into |contents|.
+// Files with extension `.gz` (gzip) or `.zst` (zstd)
+// are decompressed while read, in small chunks,
+// so compressed file is never kept in memory as whole.
+// Returns false if file can not be read or decompressed,
+// or if its contents exceed |maxSizeInBytes|.
+// |stats| (optional) records compression ratio
+// and time spent on decompression
+bool readTemplateFile(
+  const base::FilePath& path
+  , size_t maxSizeInBytes
+  , std::string* contents
+  , SquaretsStats* stats = nullptr);
+
+} // namespace plugin
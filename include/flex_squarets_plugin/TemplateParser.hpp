@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <base/strings/string_piece.h>
+
+#include <string>
+
+namespace plugin {
+
+// example before:
+// contents == "CXTPL;" #__VA_ARGS__
+// example after:
+// contents == "" #__VA_ARGS__
+/// \note prefix compared case-insensitive,
+/// returns false (|contents| not changed) if prefix not found
+bool removeTemplatePrefix(
+  const base::StringPiece& prefix
+  , base::StringPiece16& contents);
+
+// generates C++ code that appends rendered template
+// to variable |outputName|
+/// \note does not fail on invalid template,
+/// returns false and sets |errorMessage| instead
+/// (used by fuzzer, see `tests/fuzzing`)
+/// \note result is moved out of squarets,
+/// |generatedCode| must be empty
+bool generateTemplateCode(
+  const std::string& outputName
+  , const base::StringPiece16& templateContents
+  , std::string* generatedCode
+  , std::string* errorMessage);
+
+} // namespace plugin
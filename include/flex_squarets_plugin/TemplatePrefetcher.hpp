@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/strings/string16.h>
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace clang {
+class ASTContext;
+} // namespace clang
+
+namespace plugin {
+
+class SquaretsStats;
+
+// template file loaded and parsed in background
+struct PrefetchedTemplate {
+  // false if file can not be read
+  bool fileOk = false;
+
+  // template loaded from file
+  base::string16 contents;
+
+  // empty if template can not be parsed
+  // (error will be reported by usual code path)
+  std::string generatedCode;
+};
+
+// (template file, name of output variable in generated code)
+using PrefetchRequest
+  = std::pair<base::FilePath, std::string>;
+
+// returns template files used by `{squaretsFile};` annotations
+// in translation unit (system headers are ignored)
+std::vector<PrefetchRequest> collectSquaretsFileAnnotations(
+  clang::ASTContext& astContext);
+
+// loads and parses template files using pool of threads,
+// so I/O overlaps with processing of other annotations
+class TemplatePrefetcher {
+public:
+  // |stats| (optional) records decompressed files,
+  // must outlive prefetcher
+  TemplatePrefetcher(
+    size_t maxThreads
+    , size_t maxFileSizeInBytes
+    , SquaretsStats* stats = nullptr);
+
+  // waits for all started threads
+  /// \note may be destroyed on any thread after last use
+  ~TemplatePrefetcher();
+
+  // starts loading and parsing of |requests| in background,
+  // forgets results of previous calls
+  void PrefetchAll(
+    std::vector<PrefetchRequest> requests);
+
+  // waits until template is ready,
+  // returns nullptr if |request| was not prefetched
+  std::shared_ptr<const PrefetchedTemplate> Take(
+    const PrefetchRequest& request);
+
+private:
+  using ResultFuture
+    = std::shared_future<std::shared_ptr<const PrefetchedTemplate>>;
+
+  // shared between threads started by |PrefetchAll|
+  struct Batch {
+    std::vector<PrefetchRequest> requests;
+
+    std::vector<std::promise<
+      std::shared_ptr<const PrefetchedTemplate>>> results;
+
+    // index of next request to process
+    std::atomic<size_t> next{0};
+  };
+
+  // called by |PrefetchAll| or destructor
+  void joinWorkers();
+
+  const size_t maxThreads_;
+
+  const size_t maxFileSizeInBytes_;
+
+  SquaretsStats* const stats_;
+
+  std::vector<std::thread> workers_;
+
+  std::map<PrefetchRequest, ResultFuture> results_;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(TemplatePrefetcher);
+};
+
+} // namespace plugin
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <base/strings/string_piece.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+// finds positions of `[[` and `]]` in template
+// (uses SSE2 or AVX2 if supported by CPU)
+/// \note overlapping pairs are not reported,
+/// i.e. `[[[` has single pair at position 0
+void scanTemplateDelimiters(
+  const base::StringPiece16& contents
+  , std::vector<size_t>* positions);
+
+// true if template has `[[` or `]]`, stops at first found pair
+// (faster than |scanTemplateDelimiters| for templates with tags)
+bool hasTemplateDelimiter(
+  const base::StringPiece16& contents);
+
+// implementations of |scanTemplateDelimiters|,
+// all of them must find same positions
+enum class DelimiterScanMode {
+  // best mode supported by CPU
+  kAuto = 0,
+  kScalar,
+  kSSE2,
+  kAVX2
+};
+
+// same as |scanTemplateDelimiters|, but uses given implementation
+// (used by tests to compare vectorized code with scalar one).
+// Returns false if |mode| is not supported by build or CPU
+bool scanTemplateDelimitersWithMode(
+  DelimiterScanMode mode
+  , const base::StringPiece16& contents
+  , std::vector<size_t>* positions);
+
+// same as |hasTemplateDelimiter|, but uses given implementation.
+// Returns false if |mode| is not supported by build or CPU
+bool hasTemplateDelimiterWithMode(
+  DelimiterScanMode mode
+  , const base::StringPiece16& contents
+  , bool* hasDelimiter);
+
+// returns code that appends |contents| to |outputName|,
+// same as code generated by squarets for template without tags
+std::string generateLiteralAppend(
+  const std::string& outputName
+  , const base::StringPiece16& contents);
+
+} // namespace plugin
@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace plugin {
+
+// resolves relative paths of `{squaretsFile};` templates
+// against list of root directories (first root that has file wins,
+// like include paths of compiler).
+// Each root is listed on first lookup after |Invalidate|
+// and kept in memory, so lookup of indexed file costs one `stat`
+// (file is checked against stamp stored in index).
+/// \note file added after roots were indexed
+/// is found by `stat` in each root and added to index,
+/// name that no root has is remembered until |Invalidate|
+/// \note file added to earlier root shadows indexed one
+/// only after |Invalidate|
+/// \note thread-safe
+class TemplateSearchIndex {
+public:
+  struct Entry {
+    // |root| joined with relative path
+    base::FilePath path;
+
+    // identity of file when indexed or last found
+    // (0 on platforms without inodes)
+    uint64_t inode = 0;
+
+    // in seconds on POSIX, like |base::FileEnumerator|
+    base::Time lastModified;
+
+    int64_t size = 0;
+  };
+
+  explicit TemplateSearchIndex(
+    std::vector<base::FilePath> roots);
+
+  ~TemplateSearchIndex();
+
+  // returns false if |name| is absolute
+  // or no root contains file |name|
+  bool Resolve(
+    const base::FilePath& name
+    , Entry* entry);
+
+  // forgets indexed files and missing names,
+  // roots are listed again on next lookup
+  void Invalidate();
+
+private:
+  // lists all files of |roots_|, |lock_| must be held
+  void indexRootsIfRequired();
+
+  const std::vector<base::FilePath> roots_;
+
+  base::Lock lock_;
+
+  // guarded by |lock_|
+  bool indexed_ = false;
+
+  // relative path to entry from first root that has it,
+  // guarded by |lock_|
+  std::map<base::FilePath, Entry> entries_;
+
+  // relative paths that no root has,
+  // guarded by |lock_|
+  std::set<base::FilePath> missing_;
+
+  DISALLOW_COPY_AND_ASSIGN(TemplateSearchIndex);
+};
+
+} // namespace plugin
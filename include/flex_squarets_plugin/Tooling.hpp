@@ -1,5 +1,17 @@
 ﻿#pragma once
 
+#include <flex_squarets_plugin/AotRenderCache.hpp>
+#include <flex_squarets_plugin/ForkedWorkers.hpp>
+#include <flex_squarets_plugin/HeaderAnnotationCache.hpp>
+#include <flex_squarets_plugin/Settings.hpp>
+#include <flex_squarets_plugin/PureResultCache.hpp>
+#include <flex_squarets_plugin/Stats.hpp>
+#include <flex_squarets_plugin/TemplateCache.hpp>
+#include <flex_squarets_plugin/TemplateEngines.hpp>
+#include <flex_squarets_plugin/TemplatePrefetcher.hpp>
+#include <flex_squarets_plugin/TemplateSearchIndex.hpp>
+#include <flex_squarets_plugin/TranslationUnitRegistry.hpp>
+
 #include <flexlib/clangUtils.hpp>
 #include <flexlib/ToolPlugin.hpp>
 #if defined(CLING_IS_ON)
@@ -8,15 +20,37 @@
 
 #include <base/logging.h>
 #include <base/sequenced_task_runner.h>
+#include <base/strings/string_piece.h>
+#include <base/files/file_path.h>
+#include <base/synchronization/lock.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+
+#if defined(CLING_IS_ON)
+namespace cling {
+class Interpreter;
+class Transaction;
+} // namespace cling
+#endif // CLING_IS_ON
 
 namespace plugin {
 
 /// \note class name must not collide with
 /// class names from other loaded plugins
+/// \note annotation methods may be called from multiple threads,
+/// but each translation unit must be processed by one thread at a time.
+/// |BeginRun|, |FinishRun| and |ReportStatus| must not be called
+/// while annotations are processed.
 class SquaretsTooling {
 public:
   SquaretsTooling(
     const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+    , const SquaretsSettings& settings
 #if defined(CLING_IS_ON)
     , ::cling_utils::ClingInterpreter* clingInterpreter
 #endif // CLING_IS_ON
@@ -24,6 +58,32 @@ public:
 
   ~SquaretsTooling();
 
+  // prepares next run of long-lived process,
+  // caches are kept (see |SquaretsSettings::serverMode|)
+  void BeginRun(
+    const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+#if defined(CLING_IS_ON)
+    , ::cling_utils::ClingInterpreter* clingInterpreter
+#endif // CLING_IS_ON
+  );
+
+  // writes generated files and reports stats of current run
+  void FinishRun();
+
+  // logs state of caches kept between runs
+  void ReportStatus() const;
+
+  // true if created in server mode
+  bool KeepsCaches() const;
+
+  // adds template engine selected by annotation prefix,
+  // like `{squarets};MYENGINE;...`
+  /// \note replaces engine with same prefix,
+  /// including built-in `CXTPL;` and `RAW;`
+  void RegisterTemplateEngine(
+    const std::string& prefix
+    , TemplateEngineCallback generate);
+
   // extracts template code from annotated varible
   void squarets(
     const std::string& processedAnnotaion
@@ -46,6 +106,8 @@ public:
   // and append it after annotated variable
   /// \note template will be NOT interpreted by Cling,
   /// but we assume that it will be returned from Cling
+  /// \note annotation may start with `PURE(input_files);`
+  /// to cache result returned from Cling (see |PureResultCache|)
   void squaretsCodeAndReplace(
     const std::string& processedAnnotaion
     , clang::AnnotateAttr* annotateAttr
@@ -65,10 +127,275 @@ public:
     , const clang::Decl* nodeDecl);
 
 private:
+  // generates C++ code from template,
+  // measures time spent (see |SquaretsStats|)
+  std::string parseTemplate(
+    // engine selected by annotation prefix
+    const TemplateEngine& engine
+    // name of output variable in generated code
+    , const std::string& nodeName
+    // template to parse
+    , const base::StringPiece16& templateContents
+    // initial annotation code, for logging
+    , const std::string& processedAnnotation);
+
+  // returns |*generatedCode| if not null,
+  // otherwise stores result of |parseTemplate| in |parsedCode|
+  /// \note result is converted by |emitLiterals|
+  /// if |EmissionMode::kTable| or |LiteralMinification| is used,
+  /// output of `RAW;` engine is not minified
+  const std::string& parseTemplateIfRequired(
+    const std::string* generatedCode
+    , const TemplateEngine& engine
+    , const std::string& nodeName
+    , const base::StringPiece16& templateContents
+    , const std::string& processedAnnotation
+    , std::string* parsedCode);
+
+  // minifies literals of |generatedCode| according to |minification|
+  // and moves them into static array if |EmissionMode::kTable| is used
+  std::string emitLiterals(
+    const std::string& generatedCode
+    , const std::string& nodeName
+    , LiteralMinification minification);
+
+  // path of `{squaretsFile};` template |name| found in
+  // |SquaretsSettings::templateSearchPaths|, |name| if not found.
+  // |isIndexed| is set to true if path is known to be existing file
+  base::FilePath resolveTemplatePath(
+    const base::FilePath& name
+    , bool* isIndexed = nullptr);
+
+  // name of output variable used to generate code
+  // from template of annotated variable |nodeName|
+  std::string templateOutputName(
+    const std::string& nodeName) const;
+
+#if defined(CLING_IS_ON)
+  // finds |clingInterpreterImpl_| on first use after |BeginRun|
+  // and configures |aotRenderCache_| for it
+  /// \note |clingLock_| must be held
+  cling::Interpreter* findClingInterpreterIfRequired();
+
+  // returns last transaction of Cling interpreter
+  // before annotation code is executed
+  /// \note |clingLock_| must be held
+  const cling::Transaction* beginClingExecution();
+
+  // unloads transactions added after |lastTransaction|
+  // (see |SquaretsSettings::clingUnloadTransactions|)
+  // and records memory used by interpreter
+  /// \note result of executed code must be already captured
+  /// \note |clingLock_| must be held
+  void finishClingExecution(
+    const cling::Transaction* lastTransaction);
+
+  // executes |codeToExecute| by interpreter of current process
+  // or by worker process (see |SquaretsSettings::clingWorkers|),
+  // returns false if code can not be compiled or worker crashed.
+  // |hasResult| is set to false if code provided nothing
+  bool executeAnnotationCode(
+    const std::string& processedAnnotation
+    , clang::AnnotateAttr* annotateAttr
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl
+    , const base::StringPiece& codeToExecute
+    , const std::string& extraVariables
+    , std::string* output
+    , bool* hasResult);
+#endif // CLING_IS_ON
+
+  // state of translation unit that owns |SM|,
+  // created on first use (|isNew| is set to true),
+  // destroyed when thread starts other translation unit
+  // (see |TranslationUnitRegistry|)
+  struct TranslationUnitState;
+  TranslationUnitState& translationUnitState(
+    clang::SourceManager& SM
+    , bool* isNew = nullptr);
+
+  // forgets changed template files (see |SquaretsSettings::serverMode|)
+  // and loads `{squaretsFile};` templates in background
+  // (see |SquaretsSettings::prefetchThreads|)
+  void beginTranslationUnitIfChanged(
+    const clang_utils::MatchResult& matchResult
+    , clang::SourceManager& SM);
+
+  // generates code from template and appends it after
+  // annotated variable (see |SquaretsSettings::renderHelpers|)
+  /// \note |generatedCode| can store result of |parseTemplate|
+  /// for output variable |templateOutputName|
+  void insertGeneratedCode(
+    const std::string& processedAnnotation
+    , clang::AnnotateAttr* annotateAttr
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::VarDecl* nodeVarDecl
+    , const base::StringPiece16& templateContents
+    , const TemplateEngine& engine
+    , const std::string* generatedCode = nullptr);
+
+  // moves code that renders template into companion file
+  // (see |SquaretsSettings::outOfLineDir|)
+  // and calls it from annotated variable
+  void insertOutOfLineCall(
+    const std::string& processedAnnotation
+    , clang::AnnotateAttr* annotateAttr
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::VarDecl* nodeVarDecl
+    , const base::StringPiece16& templateContents
+    , const TemplateEngine& engine
+    , clang::SourceLocation& nodeStartLoc
+    , clang::SourceLocation& nodeEndLoc
+    , const std::string* generatedCode);
+
+  // path of companion file of translation unit |mainFile|
+  // inside of |SquaretsSettings::outOfLineDir|
+  base::FilePath outOfLineFilePath(
+    const std::string& mainFile) const;
+
+  // writes files collected by |insertOutOfLineCall|
+  // if their contents changed
+  /// \note companion file of translation unit that has no
+  /// annotations (or was removed) is not deleted
+  void writeOutOfLineFiles();
+
+  // inserts (once per file, guarded by `#ifndef`) `inline` function
+  // that renders template and calls it from annotated variable,
+  // returns false if type of annotated variable is not defined
+  // before helper (code must be inserted into variable then)
+  bool insertRenderHelperCall(
+    const std::string& processedAnnotation
+    , clang::AnnotateAttr* annotateAttr
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::VarDecl* nodeVarDecl
+    , const base::StringPiece16& templateContents
+    , const TemplateEngine& engine
+    , clang::SourceLocation& nodeStartLoc
+    , clang::SourceLocation& nodeEndLoc
+    , const std::string* generatedCode);
+
   ::clang_utils::SourceTransformRules* sourceTransformRules_;
 
+  const SquaretsSettings settings_;
+
+  // used only by thread that processes translation unit
+  struct TranslationUnitState {
+    std::string mainFile;
+
+    // also filled by replayed edits of cached annotations
+    RenderHelperSet renderHelpers;
+
+    // null if prefetching disabled
+    std::unique_ptr<TemplatePrefetcher> templatePrefetcher;
+
+    // edits of annotation placed in header that is expanded now,
+    // null if annotation is not cached (see |ScopedHeaderAnnotation|)
+    AnnotationEditRecorder* editRecorder = nullptr;
+
+    // maps file id to hash of file contents
+    std::map<unsigned, std::string> fileHashes;
+  };
+
+  // replays edits of annotation placed in header if it was expanded
+  // by other translation unit, otherwise records edits made
+  // from construction to destruction
+  // (see |SquaretsSettings::headerAnnotationCache|)
+  class ScopedHeaderAnnotation {
+  public:
+    ScopedHeaderAnnotation(
+      SquaretsTooling* tooling
+      , clang::Rewriter& rewriter
+      , const clang::Decl* nodeDecl
+      , const std::string& processedAnnotation);
+
+    ~ScopedHeaderAnnotation();
+
+    // true if cached edits were applied,
+    // so annotation must not be expanded again
+    bool IsReplayed() const
+    {
+      return isReplayed_;
+    }
+
+  private:
+    // null if edits are not recorded
+    HeaderAnnotationCache* cache_ = nullptr;
+
+    TranslationUnitState* translationUnit_ = nullptr;
+
+    std::string key_;
+
+    AnnotationEditRecorder recorder_;
+
+    bool isReplayed_ = false;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedHeaderAnnotation);
+  };
+
+  // maps main file to state of translation unit
+  TranslationUnitRegistry<TranslationUnitState> translationUnits_;
+
+  // code generated by |insertOutOfLineCall|
+  struct OutOfLineFile {
+    // names of already defined functions
+    std::set<std::string> functions;
+
+    std::string code;
+  };
+
+  base::Lock outOfLineLock_;
+
+  // maps path of companion file to its contents
+  // (empty for translation unit without out-of-line calls),
+  // guarded by |outOfLineLock_|
+  std::map<base::FilePath, OutOfLineFile> outOfLineFiles_;
+
+  // results of `PURE(...);` annotations
+  std::unique_ptr<PureResultCache> pureResultCache_;
+
+  SquaretsStats stats_;
+
+  // null if server mode disabled
+  std::unique_ptr<TemplateCache> templateCache_;
+
+  // engines selected by annotation prefix, like `CXTPL;`
+  TemplateEngineRegistry templateEngines_;
+
+  // null if |SquaretsSettings::templateSearchPaths| is empty,
+  // kept between runs
+  std::unique_ptr<TemplateSearchIndex> templateSearchIndex_;
+
+  // null if |SquaretsSettings::headerAnnotationCache| is disabled,
+  // cleared by |FinishRun|
+  std::unique_ptr<HeaderAnnotationCache> headerAnnotationCache_;
+
 #if defined(CLING_IS_ON)
   ::cling_utils::ClingInterpreter* clingInterpreter_;
+
+  // serializes code execution in |clingInterpreter_|
+  base::Lock clingLock_;
+
+  // interpreter used by |clingInterpreter_|,
+  // found on first use, guarded by |clingLock_|
+  cling::Interpreter* clingInterpreterImpl_ = nullptr;
+
+  // null if code is executed in current process
+  // (see |SquaretsSettings::clingWorkers|)
+  std::unique_ptr<ForkedWorkers> clingWorkers_;
+
+  // set when |clingWorkers_| are not used because translation units
+  // are processed by several threads, reset by |BeginRun|
+  std::atomic<bool> isWorkersWarningLogged_{false};
+
+  // null if |SquaretsSettings::aotCacheDir| is empty
+  std::unique_ptr<AotRenderCache> aotRenderCache_;
+
+  // includes at top of each source built by |aotRenderCache_|
+  std::string aotPrelude_;
 #endif // CLING_IS_ON
 
   SEQUENCE_CHECKER(sequence_checker_);
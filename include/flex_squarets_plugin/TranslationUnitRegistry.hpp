@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/platform_thread.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace plugin {
+
+// maps main file of translation unit to its |State|,
+// state is destroyed when translation unit is finished,
+// i.e. each thread that used it started other translation unit
+/// \note thread-safe, but returned state must be used only
+/// by threads that process its translation unit
+/// \note thread is assumed to process one translation unit at a time
+template <typename State>
+class TranslationUnitRegistry {
+public:
+  TranslationUnitRegistry() = default;
+
+  ~TranslationUnitRegistry() = default;
+
+  // returns state of |mainFile| (created by |createState|
+  // on first use, then |isNew| is set to true)
+  // and destroys state of translation unit that was processed
+  // by current thread before |mainFile| if no other thread uses it
+  /// \note result is valid until current thread
+  /// starts other translation unit or |Clear| is called
+  template <typename CreateState>
+  State& Enter(
+    const std::string& mainFile
+    , bool* isNew
+    , CreateState&& createState)
+  {
+    // destroyed without lock (may wait for threads of state)
+    std::unique_ptr<State> finishedState;
+
+    base::AutoLock lock(lock_);
+
+    const base::PlatformThreadId threadId
+      = base::PlatformThread::CurrentId();
+    auto threadIt = threadMainFiles_.find(threadId);
+    if(threadIt != threadMainFiles_.end()
+       && threadIt->second != mainFile)
+    {
+      finishedState = leave(threadIt->second);
+      threadMainFiles_.erase(threadIt);
+      threadIt = threadMainFiles_.end();
+    }
+
+    Entry& entry = entries_[mainFile];
+    if(isNew) {
+      *isNew = !entry.state;
+    }
+    if(!entry.state) {
+      entry.state = createState();
+      DCHECK(entry.state);
+    }
+    if(threadIt == threadMainFiles_.end()) {
+      threadMainFiles_.emplace(threadId, mainFile);
+      ++entry.threads;
+    }
+
+    return *entry.state;
+  }
+
+  // destroys all states
+  /// \note must not be called while translation units are processed
+  void Clear()
+  {
+    std::map<std::string, Entry> entries;
+    {
+      base::AutoLock lock(lock_);
+      entries.swap(entries_);
+      threadMainFiles_.clear();
+    }
+  }
+
+  // number of states that are not destroyed yet
+  size_t size() const
+  {
+    base::AutoLock lock(lock_);
+    return entries_.size();
+  }
+
+  // number of threads that entered translation unit since |Clear|
+  size_t threadCount() const
+  {
+    base::AutoLock lock(lock_);
+    return threadMainFiles_.size();
+  }
+
+private:
+  struct Entry {
+    std::unique_ptr<State> state;
+
+    // number of threads that process translation unit
+    size_t threads = 0;
+  };
+
+  // current thread does not use |mainFile| anymore,
+  // returns its state if no other thread uses it
+  std::unique_ptr<State> leave(const std::string& mainFile)
+  {
+    lock_.AssertAcquired();
+
+    auto it = entries_.find(mainFile);
+    DCHECK(it != entries_.end());
+    DCHECK_GT(it->second.threads, 0u);
+    if(--it->second.threads) {
+      return nullptr;
+    }
+    std::unique_ptr<State> state = std::move(it->second.state);
+    entries_.erase(it);
+    return state;
+  }
+
+  mutable base::Lock lock_;
+
+  // guarded by |lock_|
+  std::map<std::string, Entry> entries_;
+
+  // main file of translation unit that is processed by thread,
+  // guarded by |lock_|
+  std::map<base::PlatformThreadId, std::string> threadMainFiles_;
+
+  DISALLOW_COPY_AND_ASSIGN(TranslationUnitRegistry);
+};
+
+} // namespace plugin
@@ -0,0 +1,287 @@
+#include <flex_squarets_plugin/AllocationProfiler.hpp> // IWYU pragma: associated
+
+#include <base/logging.h>
+
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+#include <base/allocator/allocator_shim.h>
+
+#include <dlfcn.h>
+#endif // SQUARETS_ALLOCATION_PROFILING
+
+#include <algorithm>
+
+namespace plugin {
+
+namespace {
+
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+static const size_t kPhaseCount
+  = static_cast<size_t>(AllocationPhase::kTotal);
+
+// trivially constructed, so access from allocator hook
+// does not allocate
+struct ThreadCounters {
+  bool enabled;
+
+  AllocationPhase phase;
+
+  AllocationCounters counters[kPhaseCount];
+};
+
+// initial-exec model does not call `__tls_get_addr`
+// (that may allocate) on first access from dlopen-ed library
+static thread_local ThreadCounters threadCounters
+  __attribute__((tls_model("initial-exec")));
+
+static void countAllocation(size_t size)
+{
+  ThreadCounters& thread = threadCounters;
+  if(!thread.enabled) {
+    return;
+  }
+  AllocationCounters& counters
+    = thread.counters[static_cast<size_t>(thread.phase)];
+  counters.allocations++;
+  counters.bytes += size;
+}
+
+using base::allocator::AllocatorDispatch;
+
+static void* allocHook(
+  const AllocatorDispatch* self
+  , size_t size
+  , void* context)
+{
+  countAllocation(size);
+  return self->next->alloc_function(self->next, size, context);
+}
+
+static void* allocZeroInitializedHook(
+  const AllocatorDispatch* self
+  , size_t n
+  , size_t size
+  , void* context)
+{
+  countAllocation(n * size);
+  return self->next->alloc_zero_initialized_function(
+    self->next, n, size, context);
+}
+
+static void* allocAlignedHook(
+  const AllocatorDispatch* self
+  , size_t alignment
+  , size_t size
+  , void* context)
+{
+  countAllocation(size);
+  return self->next->alloc_aligned_function(
+    self->next, alignment, size, context);
+}
+
+// block moved by `realloc` is counted as new allocation
+static void* reallocHook(
+  const AllocatorDispatch* self
+  , void* address
+  , size_t size
+  , void* context)
+{
+  if(size) {
+    countAllocation(size);
+  }
+  return self->next->realloc_function(
+    self->next, address, size, context);
+}
+
+static void freeHook(
+  const AllocatorDispatch* self
+  , void* address
+  , void* context)
+{
+  self->next->free_function(self->next, address, context);
+}
+
+static size_t getSizeEstimateHook(
+  const AllocatorDispatch* self
+  , void* address
+  , void* context)
+{
+  return self->next->get_size_estimate_function(
+    self->next, address, context);
+}
+
+static unsigned batchMallocHook(
+  const AllocatorDispatch* self
+  , size_t size
+  , void** results
+  , unsigned numRequested
+  , void* context)
+{
+  const unsigned allocated
+    = self->next->batch_malloc_function(
+        self->next, size, results, numRequested, context);
+  for(unsigned i = 0; i < allocated; ++i) {
+    countAllocation(size);
+  }
+  return allocated;
+}
+
+static void batchFreeHook(
+  const AllocatorDispatch* self
+  , void** toBeFreed
+  , unsigned numToBeFreed
+  , void* context)
+{
+  self->next->batch_free_function(
+    self->next, toBeFreed, numToBeFreed, context);
+}
+
+static void freeDefiniteSizeHook(
+  const AllocatorDispatch* self
+  , void* address
+  , size_t size
+  , void* context)
+{
+  self->next->free_definite_size_function(
+    self->next, address, size, context);
+}
+
+static void* alignedMallocHook(
+  const AllocatorDispatch* self
+  , size_t size
+  , size_t alignment
+  , void* context)
+{
+  countAllocation(size);
+  return self->next->aligned_malloc_function(
+    self->next, size, alignment, context);
+}
+
+static void* alignedReallocHook(
+  const AllocatorDispatch* self
+  , void* address
+  , size_t size
+  , size_t alignment
+  , void* context)
+{
+  if(size) {
+    countAllocation(size);
+  }
+  return self->next->aligned_realloc_function(
+    self->next, address, size, alignment, context);
+}
+
+static void alignedFreeHook(
+  const AllocatorDispatch* self
+  , void* address
+  , void* context)
+{
+  self->next->aligned_free_function(self->next, address, context);
+}
+
+static AllocatorDispatch allocationDispatch = {
+  &allocHook
+  , &allocZeroInitializedHook
+  , &allocAlignedHook
+  , &reallocHook
+  , &freeHook
+  , &getSizeEstimateHook
+  , &batchMallocHook
+  , &batchFreeHook
+  , &freeDefiniteSizeHook
+  , &alignedMallocHook
+  , &alignedReallocHook
+  , &alignedFreeHook
+  , nullptr // next
+};
+#endif // SQUARETS_ALLOCATION_PROFILING
+
+} // namespace
+
+// static
+bool AllocationProfiler::Install()
+{
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+  static const bool isInstalled = []() {
+    // hooks are called until process exits,
+    // so code of plugin must stay loaded
+    Dl_info info;
+    if(!dladdr(reinterpret_cast<void*>(&allocHook), &info)
+       || !info.dli_fname
+       || !dlopen(info.dli_fname, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE))
+    {
+      LOG(WARNING)
+        << "(squarets) unable to pin plugin library,"
+           " allocation profiling disabled";
+      return false;
+    }
+    base::allocator::InsertAllocatorDispatch(&allocationDispatch);
+    return true;
+  }();
+  return isInstalled;
+#else
+  return false;
+#endif // SQUARETS_ALLOCATION_PROFILING
+}
+
+// static
+void AllocationProfiler::BeginThreadCounting()
+{
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+  ThreadCounters& thread = threadCounters;
+  std::fill(
+    std::begin(thread.counters)
+    , std::end(thread.counters)
+    , AllocationCounters());
+  thread.phase = AllocationPhase::kOther;
+  thread.enabled = true;
+#endif // SQUARETS_ALLOCATION_PROFILING
+}
+
+// static
+void AllocationProfiler::EndThreadCounting(
+  AllocationCounters* counters)
+{
+  DCHECK(counters);
+
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+  ThreadCounters& thread = threadCounters;
+  thread.enabled = false;
+  std::copy(
+    std::begin(thread.counters)
+    , std::end(thread.counters)
+    , counters);
+#else
+  std::fill(
+    counters
+    , counters + static_cast<size_t>(AllocationPhase::kTotal)
+    , AllocationCounters());
+#endif // SQUARETS_ALLOCATION_PROFILING
+}
+
+// static
+AllocationPhase AllocationProfiler::SetThreadPhase(
+  AllocationPhase phase)
+{
+  DCHECK(phase != AllocationPhase::kTotal);
+
+#if defined(SQUARETS_ALLOCATION_PROFILING)
+  ThreadCounters& thread = threadCounters;
+  const AllocationPhase previousPhase = thread.phase;
+  thread.phase = phase;
+  return previousPhase;
+#else
+  return AllocationPhase::kOther;
+#endif // SQUARETS_ALLOCATION_PROFILING
+}
+
+ScopedAllocationPhase::ScopedAllocationPhase(
+  AllocationPhase phase)
+  : previousPhase_(AllocationProfiler::SetThreadPhase(phase))
+{}
+
+ScopedAllocationPhase::~ScopedAllocationPhase()
+{
+  AllocationProfiler::SetThreadPhase(previousPhase_);
+}
+
+} // namespace plugin
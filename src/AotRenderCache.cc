@@ -0,0 +1,320 @@
+#include <flex_squarets_plugin/AotRenderCache.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/Hash.hpp>
+
+#include <base/command_line.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/process/launch.h>
+#include <base/strings/strcat.h>
+#include <base/strings/string_util.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace plugin {
+
+namespace {
+
+static const char kFunctionPrefix[] = "squarets_aot_";
+
+// change it if signature of render function
+// or format of generated source changed
+static const char kCacheFormat[] = "squarets-aot-cache-v1";
+
+static const char kCompilerVersionFlag[] = "--version";
+
+} // namespace
+
+AotRenderCache::AotRenderCache(
+  const base::FilePath& cacheDir)
+  : cacheDir_(cacheDir)
+{}
+
+AotRenderCache::~AotRenderCache()
+{
+  base::AutoLock lock(lock_);
+  for(const auto& it : libraries_) {
+    base::UnloadNativeLibrary(it.second);
+  }
+}
+
+// static
+std::string AotRenderCache::FunctionName(
+  const std::string& key)
+{
+  return base::StrCat({kFunctionPrefix, key});
+}
+
+bool AotRenderCache::Configure(
+  std::vector<std::string> compileCommand
+  , const std::string& abi)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::AotRenderCache::Configure");
+
+  DCHECK(!compileCommand.empty());
+
+  std::vector<std::string> versionCommand{
+    compileCommand.front(), kCompilerVersionFlag};
+  std::string compilerVersion;
+  if(!base::GetAppOutputAndError(
+       base::CommandLine(versionCommand), &compilerVersion))
+  {
+    LOG(WARNING)
+      << "(squarets) AOT cache disabled,"
+         " unable to run compiler: "
+      << compileCommand.front();
+    return false;
+  }
+
+  if(!base::CreateDirectory(cacheDir_)) {
+    LOG(WARNING)
+      << "(squarets) AOT cache disabled,"
+         " unable to create directory: "
+      << cacheDir_;
+    return false;
+  }
+
+  const std::string command
+    = base::JoinString(compileCommand, " ");
+
+  base::AutoLock lock(lock_);
+  compileCommand_ = std::move(compileCommand);
+  abiHash_ = hashToHex({
+    kCacheFormat
+    , abi
+    , command
+    , compilerVersion});
+  return true;
+}
+
+bool AotRenderCache::IsConfigured() const
+{
+  base::AutoLock lock(lock_);
+  return !abiHash_.empty();
+}
+
+std::string AotRenderCache::KeyFor(
+  const base::StringPiece& code) const
+{
+  base::AutoLock lock(lock_);
+  if(abiHash_.empty()) {
+    return "";
+  }
+  return hashToHex({
+    abiHash_
+    , llvm::StringRef(code.data(), code.size())});
+}
+
+base::FilePath AotRenderCache::libraryPath(
+  const std::string& key) const
+{
+  return cacheDir_.AppendASCII(
+    base::GetNativeLibraryName(FunctionName(key)));
+}
+
+void* AotRenderCache::FindFunction(
+  const std::string& key)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::AotRenderCache::FindFunction");
+
+  DCHECK(!key.empty());
+
+  base::AutoLock lock(lock_);
+
+  auto it = functions_.find(key);
+  if(it != functions_.end()) {
+    if(it->second) {
+      hits_++;
+    }
+    return it->second;
+  }
+
+  const base::FilePath path = libraryPath(key);
+  if(!base::PathExists(path)) {
+    functions_.emplace(key, nullptr);
+    missing_.insert(key);
+    return nullptr;
+  }
+
+  base::NativeLibraryLoadError error;
+  base::NativeLibrary library
+    = base::LoadNativeLibrary(path, &error);
+  void* function = nullptr;
+  if(library) {
+    libraries_.emplace(key, library);
+    function = base::GetFunctionPointerFromNativeLibrary(
+      library, FunctionName(key).c_str());
+  }
+
+  if(!function) {
+    // symbols used by templates must be exported by flextool
+    LOG(WARNING)
+      << "(squarets) unable to load AOT compiled template "
+      << path
+      << ": "
+      << error.ToString();
+  } else {
+    hits_++;
+  }
+
+  // not loaded again if failed
+  functions_.emplace(key, function);
+  return function;
+}
+
+void AotRenderCache::ScheduleBuild(
+  const std::string& key
+  , std::string source)
+{
+  DCHECK(!key.empty());
+
+  base::AutoLock lock(lock_);
+  // library that exists, but can not be loaded
+  // is not built again
+  if(functions_.count(key) && !missing_.count(key)) {
+    return;
+  }
+  pending_.emplace(key, std::move(source));
+}
+
+bool AotRenderCache::buildLibrary(
+  const std::vector<std::string>& compileCommand
+  , const std::string& key
+  , const std::string& source) const
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::AotRenderCache::buildLibrary");
+
+  base::FilePath sourcePath;
+  base::FilePath temporaryLibraryPath;
+  if(!base::CreateTemporaryFileInDir(cacheDir_, &sourcePath)
+     || !base::CreateTemporaryFileInDir(cacheDir_, &temporaryLibraryPath))
+  {
+    LOG(WARNING)
+      << "(squarets) unable to create files in "
+      << cacheDir_;
+    return false;
+  }
+
+  const int written
+    = base::WriteFile(sourcePath
+        , source.data()
+        , static_cast<int>(source.size()));
+  bool isBuilt = written == static_cast<int>(source.size());
+
+  std::string compilerOutput;
+  if(isBuilt) {
+    std::vector<std::string> argv = compileCommand;
+    argv.insert(argv.end(), {
+      "-shared"
+      , "-fPIC"
+      // temporary file has no extension
+      , "-x", "c++"
+      , sourcePath.value()
+      , "-o", temporaryLibraryPath.value()});
+    isBuilt = base::GetAppOutputAndError(
+      base::CommandLine(argv), &compilerOutput);
+  }
+  base::DeleteFile(sourcePath, false);
+
+  // library appears atomically, so concurrent runs
+  // never load partially written file
+  if(isBuilt) {
+    isBuilt = base::ReplaceFile(
+      temporaryLibraryPath, libraryPath(key), nullptr);
+  }
+
+  if(!isBuilt) {
+    base::DeleteFile(temporaryLibraryPath, false);
+    LOG(WARNING)
+      << "(squarets) unable to build AOT compiled template "
+      << FunctionName(key)
+      << ": "
+      << compilerOutput.substr(0, 10000);
+  }
+
+  return isBuilt;
+}
+
+void AotRenderCache::BuildPending(
+  size_t maxProcesses)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::AotRenderCache::BuildPending");
+
+  DCHECK(maxProcesses > 0);
+
+  std::vector<std::pair<std::string, std::string>> pending;
+  std::vector<std::string> compileCommand;
+  size_t hits = 0;
+  {
+    base::AutoLock lock(lock_);
+    pending.assign(
+      std::make_move_iterator(pending_.begin())
+      , std::make_move_iterator(pending_.end()));
+    pending_.clear();
+    compileCommand = compileCommand_;
+    hits = hits_;
+    hits_ = 0;
+  }
+
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> built{0};
+  // written by each worker at own index
+  std::vector<char> isBuilt(pending.size(), false);
+  std::vector<std::thread> workers;
+  const size_t threads
+    = std::min(maxProcesses, pending.size());
+  for(size_t i = 0; i < threads; ++i) {
+    workers.emplace_back(
+      [this, &pending, &compileCommand, &next, &built, &isBuilt]() {
+        for(size_t index = next++
+            ; index < pending.size()
+            ; index = next++)
+        {
+          if(buildLibrary(
+               compileCommand
+               , pending[index].first
+               , pending[index].second))
+          {
+            isBuilt[index] = true;
+            built++;
+          }
+        }
+      });
+  }
+  for(std::thread& worker : workers) {
+    worker.join();
+  }
+
+  {
+    // long-lived process loads built libraries
+    base::AutoLock lock(lock_);
+    for(size_t index = 0; index < pending.size(); ++index) {
+      const std::string& key = pending[index].first;
+      if(isBuilt[index] && missing_.erase(key)) {
+        functions_.erase(key);
+      }
+    }
+  }
+
+  if(hits || !pending.empty()) {
+    LOG(INFO)
+      << "(squarets) AOT compiled templates: "
+      << hits
+      << " used, "
+      << built
+      << " of "
+      << pending.size()
+      << " built for next runs";
+  }
+}
+
+} // namespace plugin
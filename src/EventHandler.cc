@@ -38,13 +38,30 @@ static const std::string kVersion = "v0.0.1";
 
 static const std::string kVersionCommand = "/version";
 
+// `/squarets_server on` keeps caches between runs
+static const std::string kServerCommand = "/squarets_server";
+
+static const std::string kServerOn = "on";
+
+static const std::string kServerOff = "off";
+
+// logs state of caches kept between runs
+static const std::string kStatusCommand = "/squarets_status";
+
+// finishes current run (writes generated files)
+// without waiting for next run
+static const std::string kFlushCommand = "/squarets_flush";
+
 #if !defined(APPLICATION_BUILD_TYPE)
 #define APPLICATION_BUILD_TYPE "local build"
 #endif
 
 } // namespace
 
-FlexSquaretsEventHandler::FlexSquaretsEventHandler()
+FlexSquaretsEventHandler::FlexSquaretsEventHandler(
+  const SquaretsSettings& settings)
+  : settings_(settings)
+  , serverMode_(settings.serverMode)
 {
   DETACH_FROM_SEQUENCE(sequence_checker_);
 }
@@ -73,6 +90,45 @@ void FlexSquaretsEventHandler::StringCommand(
         << " build type: "
         << APPLICATION_BUILD_TYPE;
     }
+    else if(event.split_parts[0] == kStatusCommand) {
+      LOG(INFO)
+        << kPluginDebugLogName
+        << " server mode: "
+        << serverMode_;
+      if(tooling_) {
+        tooling_->ReportStatus();
+      }
+    }
+    else if(event.split_parts[0] == kFlushCommand) {
+      if(tooling_) {
+        tooling_->FinishRun();
+      }
+    }
+  }
+  else if(event.split_parts.size() == 2
+          && event.split_parts[0] == kServerCommand)
+  {
+    if(event.split_parts[1] == kServerOn) {
+      serverMode_ = true;
+    }
+    else if(event.split_parts[1] == kServerOff) {
+      serverMode_ = false;
+    }
+    else {
+      LOG(WARNING)
+        << kPluginDebugLogName
+        << " usage: "
+        << kServerCommand
+        << " "
+        << kServerOn
+        << "|"
+        << kServerOff;
+      return;
+    }
+    LOG(INFO)
+      << kPluginDebugLogName
+      << " server mode: "
+      << serverMode_;
   }
 }
 
@@ -87,12 +143,29 @@ void FlexSquaretsEventHandler::RegisterAnnotationMethods(
   DCHECK(clingInterpreter_);
 #endif // CLING_IS_ON
 
-  tooling_ = std::make_unique<SquaretsTooling>(
-    event
+  if(serverMode_ && tooling_ && tooling_->KeepsCaches()) {
+    // reuse caches of previous run
+    tooling_->BeginRun(
+      event
 #if defined(CLING_IS_ON)
-    , clingInterpreter_
+      , clingInterpreter_
 #endif // CLING_IS_ON
-  );
+    );
+  } else {
+    SquaretsSettings settings = settings_;
+    settings.serverMode = serverMode_;
+
+    // |SquaretsTooling| writes generated files in destructor
+    tooling_.reset();
+    tooling_ = std::make_unique<SquaretsTooling>(
+      event
+      , settings
+#if defined(CLING_IS_ON)
+      , clingInterpreter_
+#endif // CLING_IS_ON
+    );
+    RegisterTemplateEngines();
+  }
 
   DCHECK(event.sourceTransformPipeline);
   ::clang_utils::SourceTransformPipeline& sourceTransformPipeline
@@ -155,6 +228,41 @@ void FlexSquaretsEventHandler::RegisterAnnotationMethods(
   //  = __attribute__((annotate("{gen};{squarets};CXTPL;int hsdf;" ))){"sfd"};
 }
 
+void FlexSquaretsEventHandler::Unload()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquaretsEventHandler::Unload()");
+
+  // |SquaretsTooling| writes generated files in destructor
+  tooling_.reset();
+}
+
+void FlexSquaretsEventHandler::RegisterTemplateEngine(
+  const std::string& prefix
+  , TemplateEngineCallback generate)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  templateEngines_.push_back(TemplateEngine{prefix, generate});
+
+  // also used by current run (if any)
+  if(tooling_) {
+    tooling_->RegisterTemplateEngine(prefix, std::move(generate));
+  }
+}
+
+void FlexSquaretsEventHandler::RegisterTemplateEngines()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  DCHECK(tooling_);
+
+  // later registration replaces engine with same prefix
+  for(const TemplateEngine& engine : templateEngines_) {
+    tooling_->RegisterTemplateEngine(engine.prefix, engine.generate);
+  }
+}
+
 #if defined(CLING_IS_ON)
 void FlexSquaretsEventHandler::RegisterClingInterpreter(
   const ::plugin::ToolPlugin::Events::RegisterClingInterpreter& event)
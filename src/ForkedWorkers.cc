@@ -0,0 +1,354 @@
+#include <flex_squarets_plugin/ForkedWorkers.hpp> // IWYU pragma: associated
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+#if defined(OS_POSIX)
+#include <base/posix/eintr_wrapper.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // OS_POSIX
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+
+namespace plugin {
+
+namespace {
+
+#if defined(OS_POSIX)
+static bool writeAll(
+  int fd
+  , const void* data
+  , size_t size)
+{
+  const char* pos = static_cast<const char*>(data);
+  while(size) {
+    const ssize_t written = HANDLE_EINTR(write(fd, pos, size));
+    if(written <= 0) {
+      return false;
+    }
+    pos += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+// returns false on error, if pipe closed before |size| bytes read
+// or if |deadline| passed (|timedOut| is set to true),
+// null |deadline| means no limit
+static bool readAll(
+  int fd
+  , void* data
+  , size_t size
+  , base::TimeTicks deadline
+  , bool* timedOut)
+{
+  DCHECK(timedOut);
+
+  char* pos = static_cast<char*>(data);
+  while(size) {
+    if(!deadline.is_null()) {
+      const base::TimeDelta remaining
+        = deadline - base::TimeTicks::Now();
+      if(remaining <= base::TimeDelta()) {
+        *timedOut = true;
+        return false;
+      }
+      struct pollfd pollFd;
+      pollFd.fd = fd;
+      pollFd.events = POLLIN;
+      pollFd.revents = 0;
+      const int ready = poll(
+        &pollFd
+        , 1
+        , static_cast<int>(std::min<int64_t>(
+            remaining.InMillisecondsRoundedUp()
+            , std::numeric_limits<int>::max())));
+      if(ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if(ready < 0) {
+        return false;
+      }
+      if(ready == 0) {
+        // deadline is checked again
+        continue;
+      }
+    }
+    const ssize_t bytesRead = HANDLE_EINTR(read(fd, pos, size));
+    if(bytesRead <= 0) {
+      return false;
+    }
+    pos += bytesRead;
+    size -= static_cast<size_t>(bytesRead);
+  }
+  return true;
+}
+
+// size in bytes of address space of current process,
+// 0 if unknown (`/proc` is available only on Linux)
+static size_t currentAddressSpace()
+{
+  std::string statm;
+  if(!base::ReadFileToString(
+       base::FilePath(FILE_PATH_LITERAL("/proc/self/statm")), &statm))
+  {
+    return 0;
+  }
+
+  size_t pages = 0;
+  if(!base::StringToSizeT(
+       base::StringPiece(statm).substr(0, statm.find(' ')), &pages))
+  {
+    return 0;
+  }
+
+  return pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// runs in forked process, never returns.
+// Sends size of |output| followed by |output| into |fd|,
+// exit code of process is |WorkerStatus|
+[[noreturn]] static void runInWorker(
+  int fd
+  , size_t memoryLimitInBytes
+  , ForkedWorkers::Task task)
+{
+  if(memoryLimitInBytes) {
+    // snapshot of host process is already mapped
+    const size_t snapshotSize = currentAddressSpace();
+    if(snapshotSize) {
+      struct rlimit limit;
+      limit.rlim_cur = limit.rlim_max
+        = static_cast<rlim_t>(snapshotSize + memoryLimitInBytes);
+      setrlimit(RLIMIT_AS, &limit);
+    }
+  }
+
+  std::string output;
+  WorkerStatus status = std::move(task).Run(&output);
+
+  const uint64_t outputSize = output.size();
+  if(!writeAll(fd, &outputSize, sizeof(outputSize))
+     || !writeAll(fd, output.data(), output.size()))
+  {
+    status = WorkerStatus::kFailed;
+  }
+
+  // skips destructors and `atexit` handlers of host process
+  _exit(static_cast<int>(status));
+}
+
+// forks process while |forkLock| is held,
+// waits for result of |task| up to |timeout| (zero means no limit)
+static WorkerStatus forkAndWait(
+  base::Lock* forkLock
+  , size_t memoryLimitInBytes
+  , base::TimeDelta timeout
+  , ForkedWorkers::Task task
+  , std::string* output)
+{
+  int fds[2];
+  // not inherited by processes started by host
+  // (like compiler of |AotRenderCache|)
+#if defined(OS_LINUX)
+  const int pipeResult = pipe2(fds, O_CLOEXEC);
+#else
+  const int pipeResult = pipe(fds);
+  if(pipeResult == 0) {
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  }
+#endif // OS_LINUX
+  if(pipeResult != 0) {
+    PLOG(ERROR)
+      << "(squarets) unable to create pipe for worker process";
+    return WorkerStatus::kCrashed;
+  }
+
+  pid_t pid = -1;
+  {
+    base::AutoLock lock(*forkLock);
+    pid = fork();
+    if(pid == 0) {
+      close(fds[0]);
+      runInWorker(fds[1], memoryLimitInBytes, std::move(task));
+    }
+  }
+
+  close(fds[1]);
+
+  if(pid < 0) {
+    PLOG(ERROR)
+      << "(squarets) unable to start worker process";
+    close(fds[0]);
+    return WorkerStatus::kCrashed;
+  }
+
+  const base::TimeTicks deadline
+    = timeout.is_zero()
+      ? base::TimeTicks()
+      : base::TimeTicks::Now() + timeout;
+
+  /// \note worker forked at same time by other thread may
+  /// inherit write end of pipe, so result is prefixed with its size
+  /// and end of file is not awaited
+  bool timedOut = false;
+  uint64_t outputSize = 0;
+  bool received
+    = readAll(fds[0], &outputSize, sizeof(outputSize)
+        , deadline, &timedOut);
+  if(received) {
+    output->resize(static_cast<size_t>(outputSize));
+    received
+      = readAll(fds[0], &(*output)[0], output->size()
+          , deadline, &timedOut);
+  }
+  close(fds[0]);
+
+  if(timedOut) {
+    // worker may hang on lock inherited from other thread of host
+    // or on endless loop of interpreted code
+    LOG(ERROR)
+      << "(squarets) worker process "
+      << pid
+      << " did not finish in "
+      << timeout.InMilliseconds()
+      << "ms, killed";
+    kill(pid, SIGKILL);
+    HANDLE_EINTR(waitpid(pid, nullptr, 0));
+    output->clear();
+    return WorkerStatus::kCrashed;
+  }
+
+  int exitStatus = 0;
+  if(HANDLE_EINTR(waitpid(pid, &exitStatus, 0)) < 0) {
+    PLOG(ERROR)
+      << "(squarets) unable to wait for worker process "
+      << pid;
+    output->clear();
+    return WorkerStatus::kCrashed;
+  }
+
+  if(WIFSIGNALED(exitStatus)) {
+    LOG(ERROR)
+      << "(squarets) worker process "
+      << pid
+      << " killed by signal "
+      << WTERMSIG(exitStatus);
+    output->clear();
+    return WorkerStatus::kCrashed;
+  }
+
+  const int exitCode
+    = WIFEXITED(exitStatus) ? WEXITSTATUS(exitStatus) : -1;
+  if(!received
+     || exitCode < static_cast<int>(WorkerStatus::kOk)
+     || exitCode > static_cast<int>(WorkerStatus::kFailed))
+  {
+    LOG(ERROR)
+      << "(squarets) worker process "
+      << pid
+      << " exited without result, exit code: "
+      << exitCode;
+    output->clear();
+    return WorkerStatus::kCrashed;
+  }
+
+  return static_cast<WorkerStatus>(exitCode);
+}
+#endif // OS_POSIX
+
+} // namespace
+
+ForkedWorkers::ForkedWorkers(
+  size_t maxWorkers
+  , size_t memoryLimitInBytes
+  , base::TimeDelta timeout)
+  : maxWorkers_(maxWorkers)
+  , memoryLimitInBytes_(memoryLimitInBytes)
+  , timeout_(timeout)
+  , workerExited_(&lock_)
+{
+  DCHECK(maxWorkers_ > 0);
+  DCHECK(IsSupported());
+
+#if defined(OS_POSIX)
+  if(memoryLimitInBytes_ && !currentAddressSpace()) {
+    LOG(WARNING)
+      << "(squarets) memory limit of worker processes"
+         " is not supported on this platform";
+  }
+#endif // OS_POSIX
+}
+
+ForkedWorkers::~ForkedWorkers()
+{
+  base::AutoLock lock(lock_);
+  DCHECK_EQ(activeWorkers_, 0u);
+}
+
+// static
+bool ForkedWorkers::IsSupported()
+{
+#if defined(OS_POSIX)
+  return true;
+#else
+  return false;
+#endif // OS_POSIX
+}
+
+WorkerStatus ForkedWorkers::Run(
+  base::Lock* forkLock
+  , Task task
+  , std::string* output)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::ForkedWorkers::Run");
+
+  DCHECK(forkLock);
+  DCHECK(output);
+
+#if defined(OS_POSIX)
+  {
+    base::AutoLock lock(lock_);
+    while(activeWorkers_ >= maxWorkers_) {
+      workerExited_.Wait();
+    }
+    activeWorkers_++;
+  }
+
+  const WorkerStatus status
+    = forkAndWait(
+        forkLock
+        , memoryLimitInBytes_
+        , timeout_
+        , std::move(task)
+        , output);
+
+  {
+    base::AutoLock lock(lock_);
+    activeWorkers_--;
+    workerExited_.Signal();
+  }
+
+  return status;
+#else
+  NOTREACHED();
+  return WorkerStatus::kCrashed;
+#endif // OS_POSIX
+}
+
+} // namespace plugin
@@ -0,0 +1,542 @@
+#include <flex_squarets_plugin/GeneratedCode.hpp> // IWYU pragma: associated
+
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+
+#include <algorithm>
+
+namespace plugin {
+
+namespace {
+
+// max. length of raw string delimiter is 16
+static const size_t kMaxRawDelimiterCandidates = 100;
+
+static const size_t kMaxRawDelimiterLength = 16;
+
+static bool isIdentifierChar(char c)
+{
+  return base::IsAsciiAlpha(c) || base::IsAsciiDigit(c) || c == '_';
+}
+
+static size_t skipWhitespace(
+  const base::StringPiece& code
+  , size_t pos)
+{
+  while(pos < code.size() && base::IsAsciiWhitespace(code[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+// |pos| points to `"` of `R"delim(`,
+// returns position after closing `"` or npos
+// and sets |contents| to text between parens
+static size_t parseRawString(
+  const base::StringPiece& code
+  , size_t pos
+  , base::StringPiece* contents)
+{
+  DCHECK_EQ(code[pos], '"');
+  const size_t open = code.find('(', pos + 1);
+  if(open == base::StringPiece::npos
+     || open - pos - 1 > kMaxRawDelimiterLength)
+  {
+    return base::StringPiece::npos;
+  }
+  const base::StringPiece delimiter
+    = code.substr(pos + 1, open - pos - 1);
+  for(char c : delimiter) {
+    if(base::IsAsciiWhitespace(c) || c == ')' || c == '\\') {
+      return base::StringPiece::npos;
+    }
+  }
+
+  const std::string terminator
+    = ")" + delimiter.as_string() + "\"";
+  const size_t close = code.find(terminator, open + 1);
+  if(close == base::StringPiece::npos) {
+    return base::StringPiece::npos;
+  }
+  if(contents) {
+    *contents = code.substr(open + 1, close - open - 1);
+  }
+  return close + terminator.size();
+}
+
+// |pos| points to opening quote,
+// returns position after closing quote (or end of code)
+static size_t skipQuoted(
+  const base::StringPiece& code
+  , size_t pos)
+{
+  const char quote = code[pos];
+  for(++pos; pos < code.size(); ++pos) {
+    if(code[pos] == '\\') {
+      ++pos;
+    } else if(code[pos] == quote) {
+      return pos + 1;
+    }
+  }
+  return code.size();
+}
+
+// matches `outputName += R"delim(text)delim" ;` at |pos|,
+// returns position after `;` or npos
+static size_t parseLiteralAppend(
+  const base::StringPiece& code
+  , size_t pos
+  , const base::StringPiece& outputName
+  , base::StringPiece* contents)
+{
+  if(code.substr(pos, outputName.size()) != outputName) {
+    return base::StringPiece::npos;
+  }
+  pos += outputName.size();
+  if(pos < code.size() && isIdentifierChar(code[pos])) {
+    return base::StringPiece::npos;
+  }
+  pos = skipWhitespace(code, pos);
+  if(code.substr(pos, 2) != "+=") {
+    return base::StringPiece::npos;
+  }
+  pos = skipWhitespace(code, pos + 2);
+  if(code.substr(pos, 2) != "R\"") {
+    return base::StringPiece::npos;
+  }
+  pos = parseRawString(code, pos + 1, contents);
+  if(pos == base::StringPiece::npos) {
+    return base::StringPiece::npos;
+  }
+  pos = skipWhitespace(code, pos);
+  if(pos >= code.size() || code[pos] != ';') {
+    return base::StringPiece::npos;
+  }
+  return pos + 1;
+}
+
+static bool isIndentChar(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+// output line seen by |collapseWhitespace|,
+// kept between literals of template
+struct CollapseState {
+  // nothing was appended before
+  bool atOutputStart = true;
+
+  // no text on line yet (or unknown after code),
+  // so `#` starts preprocessor directive
+  bool atLineStart = true;
+
+  // line has `//` comment or is preprocessor directive,
+  // so its newline can not be replaced by space
+  bool keepsNewline = false;
+
+  // last appended character, 0 if unknown
+  char lastChar = '\0';
+};
+
+// applies |LiteralMinification::kAll| to |text|
+/// \note newline is kept after `//` comment or directive
+/// (also after line continuation of directive) and before `#`,
+/// so output that is C++ code has same meaning
+static std::string collapseWhitespace(
+  const base::StringPiece& text
+  , CollapseState* state)
+{
+  DCHECK(state);
+
+  std::string result;
+  result.reserve(text.size());
+  for(size_t pos = 0; pos < text.size(); ++pos) {
+    const char c = text[pos];
+    if(!base::IsAsciiWhitespace(c)) {
+      if((c == '#' && state->atLineStart)
+         || (c == '/' && state->lastChar == '/'))
+      {
+        state->keepsNewline = true;
+      }
+      result += c;
+      state->atOutputStart = false;
+      state->atLineStart = false;
+      state->lastChar = c;
+      continue;
+    }
+
+    bool hasNewline = c == '\n';
+    while(pos + 1 < text.size()
+          && base::IsAsciiWhitespace(text[pos + 1]))
+    {
+      ++pos;
+      hasNewline = hasNewline || text[pos] == '\n';
+    }
+    if(state->atOutputStart) {
+      continue;
+    }
+    const bool isDirectiveNext
+      = pos + 1 < text.size() && text[pos + 1] == '#';
+    if(hasNewline && (state->keepsNewline || isDirectiveNext)) {
+      // directive continues after `\` at end of line
+      state->keepsNewline
+        = state->keepsNewline && state->lastChar == '\\';
+      result += '\n';
+      state->atLineStart = true;
+      state->lastChar = '\n';
+      continue;
+    }
+    result += ' ';
+    state->lastChar = ' ';
+  }
+  return result;
+}
+
+// applies |LiteralMinification::kIndent| or |LiteralMinification::kLines|
+// to |text| line by line, |atLineStart| is true if |text|
+// starts new line of output and is updated for next literal
+static std::string minifyLines(
+  const base::StringPiece& text
+  , bool removeBlankLines
+  , bool* atLineStart)
+{
+  std::string result;
+  result.reserve(text.size());
+  size_t pos = 0;
+  while(pos < text.size()) {
+    size_t end = text.find('\n', pos);
+    const bool hasNewline = end != base::StringPiece::npos;
+    if(!hasNewline) {
+      end = text.size();
+    }
+    base::StringPiece line = text.substr(pos, end - pos);
+    pos = hasNewline ? end + 1 : end;
+
+    if(*atLineStart) {
+      while(!line.empty() && isIndentChar(line.front())) {
+        line.remove_prefix(1);
+      }
+    }
+    // trailing spaces of last line may be followed by output of code
+    if(removeBlankLines && hasNewline) {
+      while(!line.empty() && isIndentChar(line.back())) {
+        line.remove_suffix(1);
+      }
+      if(line.empty() && *atLineStart) {
+        continue;
+      }
+    }
+
+    line.AppendToString(&result);
+    if(hasNewline) {
+      result += '\n';
+      *atLineStart = true;
+    } else if(!line.empty()) {
+      *atLineStart = false;
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+size_t chunkLength(
+  const base::StringPiece& text
+  , size_t chunkSize)
+{
+  if(text.size() <= chunkSize) {
+    return text.size();
+  }
+  size_t length = chunkSize;
+  // continuation bytes are 10xxxxxx
+  while(length > 0
+        && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80)
+  {
+    --length;
+  }
+  // invalid UTF-8, split anywhere
+  return length ? length : chunkSize;
+}
+
+void appendRawStringLiteral(
+  const base::StringPiece& text
+  , std::string* output)
+{
+  // raw string must not contain `)delimiter"`
+  std::string delimiter = "raw";
+  for(size_t i = 0
+      ; text.find(")" + delimiter + "\"") != base::StringPiece::npos
+      ; ++i)
+  {
+    CHECK(i < kMaxRawDelimiterCandidates);
+    delimiter = "raw" + std::to_string(i);
+  }
+
+  *output += "R\"";
+  *output += delimiter;
+  *output += "(";
+  text.AppendToString(output);
+  *output += ")";
+  *output += delimiter;
+  *output += "\"";
+}
+
+std::string makeRawStringLiteral(
+  const base::StringPiece& text)
+{
+  std::string result;
+  result.reserve(text.size() + 32);
+  appendRawStringLiteral(text, &result);
+  return result;
+}
+
+std::vector<GeneratedSegment> splitGeneratedCode(
+  const base::StringPiece& code
+  , const base::StringPiece& outputName)
+{
+  DCHECK(!outputName.empty());
+
+  std::vector<GeneratedSegment> segments;
+
+  // start of code that is not added to |segments| yet
+  size_t codeStart = 0;
+
+  auto addCode = [&segments, &code](size_t begin, size_t end) {
+    if(begin >= end) {
+      return;
+    }
+    segments.push_back(GeneratedSegment{
+      GeneratedSegment::Kind::kCode
+      , code.substr(begin, end - begin).as_string()});
+  };
+
+  auto addLiteral = [&segments, &code, &codeStart]
+    (const base::StringPiece& contents, size_t begin)
+  {
+    const base::StringPiece between
+      = code.substr(codeStart, begin - codeStart);
+    const bool onlyWhitespace
+      = std::all_of(between.begin(), between.end()
+          , [](char c) { return base::IsAsciiWhitespace(c); });
+    if(onlyWhitespace
+       && !segments.empty()
+       && segments.back().kind == GeneratedSegment::Kind::kLiteral)
+    {
+      contents.AppendToString(&segments.back().text);
+      return;
+    }
+    if(!between.empty()) {
+      segments.push_back(GeneratedSegment{
+        GeneratedSegment::Kind::kCode
+        , between.as_string()});
+    }
+    segments.push_back(GeneratedSegment{
+      GeneratedSegment::Kind::kLiteral
+      , contents.as_string()});
+  };
+
+  size_t pos = 0;
+  while(pos < code.size()) {
+    const char c = code[pos];
+
+    if(c == '/' && code.substr(pos, 2) == "//") {
+      const size_t end = code.find('\n', pos);
+      pos = end == base::StringPiece::npos ? code.size() : end;
+      continue;
+    }
+
+    if(c == '/' && code.substr(pos, 2) == "/*") {
+      const size_t end = code.find("*/", pos + 2);
+      pos = end == base::StringPiece::npos ? code.size() : end + 2;
+      continue;
+    }
+
+    if(c == '"') {
+      // raw string like R"(...)", u8R"(...)"
+      if(pos > 0 && code[pos - 1] == 'R') {
+        const size_t end = parseRawString(code, pos, nullptr);
+        pos = end == base::StringPiece::npos ? code.size() : end;
+      } else {
+        pos = skipQuoted(code, pos);
+      }
+      continue;
+    }
+
+    if(c == '\'') {
+      // digit separator like 1'000
+      if(pos > 0 && isIdentifierChar(code[pos - 1])) {
+        ++pos;
+      } else {
+        pos = skipQuoted(code, pos);
+      }
+      continue;
+    }
+
+    if(isIdentifierChar(c)) {
+      base::StringPiece contents;
+      const size_t end
+        = parseLiteralAppend(code, pos, outputName, &contents);
+      if(end != base::StringPiece::npos) {
+        addLiteral(contents, pos);
+        codeStart = end;
+        pos = end;
+        continue;
+      }
+      // skip whole identifier, |outputName| may be its suffix,
+      // prefix of raw string (like `u8R`) is checked by next `"`
+      while(pos < code.size() && isIdentifierChar(code[pos])) {
+        ++pos;
+      }
+      continue;
+    }
+
+    ++pos;
+  }
+
+  addCode(codeStart, code.size());
+
+  return segments;
+}
+
+void minifyLiterals(
+  std::vector<GeneratedSegment>* segments
+  , LiteralMinification mode)
+{
+  DCHECK(segments);
+
+  if(mode == LiteralMinification::kNone) {
+    return;
+  }
+
+  // first literal of template starts output
+  bool atLineStart = true;
+  CollapseState collapseState;
+  for(GeneratedSegment& segment : *segments) {
+    if(segment.kind == GeneratedSegment::Kind::kCode) {
+      // code may append anything to output
+      const bool isWhitespace
+        = std::all_of(segment.text.begin(), segment.text.end()
+            , [](char c) { return base::IsAsciiWhitespace(c); });
+      atLineStart = atLineStart && isWhitespace;
+      collapseState.atOutputStart
+        = collapseState.atOutputStart && isWhitespace;
+      // code may end line, so directive may follow
+      collapseState.atLineStart = true;
+      collapseState.lastChar = '\0';
+      continue;
+    }
+    segment.text
+      = mode == LiteralMinification::kAll
+        ? collapseWhitespace(segment.text, &collapseState)
+        : minifyLines(
+            segment.text
+            , mode == LiteralMinification::kLines
+            , &atLineStart);
+  }
+
+  segments->erase(
+    std::remove_if(segments->begin(), segments->end()
+      , [](const GeneratedSegment& segment) {
+          return segment.kind == GeneratedSegment::Kind::kLiteral
+            && segment.text.empty();
+        })
+    , segments->end());
+}
+
+std::string joinGeneratedCode(
+  const std::vector<GeneratedSegment>& segments
+  , const base::StringPiece& outputName)
+{
+  size_t size = 0;
+  for(const GeneratedSegment& segment : segments) {
+    size += segment.text.size() + outputName.size() + 32;
+  }
+
+  std::string result;
+  result.reserve(size);
+  for(const GeneratedSegment& segment : segments) {
+    if(segment.kind == GeneratedSegment::Kind::kCode) {
+      result += segment.text;
+      continue;
+    }
+    outputName.AppendToString(&result);
+    result += "\n +=\n";
+    appendRawStringLiteral(segment.text, &result);
+    result += "\n ;\n";
+  }
+  return result;
+}
+
+std::string emitLiteralTable(
+  const std::vector<GeneratedSegment>& segments
+  , const base::StringPiece& outputName
+  , size_t chunkSize
+  , const std::string& tableName)
+{
+  DCHECK(chunkSize);
+
+  // all chunks of all literals
+  std::string chunks;
+  // literal N uses chunks in range [bounds[N], bounds[N + 1])
+  std::string bounds = "0";
+  size_t chunkCount = 0;
+  for(const GeneratedSegment& segment : segments) {
+    if(segment.kind != GeneratedSegment::Kind::kLiteral) {
+      continue;
+    }
+    base::StringPiece text = segment.text;
+    while(!text.empty()) {
+      const size_t length = chunkLength(text, chunkSize);
+      appendRawStringLiteral(text.substr(0, length), &chunks);
+      chunks += ",\n";
+      text.remove_prefix(length);
+      ++chunkCount;
+    }
+    bounds += ", ";
+    bounds += std::to_string(chunkCount);
+  }
+
+  if(!chunkCount) {
+    return joinGeneratedCode(segments, outputName);
+  }
+
+  const std::string indexName = tableName + "_bounds";
+
+  std::string result;
+  result.reserve(chunks.size() + bounds.size() + 256);
+  result += "static constexpr std::string_view ";
+  result += tableName;
+  result += "[] = {\n";
+  result += chunks;
+  result += "};\n";
+  result += "static constexpr unsigned ";
+  result += indexName;
+  result += "[] = {";
+  result += bounds;
+  result += "};\n";
+
+  size_t literalIndex = 0;
+  for(const GeneratedSegment& segment : segments) {
+    if(segment.kind == GeneratedSegment::Kind::kCode) {
+      result += segment.text;
+      continue;
+    }
+    const std::string index = std::to_string(literalIndex++);
+    result += "for(unsigned squarets_i = ";
+    result += indexName;
+    result += "[";
+    result += index;
+    result += "]; squarets_i < ";
+    result += indexName;
+    result += "[";
+    result += index;
+    result += " + 1]; ++squarets_i) { ";
+    outputName.AppendToString(&result);
+    result += " += ";
+    result += tableName;
+    result += "[squarets_i]; }\n";
+  }
+  return result;
+}
+
+} // namespace plugin
@@ -0,0 +1,35 @@
+#include <flex_squarets_plugin/Hash.hpp> // IWYU pragma: associated
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
+
+#include <cstdint>
+
+namespace plugin {
+
+std::string hashToHex(
+  std::initializer_list<llvm::StringRef> parts)
+{
+  llvm::MD5 hash;
+  for(const llvm::StringRef& part : parts) {
+    // length makes boundaries of parts unambiguous,
+    // little-endian, so hash is same on each host
+    const uint64_t length = part.size();
+    uint8_t lengthBytes[sizeof(length)];
+    for(size_t i = 0; i < sizeof(length); ++i) {
+      lengthBytes[i] = static_cast<uint8_t>(length >> (8 * i));
+    }
+    hash.update(llvm::ArrayRef<uint8_t>(lengthBytes));
+    hash.update(part);
+  }
+
+  llvm::MD5::MD5Result hashResult;
+  hash.final(hashResult);
+
+  llvm::SmallString<32> hashHex;
+  llvm::MD5::stringifyResult(hashResult, hashHex);
+  return hashHex.str().str();
+}
+
+} // namespace plugin
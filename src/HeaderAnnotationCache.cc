@@ -0,0 +1,225 @@
+#include <flex_squarets_plugin/HeaderAnnotationCache.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/Hash.hpp>
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+
+namespace plugin {
+
+namespace {
+
+// adds edit at |loc| to |recorder|,
+// edit outside of annotated file makes annotation not replayable
+static void recordEdit(
+  const clang::SourceManager& SM
+  , clang::SourceLocation loc
+  , AnnotationEdit::Kind kind
+  , unsigned length
+  , llvm::StringRef text
+  , const std::string& renderHelper
+  , AnnotationEditRecorder* recorder)
+{
+  if(!recorder || !recorder->isReplayable) {
+    return;
+  }
+
+  const std::pair<clang::FileID, unsigned> decomposedLoc
+    = SM.getDecomposedLoc(SM.getExpansionLoc(loc));
+  if(decomposedLoc.first != recorder->fileID) {
+    recorder->isReplayable = false;
+    recorder->edits.clear();
+    return;
+  }
+
+  AnnotationEdit edit;
+  edit.kind = kind;
+  edit.offset = decomposedLoc.second;
+  edit.length = length;
+  edit.text = text.str();
+  edit.renderHelper = renderHelper;
+  recorder->edits.push_back(std::move(edit));
+}
+
+} // namespace
+
+void insertTextAfter(
+  clang::Rewriter& rewriter
+  , clang::SourceLocation loc
+  , llvm::StringRef text
+  , AnnotationEditRecorder* recorder)
+{
+  recordEdit(
+    rewriter.getSourceMgr()
+    , loc
+    , AnnotationEdit::Kind::kInsertAfter
+    , 0
+    , text
+    , std::string()
+    , recorder);
+
+  rewriter.InsertText(loc, text,
+    /*InsertAfter=*/true, /*IndentNewLines*/ false);
+}
+
+void insertRenderHelper(
+  clang::Rewriter& rewriter
+  , clang::SourceLocation loc
+  , llvm::StringRef text
+  , const std::string& helperName
+  , AnnotationEditRecorder* recorder)
+{
+  DCHECK(!helperName.empty());
+
+  recordEdit(
+    rewriter.getSourceMgr()
+    , loc
+    , AnnotationEdit::Kind::kInsertAfter
+    , 0
+    , text
+    , helperName
+    , recorder);
+
+  rewriter.InsertText(loc, text,
+    /*InsertAfter=*/true, /*IndentNewLines*/ false);
+}
+
+void replaceText(
+  clang::Rewriter& rewriter
+  , clang::SourceRange range
+  , llvm::StringRef text
+  , AnnotationEditRecorder* recorder)
+{
+  // same length as used by `rewriter.ReplaceText(range, text)`
+  const int length = rewriter.getRangeSize(range);
+  DCHECK(length >= 0);
+
+  recordEdit(
+    rewriter.getSourceMgr()
+    , range.getBegin()
+    , AnnotationEdit::Kind::kReplace
+    , static_cast<unsigned>(length)
+    , text
+    , std::string()
+    , recorder);
+
+  rewriter.ReplaceText(
+    range.getBegin(), static_cast<unsigned>(length), text);
+}
+
+void replayEdits(
+  clang::Rewriter& rewriter
+  , clang::FileID fileID
+  , const std::vector<AnnotationEdit>& edits
+  , RenderHelperSet* renderHelpers)
+{
+  DCHECK(renderHelpers);
+
+  const clang::SourceLocation fileStart
+    = rewriter.getSourceMgr().getLocForStartOfFile(fileID);
+
+  for(const AnnotationEdit& edit : edits) {
+    // other annotation of this translation unit
+    // may have inserted same helper
+    if(!edit.renderHelper.empty()
+       && !renderHelpers->emplace(
+             fileID.getHashValue(), edit.renderHelper).second)
+    {
+      continue;
+    }
+
+    const clang::SourceLocation loc
+      = fileStart.getLocWithOffset(edit.offset);
+    switch(edit.kind) {
+      case AnnotationEdit::Kind::kInsertAfter:
+        rewriter.InsertText(loc, edit.text,
+          /*InsertAfter=*/true, /*IndentNewLines*/ false);
+        break;
+      case AnnotationEdit::Kind::kReplace:
+        rewriter.ReplaceText(loc, edit.length, edit.text);
+        break;
+    }
+  }
+}
+
+HeaderAnnotationCache::HeaderAnnotationCache(
+  size_t maxEntries)
+  : entries_(maxEntries)
+{}
+
+HeaderAnnotationCache::~HeaderAnnotationCache()
+{}
+
+// static
+std::string HeaderAnnotationCache::MakeKey(
+  const std::string& filePath
+  , const std::string& contentHash
+  , unsigned offset
+  , const std::string& outputName
+  , const std::string& processedAnnotation)
+{
+  return hashToHex({
+    filePath
+    , contentHash
+    , std::to_string(offset)
+    , outputName
+    , processedAnnotation
+  });
+}
+
+std::shared_ptr<const std::vector<AnnotationEdit>>
+  HeaderAnnotationCache::Find(
+    const std::string& key)
+{
+  base::AutoLock lock(lock_);
+
+  auto it = entries_.Get(key);
+  if(it == entries_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  return it->second;
+}
+
+void HeaderAnnotationCache::Store(
+  const std::string& key
+  , std::vector<AnnotationEdit> edits)
+{
+  auto stored
+    = std::make_shared<const std::vector<AnnotationEdit>>(
+        std::move(edits));
+
+  base::AutoLock lock(lock_);
+
+  entries_.Put(key, std::move(stored));
+}
+
+void HeaderAnnotationCache::ReportStatus() const
+{
+  base::AutoLock lock(lock_);
+
+  if(!hits_ && !misses_) {
+    return;
+  }
+
+  LOG(INFO)
+    << "(squarets) annotations of headers: "
+    << misses_
+    << " expanded, "
+    << hits_
+    << " reused by other translation units";
+}
+
+void HeaderAnnotationCache::Clear()
+{
+  base::AutoLock lock(lock_);
+
+  entries_.Clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+} // namespace plugin
@@ -0,0 +1,81 @@
+#include <flex_squarets_plugin/PerfMap.hpp> // IWYU pragma: associated
+
+#include <base/files/file.h>
+#include <base/files/file_path.h>
+#include <base/logging.h>
+#include <base/process/process_handle.h>
+#include <base/strings/stringprintf.h>
+#include <base/synchronization/lock.h>
+
+#include <cinttypes>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+// file of process that opened it
+struct PerfMapFile {
+  base::Lock lock;
+
+  // guarded by |lock|
+  base::ProcessId pid = base::kNullProcessId;
+
+  // guarded by |lock|
+  base::File file;
+};
+
+static PerfMapFile& perfMapFile()
+{
+  // leaked, so entries can be written during exit
+  static PerfMapFile* instance = new PerfMapFile;
+  return *instance;
+}
+
+} // namespace
+
+// static
+bool PerfMap::AddEntry(
+  uintptr_t start
+  , size_t size
+  , base::StringPiece name)
+{
+  DCHECK(size);
+
+  // perf reads name until end of line
+  std::string line = base::StringPrintf(
+    "%" PRIxPTR " %zx ", start, size);
+  for(const char c : name) {
+    line.push_back(c == '\n' ? ' ' : c);
+  }
+  line.push_back('\n');
+
+  PerfMapFile& perfMap = perfMapFile();
+  base::AutoLock lock(perfMap.lock);
+
+  // file inherited from parent process belongs to parent
+  const base::ProcessId pid = base::GetCurrentProcId();
+  if(perfMap.pid != pid) {
+    perfMap.pid = pid;
+    perfMap.file = base::File(
+      base::FilePath(base::StringPrintf(
+        "/tmp/perf-%d.map", static_cast<int>(pid)))
+      , base::File::FLAG_OPEN_ALWAYS | base::File::FLAG_APPEND);
+    if(!perfMap.file.IsValid()) {
+      LOG(WARNING)
+        << "(squarets) unable to open perf map: "
+        << base::File::ErrorToString(perfMap.file.error_details());
+    }
+  }
+
+  if(!perfMap.file.IsValid()) {
+    return false;
+  }
+
+  // one write per line, so lines of threads are not mixed
+  return perfMap.file.WriteAtCurrentPos(
+      line.data(), static_cast<int>(line.size()))
+    == static_cast<int>(line.size());
+}
+
+} // namespace plugin
@@ -0,0 +1,297 @@
+#include <flex_squarets_plugin/PureResultCache.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/Hash.hpp>
+
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
+#include <base/logging.h>
+#include <base/strings/strcat.h>
+#include <base/stl_util.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_split.h>
+#include <base/strings/string_util.h>
+#include <base/strings/utf_string_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+#if defined(OS_POSIX)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif // OS_POSIX
+
+namespace plugin {
+
+namespace {
+
+static const char kPureDirectivePrefix[] = "PURE(";
+
+static const char kPureDirectiveSuffix[] = ");";
+
+// first line of each cache entry,
+// change it if format of cache entry changed
+static const char kCacheEntryHeader[] = "squarets-pure-cache-v2";
+
+// name of |defaultPureCacheDir| inside of temporary directory
+// (followed by user id on POSIX)
+static const char kDefaultCacheDirName[] = "flex_squarets_pure_cache";
+
+static const base::FilePath::CharType kCacheEntryExtension[]
+  = FILE_PATH_LITERAL(".pure");
+
+// returns empty string if file can not be read
+static std::string hashOfFile(
+  const base::FilePath& path)
+{
+  std::string contents;
+  if(!base::ReadFileToString(path, &contents)) {
+    return "";
+  }
+  return hashToHex({contents});
+}
+
+} // namespace
+
+bool removePureDirective(
+  base::StringPiece16& contents
+  , std::vector<base::FilePath>* inputFiles)
+{
+  DCHECK(inputFiles);
+
+  const base::string16 prefix
+    = base::ASCIIToUTF16(kPureDirectivePrefix);
+  if(!base::StartsWith(contents
+      , prefix
+      , base::CompareCase::SENSITIVE))
+  {
+    return false;
+  }
+
+  const size_t end
+    = contents.find(base::ASCIIToUTF16(kPureDirectiveSuffix));
+  if(end == base::StringPiece16::npos) {
+    LOG(ERROR)
+      << "(squarets) expected `"
+      << kPureDirectiveSuffix
+      << "` after `"
+      << kPureDirectivePrefix
+      << "`";
+    return false;
+  }
+
+  const base::StringPiece16 inputs
+    = contents.substr(prefix.size(), end - prefix.size());
+  for(const base::StringPiece16& input
+      : base::SplitStringPiece(inputs
+          , base::ASCIIToUTF16(",")
+          , base::TRIM_WHITESPACE
+          , base::SPLIT_WANT_NONEMPTY))
+  {
+    inputFiles->push_back(
+      base::FilePath{base::UTF16ToUTF8(input)});
+  }
+
+  contents.remove_prefix(
+    end + base::size(kPureDirectiveSuffix) - 1);
+
+  return true;
+}
+
+base::FilePath defaultPureCacheDir()
+{
+  base::FilePath tempDir;
+  if(!base::GetTempDir(&tempDir)) {
+    LOG(WARNING)
+      << "(squarets) unable to find temporary directory";
+    return base::FilePath{};
+  }
+
+#if defined(OS_POSIX)
+  const uid_t uid = getuid();
+  const base::FilePath cacheDir
+    = tempDir.AppendASCII(base::StrCat({
+        kDefaultCacheDirName
+        , "-"
+        , base::NumberToString(uid)}));
+
+  if(mkdir(cacheDir.value().c_str(), S_IRWXU) != 0
+     && errno != EEXIST)
+  {
+    PLOG(WARNING)
+      << "(squarets) unable to create directory: "
+      << cacheDir;
+    return base::FilePath{};
+  }
+
+  // directory may be created in advance by other user
+  // (or be symlink to directory of other user)
+  struct stat info;
+  if(lstat(cacheDir.value().c_str(), &info) != 0
+     || !S_ISDIR(info.st_mode)
+     || info.st_uid != uid
+     || (info.st_mode & (S_IRWXG | S_IRWXO)))
+  {
+    LOG(WARNING)
+      << "(squarets) cache directory must be owned by current user"
+         " and not accessible by others: "
+      << cacheDir;
+    return base::FilePath{};
+  }
+
+  return cacheDir;
+#else
+  // temporary directory is per-user
+  return tempDir.AppendASCII(kDefaultCacheDirName);
+#endif // OS_POSIX
+}
+
+PureResultCache::PureResultCache(
+  const base::FilePath& cacheDir)
+  : cacheDir_(cacheDir)
+{}
+
+PureResultCache::~PureResultCache() = default;
+
+base::FilePath PureResultCache::entryPath(
+  const base::StringPiece& code
+  , const std::vector<base::FilePath>& inputFiles) const
+{
+  std::string key(code.data(), code.size());
+  for(const base::FilePath& inputFile : inputFiles) {
+    // separator can not be part of code or path
+    key.push_back('\0');
+    key += inputFile.AsUTF8Unsafe();
+  }
+  return cacheDir_.AppendASCII(hashToHex({key}))
+      .AddExtension(kCacheEntryExtension);
+}
+
+// cache entry format:
+//   header
+//   number of input files
+//   hash_of_input_file_1 path_of_input_file_1
+//   ...
+//   result (up to end of file)
+base::Optional<std::string> PureResultCache::Get(
+  const base::StringPiece& code
+  , const std::vector<base::FilePath>& inputFiles)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::PureResultCache::Get");
+
+  const base::FilePath path = entryPath(code, inputFiles);
+
+  std::string entry;
+  if(!base::ReadFileToString(path, &entry)) {
+    return base::nullopt;
+  }
+
+  base::StringPiece remaining = entry;
+
+  // reads line without `\n`
+  auto readLine = [&remaining](base::StringPiece* line) {
+    const size_t pos = remaining.find('\n');
+    if(pos == base::StringPiece::npos) {
+      return false;
+    }
+    *line = remaining.substr(0, pos);
+    remaining.remove_prefix(pos + 1);
+    return true;
+  };
+
+  base::StringPiece line;
+  if(!readLine(&line) || line != kCacheEntryHeader) {
+    LOG(WARNING)
+      << "(squarets) ignored invalid cache entry: "
+      << path;
+    return base::nullopt;
+  }
+
+  size_t inputsCount = 0;
+  if(!readLine(&line)
+     || !base::StringToSizeT(line, &inputsCount))
+  {
+    LOG(WARNING)
+      << "(squarets) ignored invalid cache entry: "
+      << path;
+    return base::nullopt;
+  }
+
+  for(size_t i = 0; i < inputsCount; ++i) {
+    if(!readLine(&line)) {
+      return base::nullopt;
+    }
+    const size_t separator = line.find(' ');
+    if(separator == base::StringPiece::npos) {
+      return base::nullopt;
+    }
+    const base::StringPiece expectedHash
+      = line.substr(0, separator);
+    const base::FilePath inputPath{
+      line.substr(separator + 1).as_string()};
+    if(hashOfFile(inputPath) != expectedHash) {
+      VLOG(9)
+        << "(squarets) cache entry "
+        << path
+        << " invalidated by changed file "
+        << inputPath;
+      return base::nullopt;
+    }
+  }
+
+  VLOG(9)
+    << "(squarets) using cached result: "
+    << path;
+
+  return remaining.as_string();
+}
+
+void PureResultCache::Put(
+  const base::StringPiece& code
+  , const std::vector<base::FilePath>& inputFiles
+  , const std::string& result)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::PureResultCache::Put");
+
+  std::string entry;
+  entry += kCacheEntryHeader;
+  entry += "\n";
+  entry += base::NumberToString(inputFiles.size());
+  entry += "\n";
+  for(const base::FilePath& inputFile : inputFiles) {
+    const std::string inputHash = hashOfFile(inputFile);
+    if(inputHash.empty()) {
+      LOG(WARNING)
+        << "(squarets) result will not be cached:"
+           " unable to read input file "
+        << inputFile;
+      return;
+    }
+    entry += inputHash;
+    entry += " ";
+    entry += inputFile.value();
+    entry += "\n";
+  }
+  entry += result;
+
+  if(!base::CreateDirectory(cacheDir_)) {
+    LOG(WARNING)
+      << "(squarets) unable to create directory: "
+      << cacheDir_;
+    return;
+  }
+
+  const base::FilePath path = entryPath(code, inputFiles);
+
+  /// \note atomic write prevents partial entries
+  /// if multiple processes use same cache
+  if(!base::ImportantFileWriter::WriteFileAtomically(path, entry)) {
+    LOG(WARNING)
+      << "(squarets) unable to write cache entry: "
+      << path;
+  }
+}
+
+} // namespace plugin
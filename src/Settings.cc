@@ -0,0 +1,272 @@
+#include <flex_squarets_plugin/Settings.hpp> // IWYU pragma: associated
+
+#include <Corrade/Utility/ConfigurationGroup.h>
+
+#include <base/logging.h>
+
+namespace plugin {
+
+namespace {
+
+static const char kRenderHelpersKey[] = "render_helpers";
+
+static const char kOutOfLineDirKey[] = "out_of_line_dir";
+
+static const char kOutOfLineIncludeKey[] = "out_of_line_include";
+
+static const char kDefaultOutOfLineInclude[] = "<string>";
+
+static const char kPureCacheDirKey[] = "pure_cache_dir";
+
+static const char kAnnotationBudgetMsKey[] = "annotation_budget_ms";
+
+static const char kAnnotationBudgetStrictKey[] = "annotation_budget_strict";
+
+static const char kSlowAnnotationsReportKey[] = "slow_annotations_report";
+
+static const char kAllocationProfilingKey[] = "allocation_profiling";
+
+static const char kPrefetchThreadsKey[] = "prefetch_threads";
+
+static const char kServerModeKey[] = "server_mode";
+
+static const char kServerCacheMbKey[] = "server_cache_mb";
+
+static const char kHeaderAnnotationCacheKey[] = "header_annotation_cache";
+
+static const char kEmissionModeKey[] = "emission_mode";
+
+static const char kEmissionModeAppend[] = "append";
+
+static const char kEmissionModeTable[] = "table";
+
+static const char kLiteralChunkSizeKey[] = "literal_chunk_size";
+
+static const char kMinifyLiteralsKey[] = "minify_literals";
+
+static const char kMinifyLiteralsNone[] = "none";
+
+static const char kMinifyLiteralsIndent[] = "indent";
+
+static const char kMinifyLiteralsLines[] = "lines";
+
+static const char kMinifyLiteralsAll[] = "all";
+
+static const char kClingUnloadTransactionsKey[]
+  = "cling_unload_transactions";
+
+static const char kClingWorkersKey[] = "cling_workers";
+
+static const char kClingWorkerMemoryMbKey[] = "cling_worker_memory_mb";
+
+static const char kClingWorkerTimeoutMsKey[] = "cling_worker_timeout_ms";
+
+static const char kClingPerfMapKey[] = "cling_perf_map";
+
+static const char kAotCacheDirKey[] = "aot_cache_dir";
+
+static const char kAotCompilerKey[] = "aot_compiler";
+
+static const char kAotFlagsKey[] = "aot_flags";
+
+static const char kAotPreludeKey[] = "aot_prelude";
+
+static const char kAotDeferredBuildKey[] = "aot_deferred_build";
+
+static const char kTemplateSearchPathKey[] = "template_search_path";
+
+} // namespace
+
+// static
+SquaretsSettings SquaretsSettings::FromConfiguration(
+  const Corrade::Utility::ConfigurationGroup& configuration)
+{
+  SquaretsSettings settings;
+
+  if(configuration.hasValue(kRenderHelpersKey)) {
+    settings.renderHelpers
+      = configuration.value<bool>(kRenderHelpersKey);
+  }
+
+  if(configuration.hasValue(kOutOfLineDirKey)) {
+    settings.outOfLineDir
+      = configuration.value<std::string>(kOutOfLineDirKey);
+  }
+
+  settings.outOfLineIncludes
+    = configuration.values<std::string>(kOutOfLineIncludeKey);
+  if(settings.outOfLineIncludes.empty()) {
+    settings.outOfLineIncludes.push_back(kDefaultOutOfLineInclude);
+  }
+
+  if(configuration.hasValue(kPureCacheDirKey)) {
+    settings.pureCacheDir
+      = configuration.value<std::string>(kPureCacheDirKey);
+  }
+
+  if(configuration.hasValue(kAnnotationBudgetMsKey)) {
+    settings.annotationBudgetMs
+      = configuration.value<int>(kAnnotationBudgetMsKey);
+  }
+
+  if(configuration.hasValue(kAnnotationBudgetStrictKey)) {
+    settings.annotationBudgetStrict
+      = configuration.value<bool>(kAnnotationBudgetStrictKey);
+  }
+
+  if(configuration.hasValue(kSlowAnnotationsReportKey)) {
+    settings.slowAnnotationsReport
+      = configuration.value<int>(kSlowAnnotationsReportKey);
+  }
+
+  if(configuration.hasValue(kAllocationProfilingKey)) {
+    settings.allocationProfiling
+      = configuration.value<bool>(kAllocationProfilingKey);
+  }
+
+  if(configuration.hasValue(kPrefetchThreadsKey)) {
+    settings.prefetchThreads
+      = configuration.value<int>(kPrefetchThreadsKey);
+  }
+
+  if(configuration.hasValue(kServerModeKey)) {
+    settings.serverMode
+      = configuration.value<bool>(kServerModeKey);
+  }
+
+  if(configuration.hasValue(kServerCacheMbKey)) {
+    settings.serverCacheMb
+      = configuration.value<int>(kServerCacheMbKey);
+    CHECK(settings.serverCacheMb >= 0);
+  }
+
+  if(configuration.hasValue(kHeaderAnnotationCacheKey)) {
+    settings.headerAnnotationCache
+      = configuration.value<bool>(kHeaderAnnotationCacheKey);
+  }
+
+  if(configuration.hasValue(kEmissionModeKey)) {
+    const std::string emissionMode
+      = configuration.value<std::string>(kEmissionModeKey);
+    if(emissionMode == kEmissionModeAppend) {
+      settings.emissionMode = EmissionMode::kAppend;
+    } else if(emissionMode == kEmissionModeTable) {
+      settings.emissionMode = EmissionMode::kTable;
+    } else {
+      LOG(ERROR)
+        << "(squarets) unknown "
+        << kEmissionModeKey
+        << ": "
+        << emissionMode
+        << ", expected "
+        << kEmissionModeAppend
+        << " or "
+        << kEmissionModeTable;
+      CHECK(false);
+    }
+  }
+
+  if(configuration.hasValue(kLiteralChunkSizeKey)) {
+    settings.literalChunkSize
+      = configuration.value<int>(kLiteralChunkSizeKey);
+    CHECK(settings.literalChunkSize > 0);
+  }
+
+  if(configuration.hasValue(kMinifyLiteralsKey)) {
+    const std::string minifyLiterals
+      = configuration.value<std::string>(kMinifyLiteralsKey);
+    if(minifyLiterals == kMinifyLiteralsNone) {
+      settings.literalMinification = LiteralMinification::kNone;
+    } else if(minifyLiterals == kMinifyLiteralsIndent) {
+      settings.literalMinification = LiteralMinification::kIndent;
+    } else if(minifyLiterals == kMinifyLiteralsLines) {
+      settings.literalMinification = LiteralMinification::kLines;
+    } else if(minifyLiterals == kMinifyLiteralsAll) {
+      settings.literalMinification = LiteralMinification::kAll;
+    } else {
+      LOG(ERROR)
+        << "(squarets) unknown "
+        << kMinifyLiteralsKey
+        << ": "
+        << minifyLiterals
+        << ", expected "
+        << kMinifyLiteralsNone
+        << ", "
+        << kMinifyLiteralsIndent
+        << ", "
+        << kMinifyLiteralsLines
+        << " or "
+        << kMinifyLiteralsAll;
+      CHECK(false);
+    }
+  }
+
+  if(configuration.hasValue(kClingUnloadTransactionsKey)) {
+    settings.clingUnloadTransactions
+      = configuration.value<bool>(kClingUnloadTransactionsKey);
+  }
+
+  if(configuration.hasValue(kClingWorkersKey)) {
+    settings.clingWorkers
+      = configuration.value<int>(kClingWorkersKey);
+    CHECK(settings.clingWorkers >= 0);
+  }
+
+  if(configuration.hasValue(kClingWorkerMemoryMbKey)) {
+    settings.clingWorkerMemoryMb
+      = configuration.value<int>(kClingWorkerMemoryMbKey);
+    CHECK(settings.clingWorkerMemoryMb >= 0);
+  }
+
+  if(configuration.hasValue(kClingWorkerTimeoutMsKey)) {
+    settings.clingWorkerTimeoutMs
+      = configuration.value<int>(kClingWorkerTimeoutMsKey);
+    CHECK(settings.clingWorkerTimeoutMs >= 0);
+  }
+
+  if(configuration.hasValue(kClingPerfMapKey)) {
+    settings.clingPerfMap
+      = configuration.value<bool>(kClingPerfMapKey);
+  }
+
+  if(configuration.hasValue(kAotCacheDirKey)) {
+    settings.aotCacheDir
+      = configuration.value<std::string>(kAotCacheDirKey);
+  }
+
+  if(configuration.hasValue(kAotCompilerKey)) {
+    settings.aotCompiler
+      = configuration.value<std::string>(kAotCompilerKey);
+    CHECK(!settings.aotCompiler.empty());
+  }
+
+  if(configuration.hasValue(kAotFlagsKey)) {
+    settings.aotFlags
+      = configuration.value<std::string>(kAotFlagsKey);
+  }
+
+  if(configuration.hasValue(kAotPreludeKey)) {
+    settings.aotPrelude
+      = configuration.value<std::string>(kAotPreludeKey);
+  }
+
+  if(configuration.hasValue(kAotDeferredBuildKey)) {
+    settings.aotDeferredBuild
+      = configuration.value<bool>(kAotDeferredBuildKey);
+  }
+
+  settings.templateSearchPaths
+    = configuration.values<std::string>(kTemplateSearchPathKey);
+
+  VLOG(9)
+    << "(squarets) render_helpers: "
+    << settings.renderHelpers;
+
+  VLOG(9)
+    << "(squarets) out_of_line_dir: "
+    << settings.outOfLineDir;
+
+  return settings;
+}
+
+} // namespace plugin
@@ -0,0 +1,465 @@
+#include <flex_squarets_plugin/Stats.hpp> // IWYU pragma: associated
+
+#include <base/logging.h>
+#include <base/stl_util.h>
+
+#include <algorithm>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif // __GLIBC__
+
+namespace plugin {
+
+namespace {
+
+static const char* const kPhaseNames[] = {
+  "read_file",
+  "parse",
+  "interpret"
+};
+
+static_assert(
+  base::size(kPhaseNames)
+    == static_cast<size_t>(AnnotationPhase::kTotal)
+  , "name required for each AnnotationPhase");
+
+static const char* const kAllocationPhaseNames[] = {
+  "other",
+  "prefix",
+  "transcode",
+  "read_file",
+  "parse",
+  "prelude",
+  "reflection",
+  "interpret",
+  "rewrite"
+};
+
+static_assert(
+  base::size(kAllocationPhaseNames)
+    == static_cast<size_t>(AllocationPhase::kTotal)
+  , "name required for each AllocationPhase");
+
+static const size_t kKB = 1024;
+
+} // namespace
+
+base::TimeDelta SquaretsStats::AnnotationRecord::Total() const
+{
+  base::TimeDelta total;
+  for(const base::TimeDelta& phase : phases) {
+    total += phase;
+  }
+  return total;
+}
+
+AllocationCounters
+  SquaretsStats::AnnotationRecord::TotalAllocations() const
+{
+  AllocationCounters total;
+  for(const AllocationCounters& phase : allocations) {
+    total.allocations += phase.allocations;
+    total.bytes += phase.bytes;
+  }
+  return total;
+}
+
+SquaretsStats::SquaretsStats(
+  base::TimeDelta budget
+  , bool strictBudget
+  , bool allocationProfiling)
+  : budget_(budget)
+  , strictBudget_(strictBudget)
+  , allocationProfiling_(
+      allocationProfiling && AllocationProfiler::Install())
+{
+  LOG_IF(WARNING, allocationProfiling && !allocationProfiling_)
+    << "(squarets) allocation profiling requires plugin"
+       " built with ENABLE_ALLOCATION_PROFILING";
+}
+
+SquaretsStats::~SquaretsStats()
+{
+  DCHECK(currentRecords_.empty());
+}
+
+void SquaretsStats::BeginAnnotation(
+  const std::string& method
+  , const std::string& location)
+{
+  AnnotationRecord record;
+  record.method = method;
+  record.location = location;
+
+  base::AutoLock lock(lock_);
+
+  const bool isNewRecord
+    = currentRecords_.emplace(
+        base::PlatformThread::CurrentId()
+        , std::move(record)).second;
+  DCHECK(isNewRecord)
+    << "nested annotations are not supported";
+
+  if(allocationProfiling_) {
+    AllocationProfiler::BeginThreadCounting();
+  }
+}
+
+void SquaretsStats::EndAnnotation()
+{
+  // before |lock_|, so copy of record is not counted
+  AllocationCounters allocations[
+    static_cast<size_t>(AllocationPhase::kTotal)];
+  if(allocationProfiling_) {
+    AllocationProfiler::EndThreadCounting(allocations);
+  }
+
+  AnnotationRecord record;
+  {
+    base::AutoLock lock(lock_);
+
+    auto it = currentRecords_.find(
+      base::PlatformThread::CurrentId());
+    DCHECK(it != currentRecords_.end());
+    record = std::move(it->second);
+    std::copy(
+      std::begin(allocations)
+      , std::end(allocations)
+      , record.allocations);
+    currentRecords_.erase(it);
+
+    records_.push_back(record);
+  }
+
+  if(budget_.is_zero() || record.Total() <= budget_) {
+    return;
+  }
+
+  LOG(WARNING)
+    << "(squarets) annotation "
+    << record.method
+    << " took "
+    << record.Total().InMilliseconds()
+    << "ms (budget is "
+    << budget_.InMilliseconds()
+    << "ms): "
+    << record.location;
+
+  if(strictBudget_) {
+    LOG(ERROR)
+      << "(squarets) annotation time budget exceeded"
+         " in strict mode: "
+      << record.location;
+    CHECK(false);
+  }
+}
+
+void SquaretsStats::AddPhaseTime(
+  AnnotationPhase phase
+  , base::TimeDelta elapsed)
+{
+  DCHECK(phase != AnnotationPhase::kTotal);
+
+  base::AutoLock lock(lock_);
+
+  auto it = currentRecords_.find(
+    base::PlatformThread::CurrentId());
+  if(it == currentRecords_.end()) {
+    return;
+  }
+
+  it->second.phases[static_cast<size_t>(phase)] += elapsed;
+}
+
+void SquaretsStats::AddInterpreterSample(
+  size_t heapBytes
+  , size_t astBytes
+  , size_t liveTransactions
+  , size_t unloadedTransactions)
+{
+  base::AutoLock lock(lock_);
+
+  InterpreterMemory& memory = interpreterMemory_;
+  if(!memory.samples) {
+    memory.firstHeapBytes = heapBytes;
+  }
+  memory.samples++;
+  memory.lastHeapBytes = heapBytes;
+  memory.peakHeapBytes = std::max(memory.peakHeapBytes, heapBytes);
+  memory.lastAstBytes = astBytes;
+  memory.lastTransactions = liveTransactions;
+  memory.unloadedTransactions += unloadedTransactions;
+}
+
+void SquaretsStats::ReportInterpreterMemory() const
+{
+  base::AutoLock lock(lock_);
+
+  const InterpreterMemory& memory = interpreterMemory_;
+  if(!memory.samples) {
+    return;
+  }
+
+  LOG(INFO)
+    << "(squarets) heap in use after "
+    << memory.samples
+    << " Cling executions: first "
+    << memory.firstHeapBytes / kKB
+    << "KB, last "
+    << memory.lastHeapBytes / kKB
+    << "KB, peak "
+    << memory.peakHeapBytes / kKB
+    << "KB; Cling AST "
+    << memory.lastAstBytes / kKB
+    << "KB; transactions: "
+    << memory.lastTransactions
+    << " live, "
+    << memory.unloadedTransactions
+    << " unloaded";
+}
+
+// static
+size_t SquaretsStats::HeapBytesInUse()
+{
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+  return mallinfo2().uordblks;
+#else
+  // counters of `mallinfo` are `int` and wrap above 2GB
+  return static_cast<unsigned>(mallinfo().uordblks);
+#endif // __GLIBC_PREREQ(2, 33)
+#else
+  return 0;
+#endif // __GLIBC__
+}
+
+void SquaretsStats::ReportAllocations(size_t limit) const
+{
+  base::AutoLock lock(lock_);
+
+  if(!allocationProfiling_ || records_.empty()) {
+    return;
+  }
+
+  AllocationCounters phases[base::size(kAllocationPhaseNames)];
+  for(const AnnotationRecord& record : records_) {
+    for(size_t phase = 0; phase < base::size(phases); ++phase) {
+      phases[phase].allocations
+        += record.allocations[phase].allocations;
+      phases[phase].bytes += record.allocations[phase].bytes;
+    }
+  }
+
+  // phases without allocations are skipped
+  auto describePhases = [](const AllocationCounters* counters) {
+    std::string result;
+    for(size_t phase = 0
+        ; phase < base::size(kAllocationPhaseNames)
+        ; ++phase)
+    {
+      if(!counters[phase].allocations) {
+        continue;
+      }
+      result += " ";
+      result += kAllocationPhaseNames[phase];
+      result += "=";
+      result += std::to_string(counters[phase].allocations);
+      result += "/";
+      result += std::to_string(counters[phase].bytes / kKB);
+      result += "KB";
+    }
+    return result;
+  };
+
+  LOG(INFO)
+    << "(squarets) allocations of "
+    << records_.size()
+    << " annotations (count/size):"
+    << describePhases(phases);
+
+  limit = std::min(limit, records_.size());
+  if(!limit) {
+    return;
+  }
+
+  std::vector<const AnnotationRecord*> largest;
+  largest.reserve(records_.size());
+  for(const AnnotationRecord& record : records_) {
+    largest.push_back(&record);
+  }
+
+  std::partial_sort(
+    largest.begin()
+    , largest.begin() + limit
+    , largest.end()
+    , [](const AnnotationRecord* a, const AnnotationRecord* b) {
+        return a->TotalAllocations().bytes
+          > b->TotalAllocations().bytes;
+      });
+
+  for(size_t i = 0; i < limit; ++i) {
+    const AnnotationRecord& record = *largest[i];
+    const AllocationCounters total = record.TotalAllocations();
+    LOG(INFO)
+      << "(squarets) #"
+      << (i + 1)
+      << " "
+      << total.allocations
+      << " allocations, "
+      << total.bytes / kKB
+      << "KB "
+      << record.method
+      << " at "
+      << record.location
+      << " :"
+      << describePhases(record.allocations);
+  }
+}
+
+void SquaretsStats::AddDecompressedFile(
+  size_t compressedBytes
+  , size_t decompressedBytes
+  , base::TimeDelta elapsed)
+{
+  base::AutoLock lock(lock_);
+
+  decompression_.files++;
+  decompression_.compressedBytes += compressedBytes;
+  decompression_.decompressedBytes += decompressedBytes;
+  decompression_.elapsed += elapsed;
+}
+
+void SquaretsStats::ReportDecompression() const
+{
+  base::AutoLock lock(lock_);
+
+  const Decompression& decompression = decompression_;
+  if(!decompression.files) {
+    return;
+  }
+
+  LOG(INFO)
+    << "(squarets) decompressed "
+    << decompression.files
+    << " template files: "
+    << decompression.compressedBytes / kKB
+    << "KB -> "
+    << decompression.decompressedBytes / kKB
+    << "KB (ratio "
+    << (decompression.compressedBytes
+        ? static_cast<double>(decompression.decompressedBytes)
+            / decompression.compressedBytes
+        : 0.0)
+    << ") in "
+    << decompression.elapsed.InMilliseconds()
+    << "ms";
+}
+
+void SquaretsStats::Clear()
+{
+  base::AutoLock lock(lock_);
+
+  DCHECK(currentRecords_.empty());
+
+  records_.clear();
+  interpreterMemory_ = InterpreterMemory();
+  decompression_ = Decompression();
+}
+
+void SquaretsStats::ReportSlowest(size_t limit) const
+{
+  base::AutoLock lock(lock_);
+
+  if(!limit || records_.empty()) {
+    return;
+  }
+
+  std::vector<const AnnotationRecord*> slowest;
+  slowest.reserve(records_.size());
+  for(const AnnotationRecord& record : records_) {
+    slowest.push_back(&record);
+  }
+
+  limit = std::min(limit, slowest.size());
+  std::partial_sort(
+    slowest.begin()
+    , slowest.begin() + limit
+    , slowest.end()
+    , [](const AnnotationRecord* a, const AnnotationRecord* b) {
+        return a->Total() > b->Total();
+      });
+
+  base::TimeDelta total;
+  for(const AnnotationRecord& record : records_) {
+    total += record.Total();
+  }
+
+  LOG(INFO)
+    << "(squarets) processed "
+    << records_.size()
+    << " annotations in "
+    << total.InMilliseconds()
+    << "ms, slowest annotations:";
+
+  for(size_t i = 0; i < limit; ++i) {
+    const AnnotationRecord& record = *slowest[i];
+    std::string phases;
+    for(size_t phase = 0; phase < base::size(kPhaseNames); ++phase) {
+      if(record.phases[phase].is_zero()) {
+        continue;
+      }
+      phases += " ";
+      phases += kPhaseNames[phase];
+      phases += "=";
+      phases += std::to_string(
+        record.phases[phase].InMilliseconds());
+      phases += "ms";
+    }
+    LOG(INFO)
+      << "(squarets) #"
+      << (i + 1)
+      << " "
+      << record.Total().InMilliseconds()
+      << "ms "
+      << record.method
+      << " at "
+      << record.location
+      << " :"
+      << phases;
+  }
+}
+
+ScopedAnnotationRecord::ScopedAnnotationRecord(
+  SquaretsStats* stats
+  , const std::string& method
+  , const std::string& location)
+  : stats_(stats)
+{
+  DCHECK(stats_);
+  stats_->BeginAnnotation(method, location);
+}
+
+ScopedAnnotationRecord::~ScopedAnnotationRecord()
+{
+  stats_->EndAnnotation();
+}
+
+ScopedAnnotationPhase::ScopedAnnotationPhase(
+  SquaretsStats* stats
+  , AnnotationPhase phase)
+  : stats_(stats)
+  , phase_(phase)
+  , startTime_(base::TimeTicks::Now())
+{
+  DCHECK(stats_);
+}
+
+ScopedAnnotationPhase::~ScopedAnnotationPhase()
+{
+  stats_->AddPhaseTime(
+    phase_
+    , base::TimeTicks::Now() - startTime_);
+}
+
+} // namespace plugin
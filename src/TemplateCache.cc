@@ -0,0 +1,360 @@
+#include <flex_squarets_plugin/TemplateCache.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/Hash.hpp>
+
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/trace_event/trace_event.h>
+
+#if defined(OS_LINUX)
+#include <base/posix/eintr_wrapper.h>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // OS_LINUX
+
+#include <set>
+
+namespace plugin {
+
+namespace {
+
+#if defined(OS_LINUX)
+// editors may rewrite file in place or replace it by rename
+static const uint32_t kWatchMask
+  = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE
+    | IN_MOVE_SELF | IN_DELETE_SELF;
+#endif // OS_LINUX
+
+} // namespace
+
+bool TemplateFileWatcher::FileStamp::operator==(
+  const FileStamp& other) const
+{
+  return exists == other.exists
+    && lastModified == other.lastModified
+    && size == other.size;
+}
+
+TemplateFileWatcher::TemplateFileWatcher()
+{
+#if defined(OS_LINUX)
+  inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(inotifyFd_ < 0) {
+    PLOG(WARNING)
+      << "(squarets) inotify is not available,"
+         " modification time of templates will be checked";
+  }
+#endif // OS_LINUX
+}
+
+TemplateFileWatcher::~TemplateFileWatcher()
+{
+#if defined(OS_LINUX)
+  if(inotifyFd_ >= 0) {
+    // also removes all watches
+    IGNORE_EINTR(close(inotifyFd_));
+  }
+#endif // OS_LINUX
+}
+
+// static
+TemplateFileWatcher::FileStamp TemplateFileWatcher::GetFileStamp(
+  const base::FilePath& path)
+{
+  FileStamp stamp;
+  base::File::Info info;
+  if(base::GetFileInfo(path, &info)) {
+    stamp.exists = true;
+    stamp.lastModified = info.last_modified;
+    stamp.size = info.size;
+  }
+  return stamp;
+}
+
+void TemplateFileWatcher::Watch(
+  const base::FilePath& path)
+{
+  if(watchDescriptors_.count(path)) {
+    return;
+  }
+
+#if defined(OS_LINUX)
+  if(inotifyFd_ >= 0) {
+    const int wd
+      = inotify_add_watch(
+          inotifyFd_
+          , path.value().c_str()
+          , kWatchMask);
+    if(wd >= 0) {
+      watchDescriptors_[path] = wd;
+      watchedPaths_.emplace(wd, path);
+      return;
+    }
+    VPLOG(9)
+      << "(squarets) unable to watch file: "
+      << path;
+  }
+#endif // OS_LINUX
+
+  watchDescriptors_[path] = -1;
+  fileStamps_[path] = GetFileStamp(path);
+}
+
+void TemplateFileWatcher::unwatch(
+  const base::FilePath& path)
+{
+  auto it = watchDescriptors_.find(path);
+  if(it == watchDescriptors_.end()) {
+    return;
+  }
+
+#if defined(OS_LINUX)
+  const int wd = it->second;
+  if(wd >= 0) {
+    auto range = watchedPaths_.equal_range(wd);
+    for(auto pathIt = range.first; pathIt != range.second; ) {
+      if(pathIt->second == path) {
+        pathIt = watchedPaths_.erase(pathIt);
+      } else {
+        ++pathIt;
+      }
+    }
+    if(!watchedPaths_.count(wd)) {
+      // fails if watch was removed by kernel
+      // (file deleted), that is expected
+      inotify_rm_watch(inotifyFd_, wd);
+    }
+  }
+#endif // OS_LINUX
+
+  fileStamps_.erase(path);
+  watchDescriptors_.erase(it);
+}
+
+std::vector<base::FilePath> TemplateFileWatcher::TakeChangedFiles()
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::TemplateFileWatcher::TakeChangedFiles");
+
+  std::set<base::FilePath> changed;
+
+#if defined(OS_LINUX)
+  if(inotifyFd_ >= 0) {
+    alignas(struct inotify_event) char buffer[4096];
+    for(;;) {
+      // returns -1 with EAGAIN if there are no more events
+      const ssize_t length
+        = HANDLE_EINTR(read(inotifyFd_, buffer, sizeof(buffer)));
+      if(length <= 0) {
+        break;
+      }
+      for(const char* ptr = buffer; ptr < buffer + length; ) {
+        const struct inotify_event* event
+          = reinterpret_cast<const struct inotify_event*>(ptr);
+        if(event->mask & IN_Q_OVERFLOW) {
+          // events lost, assume that everything changed
+          for(const auto& it : watchedPaths_) {
+            changed.insert(it.second);
+          }
+        }
+        auto range = watchedPaths_.equal_range(event->wd);
+        for(auto it = range.first; it != range.second; ++it) {
+          changed.insert(it->second);
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  }
+#endif // OS_LINUX
+
+  for(const auto& it : fileStamps_) {
+    if(!(GetFileStamp(it.first) == it.second)) {
+      changed.insert(it.first);
+    }
+  }
+
+  for(const base::FilePath& path : changed) {
+    unwatch(path);
+  }
+
+  return std::vector<base::FilePath>(changed.begin(), changed.end());
+}
+
+TemplateCache::TemplateCache(
+  size_t maxGeneratedBytes)
+  : generated_(decltype(generated_)::NO_AUTO_EVICT)
+  , maxGeneratedBytes_(maxGeneratedBytes)
+{}
+
+TemplateCache::~TemplateCache() = default;
+
+// static
+std::string TemplateCache::generatedKey(
+  const std::string& enginePrefix
+  , const std::string& outputName
+  , const base::StringPiece16& templateContents)
+{
+  return hashToHex({
+    enginePrefix
+    , outputName
+    , llvm::StringRef(
+        reinterpret_cast<const char*>(templateContents.data())
+        , templateContents.size() * sizeof(base::char16))});
+}
+
+void TemplateCache::InvalidateChangedFiles()
+{
+  base::AutoLock lock(lock_);
+
+  for(const base::FilePath& path : watcher_.TakeChangedFiles()) {
+    VLOG(9)
+      << "(squarets) template file changed: "
+      << path;
+    invalidatedFiles_ += files_.erase(path);
+  }
+}
+
+bool TemplateCache::HasFile(
+  const base::FilePath& path) const
+{
+  base::AutoLock lock(lock_);
+
+  return files_.count(path) > 0;
+}
+
+std::shared_ptr<const base::string16> TemplateCache::FindFile(
+  const base::FilePath& path)
+{
+  base::AutoLock lock(lock_);
+
+  auto it = files_.find(path);
+  if(it == files_.end()) {
+    fileMisses_++;
+    return nullptr;
+  }
+  fileHits_++;
+  return it->second;
+}
+
+void TemplateCache::WatchFile(
+  const base::FilePath& path)
+{
+  base::AutoLock lock(lock_);
+
+  watcher_.Watch(path);
+}
+
+std::shared_ptr<const base::string16> TemplateCache::StoreFile(
+  const base::FilePath& path
+  , base::string16 contents)
+{
+  auto stored
+    = std::make_shared<const base::string16>(std::move(contents));
+
+  base::AutoLock lock(lock_);
+
+  files_[path] = stored;
+  return stored;
+}
+
+std::shared_ptr<const std::string> TemplateCache::FindGenerated(
+  const std::string& enginePrefix
+  , const std::string& outputName
+  , const base::StringPiece16& templateContents)
+{
+  // hashing does not require lock
+  const std::string key
+    = generatedKey(enginePrefix, outputName, templateContents);
+
+  base::AutoLock lock(lock_);
+
+  auto it = generated_.Get(key);
+  if(it == generated_.end()) {
+    generatedMisses_++;
+    return nullptr;
+  }
+  generatedHits_++;
+  return it->second;
+}
+
+void TemplateCache::StoreGenerated(
+  const std::string& enginePrefix
+  , const std::string& outputName
+  , const base::StringPiece16& templateContents
+  , std::string generatedCode)
+{
+  if(generatedCode.size() > maxGeneratedBytes_) {
+    VLOG(9)
+      << "(squarets) generated code is too large to be cached: "
+      << generatedCode.size()
+      << " bytes";
+    return;
+  }
+
+  const std::string key
+    = generatedKey(enginePrefix, outputName, templateContents);
+  auto stored
+    = std::make_shared<const std::string>(std::move(generatedCode));
+  const size_t storedBytes = stored->size();
+
+  base::AutoLock lock(lock_);
+
+  // replaced by |Put|
+  auto it = generated_.Peek(key);
+  if(it != generated_.end()) {
+    generatedBytes_ -= it->second->size();
+  }
+
+  generated_.Put(key, std::move(stored));
+  generatedBytes_ += storedBytes;
+
+  // least recently used entries are at back,
+  // just stored entry fits into limit
+  while(generatedBytes_ > maxGeneratedBytes_) {
+    auto oldest = generated_.rbegin();
+    DCHECK(oldest != generated_.rend());
+    generatedBytes_ -= oldest->second->size();
+    generated_.Erase(oldest);
+  }
+}
+
+void TemplateCache::ClearGenerated()
+{
+  base::AutoLock lock(lock_);
+
+  generated_.Clear();
+  generatedBytes_ = 0;
+}
+
+void TemplateCache::ReportStatus() const
+{
+  base::AutoLock lock(lock_);
+
+  LOG(INFO)
+    << "(squarets) template files: "
+    << files_.size()
+    << " cached, "
+    << fileHits_
+    << " hits, "
+    << fileMisses_
+    << " misses, "
+    << invalidatedFiles_
+    << " invalidated";
+
+  LOG(INFO)
+    << "(squarets) generated code: "
+    << generated_.size()
+    << " cached ("
+    << generatedBytes_
+    << " of "
+    << maxGeneratedBytes_
+    << " bytes), "
+    << generatedHits_
+    << " hits, "
+    << generatedMisses_
+    << " misses";
+}
+
+} // namespace plugin
@@ -0,0 +1,123 @@
+#include <flex_squarets_plugin/TemplateEngines.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/TemplateParser.hpp>
+#include <flex_squarets_plugin/TemplateScan.hpp>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+#include <base/strings/utf_string_conversions.h>
+
+namespace plugin {
+
+namespace {
+
+static const char kEngineCXTPL[] = "CXTPL;";
+
+static const char kEngineRAW[] = "RAW;";
+
+// text is emitted as single literal, without parsing
+static bool generateRaw(
+  const std::string& outputName
+  , const base::StringPiece16& templateContents
+  , std::string* generatedCode
+  , std::string* /*errorMessage*/)
+{
+  DCHECK(generatedCode);
+  *generatedCode
+    = generateLiteralAppend(
+        outputName
+        , templateContents);
+  return true;
+}
+
+} // namespace
+
+TemplateEngineRegistry::TemplateEngineRegistry()
+{
+  Register(kEngineCXTPL, base::BindRepeating(&generateTemplateCode));
+  Register(kEngineRAW, base::BindRepeating(&generateRaw));
+
+  const base::string16 prefix = base::ASCIIToUTF16(kEngineCXTPL);
+  base::StringPiece16 contents = prefix;
+  builtinCXTPL_ = Find(contents);
+  DCHECK(builtinCXTPL_);
+
+  const base::string16 rawPrefix = base::ASCIIToUTF16(kEngineRAW);
+  base::StringPiece16 rawContents = rawPrefix;
+  builtinRAW_ = Find(rawContents);
+  DCHECK(builtinRAW_);
+}
+
+TemplateEngineRegistry::~TemplateEngineRegistry() = default;
+
+void TemplateEngineRegistry::Register(
+  const std::string& prefix
+  , TemplateEngineCallback generate)
+{
+  CHECK(base::EndsWith(prefix, ";", base::CompareCase::SENSITIVE))
+    << "(squarets) template engine prefix must end with `;`: "
+    << prefix;
+  DCHECK(base::IsStringASCII(prefix));
+  DCHECK(generate);
+
+  VLOG(9)
+    << "(squarets) registered template engine: "
+    << prefix;
+
+  auto engine = std::make_unique<TemplateEngine>();
+  engine->prefix = prefix;
+  engine->generate = std::move(generate);
+
+  const std::string key = base::ToLowerASCII(prefix);
+
+  base::AutoLock lock(lock_);
+
+  // replaced engine may be used by other thread,
+  // so it is kept in |storage_|
+  engines_[key] = engine.get();
+  storage_.push_back(std::move(engine));
+}
+
+const TemplateEngine* TemplateEngineRegistry::Find(
+  base::StringPiece16& contents) const
+{
+  base::AutoLock lock(lock_);
+
+  for(const auto& it : engines_) {
+    if(removeTemplatePrefix(it.first, contents)) {
+      return it.second;
+    }
+  }
+  return nullptr;
+}
+
+bool TemplateEngineRegistry::IsBuiltinCXTPL(
+  const TemplateEngine& engine) const
+{
+  return &engine == builtinCXTPL_;
+}
+
+bool TemplateEngineRegistry::IsBuiltinRAW(
+  const TemplateEngine& engine) const
+{
+  return &engine == builtinRAW_;
+}
+
+std::string TemplateEngineRegistry::DescribePrefixes() const
+{
+  base::AutoLock lock(lock_);
+
+  std::string result;
+  for(const auto& it : engines_) {
+    if(!result.empty()) {
+      result += ", ";
+    }
+    result += "`";
+    result += it.second->prefix;
+    result += "`";
+  }
+  return result;
+}
+
+} // namespace plugin
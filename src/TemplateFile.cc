@@ -0,0 +1,292 @@
+#include <flex_squarets_plugin/TemplateFile.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/Stats.hpp>
+
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <base/trace_event/trace_event.h>
+
+#include <zlib.h>
+
+#if defined(SQUARETS_HAS_ZSTD)
+#include <zstd.h>
+#endif // SQUARETS_HAS_ZSTD
+
+#include <algorithm>
+#include <memory>
+
+namespace plugin {
+
+namespace {
+
+static const base::FilePath::CharType kGzipExtension[]
+  = FILE_PATH_LITERAL(".gz");
+
+static const base::FilePath::CharType kZstdExtension[]
+  = FILE_PATH_LITERAL(".zst");
+
+// size of compressed data read at once
+static const size_t kReadChunkSize = 64 * 1024;
+
+// output grows by at least this size
+static const size_t kMinOutputGrowth = 64 * 1024;
+
+// reads next chunk of compressed file,
+// returns -1 on error and 0 at end of file
+static int readChunk(
+  base::File& file
+  , char* buffer
+  , size_t* compressedBytes)
+{
+  const int bytesRead
+    = file.ReadAtCurrentPos(
+        buffer
+        , static_cast<int>(kReadChunkSize));
+  if(bytesRead > 0) {
+    *compressedBytes += static_cast<size_t>(bytesRead);
+  }
+  return bytesRead;
+}
+
+// makes room for at least |kMinOutputGrowth| bytes after |used|,
+// returns false if |maxSizeInBytes| exceeded
+static bool growOutput(
+  std::string* contents
+  , size_t used
+  , size_t maxSizeInBytes)
+{
+  if(used >= maxSizeInBytes) {
+    return false;
+  }
+  // doubles, so number of reallocations is logarithmic
+  const size_t size
+    = std::min(maxSizeInBytes
+        , std::max(used + kMinOutputGrowth, used * 2));
+  contents->resize(size);
+  return true;
+}
+
+static bool readGzipFile(
+  base::File& file
+  , size_t maxSizeInBytes
+  , std::string* contents
+  , size_t* compressedBytes)
+{
+  z_stream stream{};
+  // 32 enables detection of gzip and zlib headers
+  if(inflateInit2(&stream, 32 + MAX_WBITS) != Z_OK) {
+    return false;
+  }
+
+  std::unique_ptr<char[]> input(new char[kReadChunkSize]);
+  size_t used = 0;
+  int result = Z_OK;
+  bool needInput = true;
+  // output has |maxSizeInBytes|, but stream may end
+  // without more output (like trailer of gzip member)
+  bool atLimit = false;
+  bool ok = true;
+  while(true) {
+    if(needInput) {
+      const int bytesRead
+        = readChunk(file, input.get(), compressedBytes);
+      if(bytesRead <= 0) {
+        // error or truncated stream
+        ok = bytesRead == 0 && result == Z_STREAM_END;
+        break;
+      }
+      stream.next_in = reinterpret_cast<Bytef*>(input.get());
+      stream.avail_in = static_cast<uInt>(bytesRead);
+    }
+
+    if(result == Z_STREAM_END) {
+      // concatenated gzip members, like `cat a.gz b.gz`
+      if(inflateReset(&stream) != Z_OK) {
+        ok = false;
+        break;
+      }
+      result = Z_OK;
+    }
+
+    if(used == contents->size()
+       && !growOutput(contents, used, maxSizeInBytes))
+    {
+      atLimit = true;
+    }
+    stream.next_out = reinterpret_cast<Bytef*>(&(*contents)[used]);
+    stream.avail_out = static_cast<uInt>(contents->size() - used);
+
+    result = inflate(&stream, Z_NO_FLUSH);
+    used = contents->size() - stream.avail_out;
+    if(result == Z_BUF_ERROR && stream.avail_in == 0) {
+      // no progress without more input
+      result = Z_OK;
+    }
+    // |Z_BUF_ERROR| at limit means that stream has more output
+    if(result != Z_OK && result != Z_STREAM_END) {
+      ok = false;
+      break;
+    }
+
+    // output may be pending inside of |stream| if buffer is full,
+    // at limit it is detected by |Z_BUF_ERROR| on next input
+    needInput
+      = stream.avail_in == 0
+        && (stream.avail_out != 0 || result == Z_STREAM_END || atLimit);
+  }
+
+  inflateEnd(&stream);
+  contents->resize(used);
+  return ok;
+}
+
+#if defined(SQUARETS_HAS_ZSTD)
+static bool readZstdFile(
+  base::File& file
+  , size_t maxSizeInBytes
+  , std::string* contents
+  , size_t* compressedBytes)
+{
+  std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(
+    ZSTD_createDCtx(), &ZSTD_freeDCtx);
+  if(!context) {
+    return false;
+  }
+
+  std::unique_ptr<char[]> inputBuffer(new char[kReadChunkSize]);
+  ZSTD_inBuffer input{inputBuffer.get(), 0, 0};
+  size_t used = 0;
+  // 0 after end of frame
+  size_t result = 0;
+  bool needInput = true;
+  // output has |maxSizeInBytes|, but frame may end
+  // without more output (like checksum of frame)
+  bool atLimit = false;
+  bool ok = true;
+  while(true) {
+    if(needInput) {
+      const int bytesRead
+        = readChunk(file, inputBuffer.get(), compressedBytes);
+      if(bytesRead <= 0) {
+        // error or truncated frame
+        ok = bytesRead == 0 && result == 0;
+        break;
+      }
+      input.size = static_cast<size_t>(bytesRead);
+      input.pos = 0;
+    }
+
+    if(used == contents->size()
+       && !growOutput(contents, used, maxSizeInBytes))
+    {
+      atLimit = true;
+    }
+    ZSTD_outBuffer output{&(*contents)[used], contents->size() - used, 0};
+
+    const size_t inputPos = input.pos;
+    result = ZSTD_decompressStream(context.get(), &output, &input);
+    used += output.pos;
+    if(ZSTD_isError(result)) {
+      LOG(WARNING)
+        << "(squarets) zstd error: "
+        << ZSTD_getErrorName(result);
+      ok = false;
+      break;
+    }
+    if(atLimit
+       && input.pos == inputPos
+       && input.pos < input.size)
+    {
+      // no progress without room for output
+      ok = false;
+      break;
+    }
+
+    // output may be pending inside of |context| if buffer is full,
+    // at limit it is detected by lack of progress on next input
+    needInput
+      = input.pos == input.size
+        && (output.pos < output.size || result == 0 || atLimit);
+  }
+
+  contents->resize(used);
+  return ok;
+}
+#endif // SQUARETS_HAS_ZSTD
+
+} // namespace
+
+bool isCompressedTemplateFile(
+  const base::FilePath& path)
+{
+  return path.MatchesExtension(kGzipExtension)
+    || path.MatchesExtension(kZstdExtension);
+}
+
+bool readTemplateFile(
+  const base::FilePath& path
+  , size_t maxSizeInBytes
+  , std::string* contents
+  , SquaretsStats* stats)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::readTemplateFile");
+
+  DCHECK(contents);
+
+  if(!isCompressedTemplateFile(path)) {
+    return base::ReadFileToStringWithMaxSize(
+      path
+      , contents
+      , maxSizeInBytes);
+  }
+
+  contents->clear();
+
+  base::File file(
+    path
+    , base::File::FLAG_OPEN | base::File::FLAG_READ);
+  if(!file.IsValid()) {
+    return false;
+  }
+
+  const base::TimeTicks startTime = base::TimeTicks::Now();
+  size_t compressedBytes = 0;
+  bool ok = false;
+  if(path.MatchesExtension(kGzipExtension)) {
+    ok = readGzipFile(file, maxSizeInBytes, contents, &compressedBytes);
+  } else {
+#if defined(SQUARETS_HAS_ZSTD)
+    ok = readZstdFile(file, maxSizeInBytes, contents, &compressedBytes);
+#else
+    LOG(ERROR)
+      << "(squarets) unable to read "
+      << path
+      << ": plugin is built without zstd";
+    return false;
+#endif // SQUARETS_HAS_ZSTD
+  }
+
+  if(!ok) {
+    LOG(WARNING)
+      << "(squarets) unable to decompress "
+      << path
+      << " (corrupted or larger than "
+      << maxSizeInBytes
+      << " bytes)";
+    return false;
+  }
+
+  if(stats) {
+    stats->AddDecompressedFile(
+      compressedBytes
+      , contents->size()
+      , base::TimeTicks::Now() - startTime);
+  }
+
+  return true;
+}
+
+} // namespace plugin
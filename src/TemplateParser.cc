@@ -0,0 +1,97 @@
+#include <flex_squarets_plugin/TemplateParser.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/TemplateScan.hpp>
+
+#include <squarets/core/squarets.hpp>
+#include <squarets/core/errors/errors.hpp>
+
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+
+#include <sstream>
+
+namespace plugin {
+
+bool removeTemplatePrefix(
+  const base::StringPiece& prefix
+  , base::StringPiece16& contents)
+{
+  DCHECK(base::IsStringASCII(prefix));
+
+  if(contents.size() < prefix.size()) {
+    return false;
+  }
+
+  // compare without conversion of |prefix| to UTF-16
+  for(size_t i = 0; i < prefix.size(); ++i) {
+    if(base::ToLowerASCII(contents[i])
+       != base::ToLowerASCII(
+            static_cast<base::char16>(prefix[i])))
+    {
+      return false;
+    }
+  }
+
+  contents.remove_prefix(prefix.size());
+  return true;
+}
+
+bool generateTemplateCode(
+  const std::string& outputName
+  , const base::StringPiece16& templateContents
+  , std::string* generatedCode
+  , std::string* errorMessage)
+{
+  DCHECK(generatedCode);
+  DCHECK(generatedCode->empty());
+
+  // template without tags is plain text,
+  // so squarets is not required to parse it
+  if(!templateContents.empty()
+     && !hasTemplateDelimiter(templateContents))
+  {
+    *generatedCode
+      = generateLiteralAppend(
+          outputName
+          , templateContents);
+    return true;
+  }
+
+  squarets::core::Generator template_engine(
+    // output variable name
+    outputName
+  );
+
+  outcome::result<
+      std::string
+      , squarets::core::errors::GeneratorErrorExtraInfo
+    >
+    genResult
+      = template_engine.generate_from_UTF16(
+        templateContents);
+
+  if(genResult.has_error()) {
+    if(errorMessage) {
+      const std::error_code& ec
+        = make_error_code(genResult.error().ec);
+      std::ostringstream sstr;
+      sstr
+        << "message: "
+        << ec.message()
+        << " category: "
+        << ec.category().name()
+        << " info: "
+        << genResult.error().extra_info;
+      *errorMessage = sstr.str();
+    }
+    return false;
+  }
+
+  if(genResult.has_value()) {
+    // output of squarets may take megabytes
+    *generatedCode = std::move(genResult.value());
+  }
+  return true;
+}
+
+} // namespace plugin
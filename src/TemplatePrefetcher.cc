@@ -0,0 +1,232 @@
+#include <flex_squarets_plugin/TemplatePrefetcher.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/TemplateFile.hpp>
+#include <flex_squarets_plugin/TemplateParser.hpp>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/stl_util.h>
+#include <base/strings/string_util.h>
+#include <base/strings/utf_string_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+
+namespace plugin {
+
+namespace {
+
+static const char kSquaretsFileMethod[] = "{squaretsFile};";
+
+static const char kAnnotationCXTPL[] = "CXTPL;";
+
+// collects paths from annotations like
+// __attribute__((annotate("{gen};{squaretsFile};CXTPL;" "file/path")))
+class SquaretsFileVisitor
+  : public clang::RecursiveASTVisitor<SquaretsFileVisitor> {
+public:
+  explicit SquaretsFileVisitor(
+    clang::SourceManager& sourceManager
+    , std::vector<PrefetchRequest>* requests)
+    : sourceManager_(sourceManager)
+    , requests_(requests)
+  {}
+
+  bool TraverseDecl(clang::Decl* decl)
+  {
+    // templates can not be used in system headers
+    if(decl
+       && decl->getLocation().isValid()
+       && sourceManager_.isInSystemHeader(decl->getLocation()))
+    {
+      return true;
+    }
+    return clang::RecursiveASTVisitor<
+      SquaretsFileVisitor>::TraverseDecl(decl);
+  }
+
+  bool VisitVarDecl(clang::VarDecl* varDecl)
+  {
+    for(const clang::AnnotateAttr* annotateAttr
+        : varDecl->specific_attrs<clang::AnnotateAttr>())
+    {
+      const llvm::StringRef annotation
+        = annotateAttr->getAnnotation();
+      const size_t methodPos
+        = annotation.find(kSquaretsFileMethod);
+      if(methodPos == llvm::StringRef::npos) {
+        continue;
+      }
+      llvm::StringRef path
+        = annotation.drop_front(
+            methodPos + base::size(kSquaretsFileMethod) - 1);
+      if(!path.startswith_lower(kAnnotationCXTPL)) {
+        // reported by usual code path
+        continue;
+      }
+      path = path.drop_front(base::size(kAnnotationCXTPL) - 1);
+      requests_->emplace_back(
+        base::FilePath{path.str()}
+        , varDecl->getNameAsString());
+    }
+    return true;
+  }
+
+private:
+  clang::SourceManager& sourceManager_;
+
+  std::vector<PrefetchRequest>* requests_;
+};
+
+static std::shared_ptr<const PrefetchedTemplate> loadAndParse(
+  const PrefetchRequest& request
+  , size_t maxFileSizeInBytes
+  , SquaretsStats* stats)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::TemplatePrefetcher::loadAndParse");
+
+  auto result = std::make_shared<PrefetchedTemplate>();
+
+  std::string fileContents;
+  result->fileOk
+    = readTemplateFile(
+        request.first
+        , maxFileSizeInBytes
+        , &fileContents
+        , stats);
+  if(!result->fileOk) {
+    return result;
+  }
+
+  result->contents = base::UTF8ToUTF16(fileContents);
+
+  // errors will be reported by usual code path
+  if(!generateTemplateCode(
+       request.second
+       , result->contents
+       , &result->generatedCode
+       , nullptr))
+  {
+    result->generatedCode.clear();
+  }
+
+  return result;
+}
+
+} // namespace
+
+std::vector<PrefetchRequest> collectSquaretsFileAnnotations(
+  clang::ASTContext& astContext)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::collectSquaretsFileAnnotations");
+
+  std::vector<PrefetchRequest> requests;
+  SquaretsFileVisitor visitor(
+    astContext.getSourceManager(), &requests);
+  visitor.TraverseDecl(astContext.getTranslationUnitDecl());
+  return requests;
+}
+
+TemplatePrefetcher::TemplatePrefetcher(
+  size_t maxThreads
+  , size_t maxFileSizeInBytes
+  , SquaretsStats* stats)
+  : maxThreads_(maxThreads)
+  , maxFileSizeInBytes_(maxFileSizeInBytes)
+  , stats_(stats)
+{
+  DCHECK(maxThreads_);
+
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+TemplatePrefetcher::~TemplatePrefetcher()
+{
+  joinWorkers();
+}
+
+void TemplatePrefetcher::joinWorkers()
+{
+  for(std::thread& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+void TemplatePrefetcher::PrefetchAll(
+  std::vector<PrefetchRequest> requests)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::TemplatePrefetcher::PrefetchAll");
+
+  // threads from previous batch usually already finished
+  joinWorkers();
+  results_.clear();
+
+  std::sort(requests.begin(), requests.end());
+  requests.erase(
+    std::unique(requests.begin(), requests.end())
+    , requests.end());
+
+  if(requests.empty()) {
+    return;
+  }
+
+  auto batch = std::make_shared<Batch>();
+  batch->requests = std::move(requests);
+  batch->results.resize(batch->requests.size());
+
+  for(size_t i = 0; i < batch->requests.size(); ++i) {
+    results_.emplace(
+      batch->requests[i]
+      , batch->results[i].get_future().share());
+  }
+
+  VLOG(9)
+    << "(squarets) prefetching "
+    << batch->requests.size()
+    << " template files";
+
+  const size_t threads
+    = std::min(maxThreads_, batch->requests.size());
+  const size_t maxFileSizeInBytes = maxFileSizeInBytes_;
+  SquaretsStats* stats = stats_;
+  for(size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([batch, maxFileSizeInBytes, stats]() {
+      for(size_t index = batch->next++
+          ; index < batch->requests.size()
+          ; index = batch->next++)
+      {
+        batch->results[index].set_value(
+          loadAndParse(
+            batch->requests[index]
+            , maxFileSizeInBytes
+            , stats));
+      }
+    });
+  }
+}
+
+std::shared_ptr<const PrefetchedTemplate> TemplatePrefetcher::Take(
+  const PrefetchRequest& request)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::TemplatePrefetcher::Take");
+
+  auto it = results_.find(request);
+  if(it == results_.end()) {
+    return nullptr;
+  }
+
+  return it->second.get();
+}
+
+} // namespace plugin
@@ -0,0 +1,264 @@
+#include <flex_squarets_plugin/TemplateScan.hpp> // IWYU pragma: associated
+
+#include <flex_squarets_plugin/GeneratedCode.hpp>
+
+#include <base/cpu.h>
+#include <base/logging.h>
+#include <base/strings/utf_string_conversions.h>
+#include <build/build_config.h>
+
+#if defined(ARCH_CPU_X86_FAMILY) && defined(COMPILER_GCC)
+#define SQUARETS_SCAN_SIMD 1
+#include <immintrin.h>
+#endif // ARCH_CPU_X86_FAMILY && COMPILER_GCC
+
+namespace plugin {
+
+namespace {
+
+static const base::char16 kOpenBracket = '[';
+
+static const base::char16 kCloseBracket = ']';
+
+// results of scan shared by all implementations
+struct ScanState {
+  // index of first code unit that
+  // is not part of already found pair
+  size_t nextAllowed = 0;
+
+  // null if scan stops at first found pair
+  std::vector<size_t>* positions = nullptr;
+
+  bool isFound = false;
+};
+
+// checks pair of brackets at |index|
+// and skips second bracket of found pair,
+// returns true if scan must stop
+static inline bool checkCandidate(
+  const base::char16* data
+  , size_t size
+  , size_t index
+  , ScanState* state)
+{
+  if(index < state->nextAllowed || index + 1 >= size) {
+    return false;
+  }
+  const base::char16 c = data[index];
+  if((c == kOpenBracket || c == kCloseBracket)
+     && data[index + 1] == c)
+  {
+    state->isFound = true;
+    if(!state->positions) {
+      return true;
+    }
+    state->positions->push_back(index);
+    state->nextAllowed = index + 2;
+  }
+  return false;
+}
+
+static void scanScalar(
+  const base::char16* data
+  , size_t size
+  , size_t begin
+  , ScanState* state)
+{
+  for(size_t i = begin; i < size; ++i) {
+    if(checkCandidate(data, size, i, state)) {
+      return;
+    }
+  }
+}
+
+#if defined(SQUARETS_SCAN_SIMD)
+// |mask| has two bits per UTF-16 code unit,
+// returns true if scan must stop
+static inline bool checkMask(
+  const base::char16* data
+  , size_t size
+  , size_t blockBegin
+  , unsigned mask
+  , ScanState* state)
+{
+  // keep one bit per code unit
+  mask &= 0x55555555u;
+  while(mask) {
+    const size_t index
+      = blockBegin + (__builtin_ctz(mask) / 2);
+    if(checkCandidate(data, size, index, state)) {
+      return true;
+    }
+    mask &= mask - 1;
+  }
+  return false;
+}
+
+// processes 8 code units per iteration,
+// returns index of first unprocessed code unit
+// (|size| if scan stopped)
+static size_t scanSSE2(
+  const base::char16* data
+  , size_t size
+  , ScanState* state)
+{
+  const __m128i open = _mm_set1_epi16(kOpenBracket);
+  const __m128i close = _mm_set1_epi16(kCloseBracket);
+
+  size_t i = 0;
+  for(; i + 8 <= size; i += 8) {
+    const __m128i chunk
+      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i found
+      = _mm_or_si128(
+          _mm_cmpeq_epi16(chunk, open)
+          , _mm_cmpeq_epi16(chunk, close));
+    const unsigned mask
+      = static_cast<unsigned>(_mm_movemask_epi8(found));
+    if(mask && checkMask(data, size, i, mask, state)) {
+      return size;
+    }
+  }
+  return i;
+}
+
+// processes 16 code units per iteration,
+// returns index of first unprocessed code unit
+// (|size| if scan stopped)
+__attribute__((target("avx2")))
+static size_t scanAVX2(
+  const base::char16* data
+  , size_t size
+  , ScanState* state)
+{
+  const __m256i open = _mm256_set1_epi16(kOpenBracket);
+  const __m256i close = _mm256_set1_epi16(kCloseBracket);
+
+  size_t i = 0;
+  for(; i + 16 <= size; i += 16) {
+    const __m256i chunk
+      = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    const __m256i found
+      = _mm256_or_si256(
+          _mm256_cmpeq_epi16(chunk, open)
+          , _mm256_cmpeq_epi16(chunk, close));
+    const unsigned mask
+      = static_cast<unsigned>(_mm256_movemask_epi8(found));
+    if(mask && checkMask(data, size, i, mask, state)) {
+      return size;
+    }
+  }
+  return i;
+}
+#endif // SQUARETS_SCAN_SIMD
+
+// runs implementation selected by |mode|,
+// returns false if |mode| is not supported by build or CPU
+static bool scanWithMode(
+  DelimiterScanMode mode
+  , const base::StringPiece16& contents
+  , ScanState* state)
+{
+#if defined(SQUARETS_SCAN_SIMD)
+  static const bool hasAVX2 = base::CPU().has_avx2();
+  if(mode == DelimiterScanMode::kAuto) {
+    mode
+      = hasAVX2
+        ? DelimiterScanMode::kAVX2
+        : DelimiterScanMode::kSSE2;
+  }
+  if(mode == DelimiterScanMode::kAVX2 && !hasAVX2) {
+    return false;
+  }
+#else
+  if(mode == DelimiterScanMode::kAuto) {
+    mode = DelimiterScanMode::kScalar;
+  }
+  if(mode != DelimiterScanMode::kScalar) {
+    return false;
+  }
+#endif // SQUARETS_SCAN_SIMD
+
+  const base::char16* data = contents.data();
+  const size_t size = contents.size();
+
+  size_t scalarBegin = 0;
+#if defined(SQUARETS_SCAN_SIMD)
+  if(mode == DelimiterScanMode::kAVX2) {
+    scalarBegin = scanAVX2(data, size, state);
+  } else if(mode == DelimiterScanMode::kSSE2) {
+    scalarBegin = scanSSE2(data, size, state);
+  }
+#endif // SQUARETS_SCAN_SIMD
+
+  // tail that does not fit into vector registers
+  scanScalar(data, size, scalarBegin, state);
+  return true;
+}
+
+} // namespace
+
+void scanTemplateDelimiters(
+  const base::StringPiece16& contents
+  , std::vector<size_t>* positions)
+{
+  const bool isScanned
+    = scanTemplateDelimitersWithMode(
+        DelimiterScanMode::kAuto, contents, positions);
+  DCHECK(isScanned);
+}
+
+bool scanTemplateDelimitersWithMode(
+  DelimiterScanMode mode
+  , const base::StringPiece16& contents
+  , std::vector<size_t>* positions)
+{
+  DCHECK(positions);
+
+  ScanState state;
+  state.positions = positions;
+  return scanWithMode(mode, contents, &state);
+}
+
+bool hasTemplateDelimiter(
+  const base::StringPiece16& contents)
+{
+  bool hasDelimiter = false;
+  const bool isScanned
+    = hasTemplateDelimiterWithMode(
+        DelimiterScanMode::kAuto, contents, &hasDelimiter);
+  DCHECK(isScanned);
+  return hasDelimiter;
+}
+
+bool hasTemplateDelimiterWithMode(
+  DelimiterScanMode mode
+  , const base::StringPiece16& contents
+  , bool* hasDelimiter)
+{
+  DCHECK(hasDelimiter);
+
+  ScanState state;
+  if(!scanWithMode(mode, contents, &state)) {
+    return false;
+  }
+  *hasDelimiter = state.isFound;
+  return true;
+}
+
+std::string generateLiteralAppend(
+  const std::string& outputName
+  , const base::StringPiece16& contents)
+{
+  const std::string text = base::UTF16ToUTF8(contents);
+
+  std::string result;
+  result.reserve(text.size() + outputName.size() + 32);
+  result += outputName;
+  result += "\n +=\n";
+  appendRawStringLiteral(text, &result);
+  result += "\n ;\n";
+  return result;
+}
+
+} // namespace plugin
@@ -0,0 +1,190 @@
+#include <flex_squarets_plugin/TemplateSearchIndex.hpp> // IWYU pragma: associated
+
+#include <base/files/file.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/trace_event/trace_event.h>
+
+#include <build/build_config.h>
+
+#if defined(OS_POSIX)
+#include <sys/stat.h>
+#endif // OS_POSIX
+
+#include <utility>
+
+namespace plugin {
+
+namespace {
+
+#if defined(OS_POSIX)
+// same precision for listed and checked files
+static void setStamp(
+  const struct stat& info
+  , TemplateSearchIndex::Entry* entry)
+{
+  entry->inode = static_cast<uint64_t>(info.st_ino);
+  entry->lastModified = base::Time::FromTimeT(info.st_mtime);
+  entry->size = static_cast<int64_t>(info.st_size);
+}
+#endif // OS_POSIX
+
+// returns false if |path| is not file
+static bool readEntry(
+  const base::FilePath& path
+  , TemplateSearchIndex::Entry* entry)
+{
+#if defined(OS_POSIX)
+  struct stat info;
+  if(stat(path.value().c_str(), &info) != 0
+     || !S_ISREG(info.st_mode))
+  {
+    return false;
+  }
+  setStamp(info, entry);
+#else
+  base::File::Info info;
+  if(!base::GetFileInfo(path, &info) || info.is_directory) {
+    return false;
+  }
+  entry->lastModified = info.last_modified;
+  entry->size = info.size;
+#endif // OS_POSIX
+  entry->path = path;
+  return true;
+}
+
+static bool hasSameStamp(
+  const TemplateSearchIndex::Entry& lhs
+  , const TemplateSearchIndex::Entry& rhs)
+{
+  return lhs.inode == rhs.inode
+    && lhs.lastModified == rhs.lastModified
+    && lhs.size == rhs.size;
+}
+
+} // namespace
+
+TemplateSearchIndex::TemplateSearchIndex(
+  std::vector<base::FilePath> roots)
+  : roots_(std::move(roots))
+{}
+
+TemplateSearchIndex::~TemplateSearchIndex() = default;
+
+void TemplateSearchIndex::indexRootsIfRequired()
+{
+  lock_.AssertAcquired();
+
+  if(indexed_) {
+    return;
+  }
+  indexed_ = true;
+
+  TRACE_EVENT0("toplevel",
+               "plugin::TemplateSearchIndex::indexRoots");
+
+  const base::TimeTicks startTime = base::TimeTicks::Now();
+
+  for(const base::FilePath& root : roots_) {
+    base::FileEnumerator enumerator(
+      root
+      , true // recursive
+      , base::FileEnumerator::FILES);
+    for(base::FilePath path = enumerator.Next()
+        ; !path.empty()
+        ; path = enumerator.Next())
+    {
+      base::FilePath relativePath;
+      if(!root.AppendRelativePath(path, &relativePath)) {
+        continue;
+      }
+
+      const base::FileEnumerator::FileInfo info
+        = enumerator.GetInfo();
+      Entry entry;
+      entry.path = path;
+#if defined(OS_POSIX)
+      setStamp(info.stat(), &entry);
+#else
+      entry.lastModified = info.GetLastModifiedTime();
+      entry.size = info.GetSize();
+#endif // OS_POSIX
+
+      // earlier roots have priority
+      entries_.emplace(relativePath, std::move(entry));
+    }
+  }
+
+  VLOG(9)
+    << "(squarets) indexed "
+    << entries_.size()
+    << " template files in "
+    << roots_.size()
+    << " search roots in "
+    << (base::TimeTicks::Now() - startTime).InMilliseconds()
+    << "ms";
+}
+
+bool TemplateSearchIndex::Resolve(
+  const base::FilePath& name
+  , Entry* entry)
+{
+  DCHECK(entry);
+
+  if(name.IsAbsolute() || name.empty()) {
+    return false;
+  }
+
+  base::AutoLock lock(lock_);
+
+  indexRootsIfRequired();
+
+  auto it = entries_.find(name);
+  if(it != entries_.end()) {
+    Entry current;
+    if(readEntry(it->second.path, &current)) {
+      if(!hasSameStamp(current, it->second)) {
+        VLOG(9)
+          << "(squarets) template changed since indexing: "
+          << current.path;
+        it->second = std::move(current);
+      }
+      *entry = it->second;
+      return true;
+    }
+    // removed since indexing, later root may have it
+    VLOG(9)
+      << "(squarets) template removed since indexing: "
+      << it->second.path;
+    entries_.erase(it);
+  } else if(missing_.find(name) != missing_.end()) {
+    return false;
+  }
+
+  // file added after roots were indexed
+  // or path with `..` components
+  for(const base::FilePath& root : roots_) {
+    Entry found;
+    if(!readEntry(root.Append(name), &found)) {
+      continue;
+    }
+    *entry = entries_.emplace(name, std::move(found)).first->second;
+    return true;
+  }
+
+  missing_.insert(name);
+  return false;
+}
+
+void TemplateSearchIndex::Invalidate()
+{
+  base::AutoLock lock(lock_);
+
+  indexed_ = false;
+  entries_.clear();
+  missing_.clear();
+}
+
+} // namespace plugin
@@ -1,5 +1,15 @@
 #include <flex_squarets_plugin/Tooling.hpp> // IWYU pragma: associated
 
+#include <flex_squarets_plugin/AllocationProfiler.hpp>
+#include <flex_squarets_plugin/AotRenderCache.hpp>
+#include <flex_squarets_plugin/GeneratedCode.hpp>
+#include <flex_squarets_plugin/HeaderAnnotationCache.hpp>
+#include <flex_squarets_plugin/Hash.hpp>
+#include <flex_squarets_plugin/PerfMap.hpp>
+#include <flex_squarets_plugin/TemplateEngines.hpp>
+#include <flex_squarets_plugin/TemplateFile.hpp>
+#include <flex_squarets_plugin/TemplateParser.hpp>
+
 #include <squarets/core/squarets.hpp>
 #include <squarets/codegen/cpp/cpp_codegen.hpp>
 #include <squarets/core/defaults/defaults.hpp>
@@ -22,14 +32,27 @@
 #include <flexlib/options/ctp/options.hpp>
 #if defined(CLING_IS_ON)
 #include "flexlib/ClingInterpreterModule.hpp"
+
+#include <cling/Interpreter/Interpreter.h>
+#include <cling/Interpreter/Transaction.h>
+#include <cling/Interpreter/Value.h>
 #endif // CLING_IS_ON
 
 #include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Frontend/CompilerInstance.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/Lex/Preprocessor.h>
+#include <clang/Lex/PreprocessorOptions.h>
+#include <clang/Lex/HeaderSearchOptions.h>
 #include <clang/Lex/Lexer.h>
+#include <clang/Basic/TargetOptions.h>
+#include <clang/Basic/Version.h>
+
+#include <llvm/ADT/Hashing.h>
+#include <llvm/ADT/StringRef.h>
 
 #include <base/cpu.h>
 #include <base/bind.h>
@@ -40,14 +63,20 @@
 #include <base/sequenced_task_runner.h>
 #include <base/trace_event/trace_event.h>
 #include <base/logging.h>
+#include <base/strings/strcat.h>
 #include <base/strings/string_util.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/string_split.h>
 #include <base/strings/utf_string_conversions.h>
+#include <base/synchronization/lock.h>
+#include <base/sys_info.h>
 #include <base/stl_util.h>
 #include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
 
+#include <algorithm>
 #include <any>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <regex>
@@ -58,12 +87,55 @@ namespace plugin {
 
 namespace {
 
-static const char kAnnotationCXTPL[] = "CXTPL;";
+// name of `std::string*` variable passed into code executed by Cling,
+// interpreted code writes its result into pointed string
+static const char kClingOutputName[] = "squaretsOutput";
+
+// name prefix of functions generated
+// by |SquaretsSettings::renderHelpers|
+static const char kRenderHelperPrefix[] = "squarets_render_";
+
+// name of output variable in generated render helpers
+static const char kRenderHelperOutputName[] = "squarets_out";
+
+// name prefix of arrays generated
+// by |EmissionMode::kTable|
+static const char kLiteralTablePrefix[] = "squarets_chunks_";
+
+// name prefix of functions generated
+// by |SquaretsSettings::outOfLineDir|
+static const char kOutOfLinePrefix[] = "squarets_out_of_line_";
+
+// extension of files generated
+// by |SquaretsSettings::outOfLineDir|
+static const base::FilePath::CharType kOutOfLineExtension[]
+  = FILE_PATH_LITERAL("squarets.cc");
+
+// number of hex digits of path hash in names of files
+// generated by |SquaretsSettings::outOfLineDir|
+static const size_t kOutOfLineHashLength = 8;
+
+// declares types used by functions built by |AotRenderCache|,
+// followed by |SquaretsSettings::aotPrelude|
+static const char kAotPrelude[] =
+  "#include <string>\n"
+  "#include <clang/AST/Attr.h>\n"
+  "#include <clang/ASTMatchers/ASTMatchFinder.h>\n"
+  "#include <clang/Rewrite/Core/Rewriter.h>\n"
+  "#include <flexlib/reflect/ReflTypes.hpp>\n";
 
 static const size_t kMB = 1024 * 1024;
 
 static const size_t kGB = 1024 * kMB;
 
+// name prefix of functions that wrap code of annotation
+// if |SquaretsSettings::clingPerfMap| is set
+static const char kPerfMapFunctionPrefix[] = "squarets_jit_";
+
+// code range larger than that means that marker
+// of |perfMapDeclarations| was not placed after code of annotation
+static const size_t kMaxPerfMapEntrySize = 64 * kMB;
+
 /// \note |base::ReadFileToStringWithMaxSize| implementation
 /// uses size_t
 /// The standard says that SIZE_MAX for size_t must be at least 65535.
@@ -72,90 +144,96 @@ static const size_t kGB = 1024 * kMB;
 /// or (64bit) 18446744073709551615UL
 static const size_t kMaxFileSizeInBytes = 1024 * kGB;
 
+// limits memory used by edits of annotations
+// reused by |HeaderAnnotationCache| during run
+static const size_t kMaxCachedHeaderAnnotations = 16384;
+
+// |base::UTF8ToUTF16| measured by |AllocationProfiler|
+static base::string16 transcodeToUTF16(
+  const base::StringPiece& text)
+{
+  ScopedAllocationPhase transcodePhase(
+    AllocationPhase::kTranscode);
+  return base::UTF8ToUTF16(text);
+}
+
+// |base::UTF16ToUTF8| measured by |AllocationProfiler|
+static std::string transcodeToUTF8(
+  const base::StringPiece16& text)
+{
+  ScopedAllocationPhase transcodePhase(
+    AllocationPhase::kTranscode);
+  return base::UTF16ToUTF8(text);
+}
+
 // example before:
 // __attribute__((annotate("{gen};{squarets};CXTPL;" #__VA_ARGS__ )))
 // contentsUTF16 == "CXTPL;" #__VA_ARGS__
 // example after:
 // result == "" #__VA_ARGS__
-static bool removeSyntaxPrefix(
+// returns engine selected by removed prefix
+static const TemplateEngine& removeSyntaxPrefix(
   const clang::SourceLocation& initStartLoc
-  , const char prefix[]
-  , const size_t prefix_size
+  , const TemplateEngineRegistry& templateEngines
   , clang::SourceManager &SM
   , base::StringPiece16& result)
 {
-  const bool isSyntaxCXTPL
-    = base::StartsWith(
-        result
-        , base::StringPiece16{
-            base::ASCIIToUTF16(prefix)}
-        , base::CompareCase::INSENSITIVE_ASCII);
-  if(isSyntaxCXTPL) {
-    DCHECK(prefix_size);
-    result.remove_prefix(
-      prefix_size - 1);
-  } else {
+  ScopedAllocationPhase prefixPhase(
+    AllocationPhase::kPrefix);
+
+  const TemplateEngine* engine
+    = templateEngines.Find(result);
+  if(!engine) {
     DCHECK(initStartLoc.isValid());
     LOG(ERROR)
       << "(squarets) invalid annotation syntax."
-         " For now squarets supports only `CXTPL;`"
-         " template engine: "
+         " Supported template engines: "
+      << templateEngines.DescribePrefixes()
+      << " "
       << initStartLoc.printToString(SM);
     CHECK(false);
-    return false;
   }
 
-  return true;
+  return *engine;
 }
 
 static std::string runTemplateParser(
+  // parses template
+  const TemplateEngine& engine
   // name of output variable in generated code
-  const std::string& nodeName
+  , const std::string& nodeName
   // template to parse
   , const base::StringPiece16& clean_contents
   // initial annotation code, for logging
   , const std::string& processedAnnotation
 ){
-  squarets::core::Generator template_engine(
-    // output variable name
-    nodeName
-  );
-
-  const outcome::result<
-      std::string
-      , squarets::core::errors::GeneratorErrorExtraInfo
-    >
-    genResult
-      = template_engine.generate_from_UTF16(
-        clean_contents);
-
-  if(genResult.has_error()) {
-    {
-      const std::error_code& ec
-        = make_error_code(genResult.error().ec);
-      LOG(ERROR)
-        << "(squarets) ERROR:"
-        << " message: "
-        << ec.message()
-        << " category: "
-        << ec.category().name()
-        << " info: "
-        << genResult.error().extra_info
-        << " input data: "
-        /// \note limit to first N symbols
-        << processedAnnotation.substr(0, 1000)
-        << "...";
-    }
+  std::string generatedCode;
+  std::string errorMessage;
+
+  if(!engine.generate.Run(
+       nodeName
+       , clean_contents
+       , &generatedCode
+       , &errorMessage))
+  {
+    LOG(ERROR)
+      << "(squarets) ERROR in "
+      << engine.prefix
+      << " template: "
+      << errorMessage
+      << " input data: "
+      /// \note limit to first N symbols
+      << processedAnnotation.substr(0, 1000)
+      << "...";
     CHECK(false);
     return "";
   }
 
-  if(!genResult.has_value() || genResult.value().empty()) {
+  if(generatedCode.empty()) {
     LOG(WARNING) << "WARNING: empty output from squarets ";
-    return "";
   }
 
-  return genResult.value();
+  return generatedCode;
 }
 
 static void insertCodeAfterPos(
@@ -167,7 +245,12 @@ static void insertCodeAfterPos(
   , clang::SourceLocation& nodeStartLoc
   , clang::SourceLocation& nodeEndLoc
   , const std::string& codeToInsert
+  // records edit of annotation placed in header, may be null
+  , AnnotationEditRecorder* recorder
 ){
+  ScopedAllocationPhase rewritePhase(
+    AllocationPhase::kRewrite);
+
   clang::SourceManager &SM
     = rewriter.getSourceMgr();
 
@@ -216,8 +299,7 @@ static void insertCodeAfterPos(
   clang::SourceLocation realEnd
     = nodeEndLoc.getLocWithOffset(offset);
 
-  rewriter.InsertText(realEnd, codeToInsert,
-    /*InsertAfter=*/true, /*IndentNewLines*/ false);
+  insertTextAfter(rewriter, realEnd, codeToInsert, recorder);
 }
 
 static void replaceCodeAfterPos(
@@ -229,7 +311,12 @@ static void replaceCodeAfterPos(
   , clang::SourceLocation& nodeStartLoc
   , clang::SourceLocation& nodeEndLoc
   , const std::string& codeToInsert
+  // records edit of annotation placed in header, may be null
+  , AnnotationEditRecorder* recorder
 ){
+  ScopedAllocationPhase rewritePhase(
+    AllocationPhase::kRewrite);
+
   clang::SourceManager &SM
     = rewriter.getSourceMgr();
 
@@ -278,11 +365,164 @@ static void replaceCodeAfterPos(
   clang::SourceLocation realEnd
     = nodeEndLoc.getLocWithOffset(offset);
 
-  rewriter.ReplaceText(
-    clang::SourceRange{nodeStartLoc, realEnd}, codeToInsert);
+  replaceText(
+    rewriter
+    , clang::SourceRange{nodeStartLoc, realEnd}
+    , codeToInsert
+    , recorder);
 }
 
-static void executeCodeInInterpreter(
+// unique key for (template, type of output variable)
+static std::string renderHelperHash(
+  const TemplateEngine& engine
+  , const base::StringPiece16& templateContents
+  , const std::string& sinkType
+  // makes key unique per generated file
+  , const std::string& salt = "")
+{
+  return hashToHex({
+    engine.prefix
+    , llvm::StringRef(
+      reinterpret_cast<const char*>(templateContents.data())
+      , templateContents.size() * sizeof(base::char16))
+    , sinkType
+    , salt});
+}
+
+// returns declaration placed directly into namespace
+// (or translation unit) that contains |decl|
+static const clang::Decl* getTopLevelDecl(
+  const clang::Decl* decl
+  // skip namespaces, i.e. find declaration
+  // placed directly into translation unit
+  , const bool untilTranslationUnit = false)
+{
+  DCHECK(decl);
+
+  /// \note uses lexical context to support
+  /// out-of-line definitions of class methods
+  const clang::DeclContext* declContext
+    = decl->getLexicalDeclContext();
+  while(declContext
+        && (untilTranslationUnit
+            ? !declContext->isTranslationUnit()
+            : !declContext->isFileContext()))
+  {
+    decl = clang::Decl::castFromDeclContext(declContext);
+    declContext = declContext->getLexicalParent();
+  }
+
+  // code must be inserted before `template<...>`
+  if(const clang::FunctionDecl* functionDecl
+       = llvm::dyn_cast<clang::FunctionDecl>(decl))
+  {
+    if(const clang::FunctionTemplateDecl* templateDecl
+         = functionDecl->getDescribedFunctionTemplate())
+    {
+      return templateDecl;
+    }
+  }
+  else if(const clang::CXXRecordDecl* recordDecl
+            = llvm::dyn_cast<clang::CXXRecordDecl>(decl))
+  {
+    if(const clang::ClassTemplateDecl* templateDecl
+         = recordDecl->getDescribedClassTemplate())
+    {
+      return templateDecl;
+    }
+  }
+
+  return decl;
+}
+
+// name of type of output variable in signature of generated function
+// placed at global scope: canonical type is printed with namespaces
+// (`ns::Buf` instead of `Buf` written inside of `ns`)
+static std::string sinkTypeName(
+  const clang::QualType& type
+  , const clang::LangOptions& langOptions)
+{
+  clang::PrintingPolicy policy{langOptions};
+  // `std::__cxx11` and anonymous namespaces are not written
+  policy.SuppressUnwrittenScope = true;
+  return type.getCanonicalType().getUnqualifiedType().getAsString(policy);
+}
+
+// true if |type| can be used at |loc|: its class
+// (and classes of its template arguments) is defined before |loc|
+// and not inside of function
+static bool isTypeDefinedBefore(
+  const clang::QualType& type
+  , clang::SourceLocation loc
+  , const clang::SourceManager& SM)
+{
+  if(type.isNull()) {
+    return false;
+  }
+
+  const clang::QualType canonicalType = type.getCanonicalType();
+  if(canonicalType->isPointerType() || canonicalType->isReferenceType()) {
+    return isTypeDefinedBefore(canonicalType->getPointeeType(), loc, SM);
+  }
+
+  const clang::TagDecl* tagDecl = canonicalType->getAsTagDecl();
+  if(!tagDecl) {
+    return canonicalType->isBuiltinType();
+  }
+
+  const clang::TagDecl* definition = tagDecl->getDefinition();
+  if(!definition || definition->getParentFunctionOrMethod()) {
+    return false;
+  }
+
+  const clang::Decl* definitionSource = definition;
+  if(const clang::ClassTemplateSpecializationDecl* specialization
+       = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(
+           definition))
+  {
+    // implicit instantiation is defined by its template
+    if(!specialization->isExplicitSpecialization()) {
+      definitionSource = specialization->getSpecializedTemplate();
+    }
+    for(const clang::TemplateArgument& arg
+        : specialization->getTemplateArgs().asArray())
+    {
+      if(arg.getKind() == clang::TemplateArgument::Type
+         && !isTypeDefinedBefore(arg.getAsType(), loc, SM))
+      {
+        return false;
+      }
+    }
+  }
+
+  return SM.isBeforeInTranslationUnit(
+    SM.getExpansionLoc(definitionSource->getLocation())
+    , loc);
+}
+
+// numbers functions of |perfMapDeclarations|,
+// guarded by Cling lock (worker process numbers own copy)
+static size_t perfMapFunctionCount = 0;
+
+// wraps |body| into |functionName| and declares
+// `<functionName>_range()` that returns end of its machine code:
+// CodeGen emits deferred functions (like lambdas of annotation
+// and new template instantiations) depth-first after top-level
+// functions of transaction, so inline marker referenced
+// from last top-level function is placed after code of annotation
+static std::string perfMapDeclarations(
+  const std::string& functionName
+  , const std::string& body)
+{
+  return base::StrCat({
+    "auto ", functionName, "(){", body, "}\n"
+    "inline void ", functionName, "_end(){}\n"
+    "void* ", functionName, "_range(){"
+      "return reinterpret_cast<void*>(&", functionName, "_end);}\n"});
+}
+
+// returns false if code can not be compiled
+static bool executeCodeInInterpreter(
   ::cling_utils::ClingInterpreter* clingInterpreter_
   // for debug
   , const std::string& processedAnnotation
@@ -290,19 +530,26 @@ static void executeCodeInInterpreter(
   , const clang_utils::MatchResult& matchResult
   , clang::Rewriter& rewriter
   , const clang::Decl* nodeDecl
-  , const base::StringPiece16& codeToExecute
+  // UTF-8
+  , const base::StringPiece& codeToExecute
+  // passed as |kClingOutputName|, owned by caller
+  , std::string* output
   , cling::Value& result
   , const std::string& extraVariables = ""
+  // see |SquaretsSettings::clingPerfMap|
+  , bool writePerfMap = false
 ){
+  DCHECK(output);
+
+  ScopedAllocationPhase preludePhase(
+    AllocationPhase::kPrelude);
+
   std::ostringstream sstr;
   // populate variables that can be used by interpreted code:
   //   clangMatchResult, clangRewriter, clangDecl
   ///
   /// \todo convert multiple variables to single struct or tuple
   {
-    // scope begin
-    sstr << "[](){";
-
     sstr << "clang::AnnotateAttr*"
             " clangAnnotateAttr = ";
     sstr << cling_utils::passCppPointerIntoInterpreter(
@@ -332,24 +579,85 @@ static void executeCodeInInterpreter(
       , "(const clang::Decl*)");
     sstr << ";";
 
+    sstr << "std::string* "
+         << kClingOutputName
+         << " = ";
+    sstr << cling_utils::passCppPointerIntoInterpreter(
+      reinterpret_cast<void*>(output)
+      , "(std::string*)");
+    sstr << ";";
+
     sstr << extraVariables;
 
     // vars end
     sstr << "return ";
     sstr << codeToExecute << ";";
+  }
+
+  std::string code;
 
-    // scope end
-    sstr << "}();";
+  // start and end of machine code of annotation,
+  // written by interpreted code
+  void* perfMapRange[2] = {nullptr, nullptr};
+
+  std::string perfMapFunction;
+
+  if(writePerfMap) {
+    perfMapFunction = base::StrCat({
+      kPerfMapFunctionPrefix
+      , base::NumberToString(++perfMapFunctionCount)});
+
+    const std::string declarations
+      = perfMapDeclarations(perfMapFunction, sstr.str());
+
+    VLOG(9)
+      << "(squarets) declaring code: "
+      << declarations;
+
+    ScopedAllocationPhase interpretPhase(
+      AllocationPhase::kInterpret);
+
+    cling::Value declarationResult;
+    if(clingInterpreter_->processCodeWithResult(
+         declarations, declarationResult)
+       != cling::Interpreter::Interpreter::kSuccess)
+    {
+      LOG(ERROR)
+        << "ERROR while running cling code:"
+        << codeToExecute.substr(0, 10000)
+        << " from annotation:"
+        << processedAnnotation.substr(0, 10000)
+        << "...";
+      return false;
+    }
+
+    code = base::StrCat({
+      "[](){"
+      , "*"
+      , cling_utils::passCppPointerIntoInterpreter(
+          reinterpret_cast<void*>(&perfMapRange[0]), "(void**)")
+      , " = reinterpret_cast<void*>(&", perfMapFunction, ");"
+      , "*"
+      , cling_utils::passCppPointerIntoInterpreter(
+          reinterpret_cast<void*>(&perfMapRange[1]), "(void**)")
+      , " = ", perfMapFunction, "_range();"
+      , "return ", perfMapFunction, "();"
+      , "}();"});
+  } else {
+    code = base::StrCat({"[](){", sstr.str(), "}();"});
   }
 
   VLOG(9)
     << "(squarets) executing code: "
-    << sstr.str();
+    << code;
 
   {
+    ScopedAllocationPhase interpretPhase(
+      AllocationPhase::kInterpret);
+
     cling::Interpreter::CompilationResult compilationResult
       = clingInterpreter_->processCodeWithResult(
-          sstr.str(), result);
+          code, result);
     if(compilationResult
        != cling::Interpreter::Interpreter::kSuccess)
     {
@@ -359,18 +667,345 @@ static void executeCodeInInterpreter(
         << " from annotation:"
         << processedAnnotation.substr(0, 10000)
         << "...";
+      return false;
+    }
+  }
+
+  if(writePerfMap) {
+    const clang::SourceManager& SM = rewriter.getSourceMgr();
+    const std::string location
+      = SM.getExpansionLoc(annotateAttr->getLocation()).printToString(SM);
+    const uintptr_t start
+      = reinterpret_cast<uintptr_t>(perfMapRange[0]);
+    const uintptr_t end
+      = reinterpret_cast<uintptr_t>(perfMapRange[1]);
+    if(start && end > start && end - start <= kMaxPerfMapEntrySize) {
+      PerfMap::AddEntry(
+        start
+        , end - start
+        , base::StrCat({"squarets ", location}));
+    } else {
+      VLOG(1)
+        << "(squarets) unable to find machine code of "
+        << perfMapFunction
+        << " for annotation at "
+        << location;
     }
   }
+
+  return true;
+}
+
+// returns |recordType| as class template specialization
+// named |qualifiedName| (like `llvm::Optional`) or nullptr
+static const clang::ClassTemplateSpecializationDecl* asSpecialization(
+  const clang::QualType& recordType
+  , const base::StringPiece& qualifiedName)
+{
+  const clang::CXXRecordDecl* record
+    = recordType.getCanonicalType()->getAsCXXRecordDecl();
+  const clang::ClassTemplateSpecializationDecl* specialization
+    = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+        record);
+  if(!specialization
+     || specialization->getQualifiedNameAsString() != qualifiedName)
+  {
+    return nullptr;
+  }
+  return specialization;
+}
+
+// true if |type| is `llvm::Optional<std::string>*`
+static bool isOptionalStringPointer(
+  const clang::QualType& type)
+{
+  if(type.isNull() || !type->isPointerType()) {
+    return false;
+  }
+
+  const clang::ClassTemplateSpecializationDecl* optional
+    = asSpecialization(type->getPointeeType(), "llvm::Optional");
+  if(!optional || optional->getTemplateArgs().size() != 1) {
+    return false;
+  }
+
+  const clang::TemplateArgument& valueArg
+    = optional->getTemplateArgs()[0];
+  if(valueArg.getKind() != clang::TemplateArgument::Type) {
+    return false;
+  }
+
+  // `std::string` is `std::basic_string<char, ...>`
+  // (inline namespace like `std::__cxx11` is not printed)
+  const clang::ClassTemplateSpecializationDecl* string
+    = asSpecialization(valueArg.getAsType(), "std::basic_string");
+  if(!string || string->getTemplateArgs().size() == 0) {
+    return false;
+  }
+  const clang::TemplateArgument& charArg
+    = string->getTemplateArgs()[0];
+  if(charArg.getKind() != clang::TemplateArgument::Type) {
+    return false;
+  }
+  const clang::QualType charType
+    = charArg.getAsType().getCanonicalType();
+  return charType->isSpecificBuiltinType(clang::BuiltinType::Char_S)
+    || charType->isSpecificBuiltinType(clang::BuiltinType::Char_U);
+}
+
+// moves result of interpreted code into |output|,
+// returns false if code returned empty `llvm::Optional`.
+// Interpreted code may write result into |kClingOutputName|
+// (no allocation or copy on host side)
+// or return `new llvm::Optional<std::string>` (deprecated)
+/// \note code that finished without value provided |output|,
+/// even if it is empty (empty result removes declaration)
+static bool takeInterpreterResult(
+  cling::Value& result
+  , std::string* output)
+{
+  DCHECK(output);
+
+  if(!result.hasValue() || !result.isValid() || result.isVoid()) {
+    return true;
+  }
+
+  // value of other type must not be deleted as
+  // `llvm::Optional<std::string>`
+  if(!isOptionalStringPointer(result.getType())) {
+    LOG(WARNING)
+      << "(squarets) ignored value of type "
+      << result.getType().getAsString()
+      << " returned by interpreted code, expected "
+         "`llvm::Optional<std::string>*` or result written into "
+      << kClingOutputName;
+    return true;
+  }
+
+  /// \note deletes value allocated by interpreted code
+  std::unique_ptr<llvm::Optional<std::string>> resOption{
+    static_cast<llvm::Optional<std::string>*>(
+      result.getAs<void*>())};
+  if(!resOption || !resOption->hasValue()) {
+    return false;
+  }
+
+  DLOG(WARNING)
+    << "(squarets) returning llvm::Optional from interpreted code"
+       " is deprecated, write result into "
+    << kClingOutputName;
+
+  *output = std::move(resOption->getValue());
+  return true;
+}
+
+// hash of all files changed by |rewriter|,
+// so edits made by interpreted code are detected
+static size_t rewriterFingerprint(
+  const clang::Rewriter& rewriter)
+{
+  llvm::hash_code hash = llvm::hash_value(0);
+  for(auto it = rewriter.buffer_begin()
+      ; it != rewriter.buffer_end()
+      ; ++it)
+  {
+    hash = llvm::hash_combine(
+      hash
+      , it->first.getHashValue()
+      , llvm::hash_combine_range(it->second.begin(), it->second.end()));
+  }
+  return hash;
+}
+
+// runs in worker process (see |ForkedWorkers|),
+// pointers refer to snapshot of host process
+/// \note edits made via `clangRewriter` can not be sent back,
+/// so annotation that makes them fails
+static WorkerStatus executeCodeInWorker(
+  ::cling_utils::ClingInterpreter* clingInterpreter
+  , const std::string* processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult* matchResult
+  , clang::Rewriter* rewriter
+  , const clang::Decl* nodeDecl
+  , base::StringPiece codeToExecute
+  , const std::string* extraVariables
+  , bool writePerfMap
+  , std::string* output)
+{
+  cling::Value result;
+
+  const size_t rewriterBefore = rewriterFingerprint(*rewriter);
+
+  const bool isCompiled
+    = executeCodeInInterpreter(
+        clingInterpreter
+        , *processedAnnotation // for debug
+        , annotateAttr
+        , *matchResult
+        , *rewriter
+        , nodeDecl
+        , codeToExecute
+        , output
+        , result
+        , *extraVariables
+        , writePerfMap
+      );
+  if(!isCompiled) {
+    return WorkerStatus::kFailed;
+  }
+
+  if(rewriterFingerprint(*rewriter) != rewriterBefore) {
+    LOG(ERROR)
+      << "(squarets) code of annotation changed source via"
+         " clangRewriter, edits of worker process are lost"
+         " (set cling_workers=0 to use clangRewriter): "
+      << processedAnnotation->substr(0, 1000);
+    return WorkerStatus::kFailed;
+  }
+
+  return takeInterpreterResult(result, output)
+    ? WorkerStatus::kOk
+    : WorkerStatus::kNoResult;
+}
+
+// signature of functions built by |AotRenderCache|,
+// arguments are variables available to interpreted code
+using AotRenderFunction = void (*)(
+  clang::AnnotateAttr* clangAnnotateAttr
+  , const clang_utils::MatchResult& clangMatchResult
+  , clang::Rewriter& clangRewriter
+  , const clang::Decl* clangDecl
+  , std::string* squaretsOutput
+  , const reflection::ClassInfo* classInfoPtr);
+
+// source of shared library that defines |functionName|
+// of type |AotRenderFunction|
+static std::string aotRenderSource(
+  const std::string& prelude
+  , const std::string& functionName
+  , const base::StringPiece& codeToExecute)
+{
+  return base::StrCat({
+    prelude
+    , "\nextern \"C\" __attribute__((visibility(\"default\"))) void "
+    , functionName
+    , "(\n"
+      "  clang::AnnotateAttr* clangAnnotateAttr\n"
+      "  , const clang::ast_matchers::MatchFinder::MatchResult&"
+      " clangMatchResult\n"
+      "  , clang::Rewriter& clangRewriter\n"
+      "  , const clang::Decl* clangDecl\n"
+      "  , std::string* "
+    , kClingOutputName
+    , "\n"
+      "  , const reflection::ClassInfo* classInfoPtr)\n"
+      "{\n"
+      "  (void)clangAnnotateAttr;\n"
+      "  (void)clangMatchResult;\n"
+      "  (void)clangRewriter;\n"
+      "  (void)clangDecl;\n"
+      "  (void)classInfoPtr;\n"
+    , codeToExecute
+    , "\n}\n"});
+}
+
+// compiler and flags used by |AotRenderCache|,
+// include paths and macros are same as in interpreter
+static std::vector<std::string> aotCompileCommand(
+  const clang::CompilerInstance& compilerInstance
+  , const SquaretsSettings& settings)
+{
+  std::vector<std::string> command{settings.aotCompiler};
+
+  for(std::string& flag
+      : base::SplitString(settings.aotFlags
+          , base::kWhitespaceASCII
+          , base::TRIM_WHITESPACE
+          , base::SPLIT_WANT_NONEMPTY))
+  {
+    command.push_back(std::move(flag));
+  }
+
+  for(const clang::HeaderSearchOptions::Entry& entry
+      : compilerInstance.getHeaderSearchOpts().UserEntries)
+  {
+    if(entry.Group == clang::frontend::Angled
+       || entry.Group == clang::frontend::Quoted)
+    {
+      command.push_back("-I" + entry.Path);
+    } else if(entry.Group == clang::frontend::System) {
+      command.push_back("-isystem" + entry.Path);
+    }
+    // headers of standard library are found by compiler itself
+  }
+
+  for(const std::pair<std::string, bool>& macro
+      : compilerInstance.getPreprocessorOpts().Macros)
+  {
+    command.push_back(
+      (macro.second ? "-U" : "-D") + macro.first);
+  }
+
+  return command;
+}
+
+// interpreter used by |clingInterpreter|,
+// interpreted code can access own interpreter via `gCling`
+static cling::Interpreter* findClingInterpreter(
+  ::cling_utils::ClingInterpreter* clingInterpreter)
+{
+  DCHECK(clingInterpreter);
+
+  cling::Value result;
+  cling::Interpreter::CompilationResult compilationResult
+    = clingInterpreter->processCodeWithResult(
+        "(void*)cling::runtime::gCling", result);
+  if(compilationResult
+     != cling::Interpreter::Interpreter::kSuccess
+     || !result.isValid())
+  {
+    LOG(WARNING)
+      << "(squarets) unable to find Cling interpreter,"
+         " transactions will not be unloaded";
+    return nullptr;
+  }
+  return static_cast<cling::Interpreter*>(result.getAs<void*>());
+}
+
+// number of transactions added after |lastTransaction|,
+// counts all transactions if |lastTransaction| is null
+static size_t countTransactionsAfter(
+  const cling::Interpreter& interpreter
+  , const cling::Transaction* lastTransaction)
+{
+  size_t count = 0;
+  for(const cling::Transaction* transaction
+        = lastTransaction
+          ? lastTransaction->getNext()
+          : interpreter.getFirstTransaction()
+      ; transaction
+      ; transaction = transaction->getNext())
+  {
+    count++;
+  }
+  return count;
 }
 
 } // namespace
 
 SquaretsTooling::SquaretsTooling(
   const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+  , const SquaretsSettings& settings
 #if defined(CLING_IS_ON)
   , ::cling_utils::ClingInterpreter* clingInterpreter
 #endif // CLING_IS_ON
-) : clingInterpreter_(clingInterpreter)
+) : settings_(settings)
+  , stats_(
+      base::TimeDelta::FromMilliseconds(settings.annotationBudgetMs)
+      , settings.annotationBudgetStrict
+      , settings.allocationProfiling)
+  , clingInterpreter_(clingInterpreter)
 {
   DCHECK(clingInterpreter_);
 
@@ -382,11 +1017,701 @@ SquaretsTooling::SquaretsTooling(
 
   sourceTransformRules_
     = &sourceTransformPipeline.sourceTransformRules;
+
+  const base::FilePath pureCacheDir
+    = settings_.pureCacheDir.empty()
+      ? defaultPureCacheDir()
+      : base::FilePath{settings_.pureCacheDir};
+  if(pureCacheDir.empty()) {
+    LOG(WARNING)
+      << "(squarets) results of PURE annotations will not be cached,"
+         " set pure_cache_dir";
+  } else {
+    pureResultCache_
+      = std::make_unique<PureResultCache>(pureCacheDir);
+  }
+
+#if defined(CLING_IS_ON)
+  if(settings_.clingWorkers > 0) {
+    if(settings_.prefetchThreads > 0) {
+      // threads of prefetcher run while code is executed
+      LOG(WARNING)
+        << "(squarets) cling_workers is ignored with prefetch_threads,"
+           " code of annotations is executed by flextool process";
+    } else if(ForkedWorkers::IsSupported()) {
+      clingWorkers_ = std::make_unique<ForkedWorkers>(
+        static_cast<size_t>(settings_.clingWorkers)
+        , static_cast<size_t>(settings_.clingWorkerMemoryMb) * kMB
+        , base::TimeDelta::FromMilliseconds(
+            settings_.clingWorkerTimeoutMs));
+    } else {
+      LOG(WARNING)
+        << "(squarets) worker processes are not supported"
+           " on this platform, code of annotations"
+           " is executed by flextool process";
+    }
+  }
+
+  if(!settings_.aotCacheDir.empty()) {
+    aotRenderCache_ = std::make_unique<AotRenderCache>(
+      base::FilePath{settings_.aotCacheDir});
+    aotPrelude_ = kAotPrelude;
+    if(!settings_.aotPrelude.empty()) {
+      aotPrelude_ += base::StrCat({
+        "#include \"", settings_.aotPrelude, "\"\n"});
+    }
+  }
+#endif // CLING_IS_ON
+
+  if(settings_.serverMode) {
+    templateCache_
+      = std::make_unique<TemplateCache>(
+          static_cast<size_t>(settings_.serverCacheMb) * 1024 * 1024);
+  }
+
+  if(settings_.headerAnnotationCache) {
+    if(settings_.outOfLineDir.empty()) {
+      headerAnnotationCache_
+        = std::make_unique<HeaderAnnotationCache>(
+            kMaxCachedHeaderAnnotations);
+    } else {
+      LOG(WARNING)
+        << "(squarets) header_annotation_cache"
+           " is ignored with out_of_line_dir";
+    }
+  }
+
+  if(!settings_.templateSearchPaths.empty()) {
+    std::vector<base::FilePath> roots;
+    for(const std::string& root : settings_.templateSearchPaths) {
+      roots.push_back(base::MakeAbsoluteFilePath(base::FilePath{root}));
+      if(roots.back().empty()) {
+        LOG(WARNING)
+          << "(squarets) ignored template_search_path: "
+          << root;
+        roots.pop_back();
+      }
+    }
+    templateSearchIndex_
+      = std::make_unique<TemplateSearchIndex>(std::move(roots));
+  }
 }
 
 SquaretsTooling::~SquaretsTooling()
 {
   DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  FinishRun();
+
+#if defined(CLING_IS_ON)
+  // see |SquaretsSettings::aotDeferredBuild|
+  if(aotRenderCache_ && settings_.aotDeferredBuild) {
+    aotRenderCache_->BuildPending(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()));
+  }
+#endif // CLING_IS_ON
+}
+
+void SquaretsTooling::BeginRun(
+  const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+#if defined(CLING_IS_ON)
+  , ::cling_utils::ClingInterpreter* clingInterpreter
+#endif // CLING_IS_ON
+)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::BeginRun");
+
+  // previous run may be not finished by `/squarets_flush`
+  FinishRun();
+
+  // templates may be added or removed between runs
+  if(templateSearchIndex_) {
+    templateSearchIndex_->Invalidate();
+  }
+
+  DCHECK(event.sourceTransformPipeline);
+  sourceTransformRules_
+    = &event.sourceTransformPipeline->sourceTransformRules;
+
+#if defined(CLING_IS_ON)
+  DCHECK(clingInterpreter);
+  clingInterpreter_ = clingInterpreter;
+  {
+    base::AutoLock clingLock(clingLock_);
+    // found again if interpreter changed
+    clingInterpreterImpl_ = nullptr;
+  }
+  isWorkersWarningLogged_ = false;
+#endif // CLING_IS_ON
+}
+
+void SquaretsTooling::FinishRun()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  writeOutOfLineFiles();
+
+  // same translation unit may be processed again,
+  // also waits for threads of prefetchers
+  translationUnits_.Clear();
+
+#if defined(CLING_IS_ON)
+  // libraries are used by next runs
+  if(aotRenderCache_ && !settings_.aotDeferredBuild) {
+    aotRenderCache_->BuildPending(
+      static_cast<size_t>(base::SysInfo::NumberOfProcessors()));
+  }
+#endif // CLING_IS_ON
+
+  stats_.ReportSlowest(
+    static_cast<size_t>(std::max(0, settings_.slowAnnotationsReport)));
+  stats_.ReportAllocations(
+    static_cast<size_t>(std::max(0, settings_.slowAnnotationsReport)));
+  stats_.ReportInterpreterMemory();
+  stats_.ReportDecompression();
+  stats_.Clear();
+
+  // edits may refer to functions
+  // or files generated by finished run
+  if(headerAnnotationCache_) {
+    headerAnnotationCache_->ReportStatus();
+    headerAnnotationCache_->Clear();
+  }
+}
+
+bool SquaretsTooling::KeepsCaches() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  return templateCache_ != nullptr;
+}
+
+void SquaretsTooling::RegisterTemplateEngine(
+  const std::string& prefix
+  , TemplateEngineCallback generate)
+{
+  templateEngines_.Register(prefix, std::move(generate));
+
+  // code generated by replaced engine must not be reused
+  if(templateCache_) {
+    templateCache_->ClearGenerated();
+  }
+}
+
+void SquaretsTooling::ReportStatus() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!templateCache_) {
+    LOG(INFO)
+      << "(squarets) server mode disabled, caches are not kept";
+    return;
+  }
+
+  templateCache_->ReportStatus();
+}
+
+#if defined(CLING_IS_ON)
+cling::Interpreter* SquaretsTooling::findClingInterpreterIfRequired()
+{
+  clingLock_.AssertAcquired();
+
+  if(clingInterpreterImpl_) {
+    return clingInterpreterImpl_;
+  }
+
+  clingInterpreterImpl_ = findClingInterpreter(clingInterpreter_);
+
+  if(clingInterpreterImpl_
+     && aotRenderCache_
+     && !aotRenderCache_->IsConfigured())
+  {
+    const clang::CompilerInstance& compilerInstance
+      = *clingInterpreterImpl_->getCI();
+
+    std::string preludeContents;
+    if(!settings_.aotPrelude.empty()
+       && !base::ReadFileToString(
+            base::FilePath{settings_.aotPrelude}, &preludeContents))
+    {
+      LOG(WARNING)
+        << "(squarets) unable to read aot_prelude: "
+        << settings_.aotPrelude;
+    }
+
+    // libraries must be rebuilt if interpreter,
+    // its target or headers included by prelude changed
+    aotRenderCache_->Configure(
+      aotCompileCommand(compilerInstance, settings_)
+      , base::StrCat({
+          clang::getClangFullVersion()
+          , "\n"
+          , compilerInstance.getTargetOpts().Triple
+          , "\n"
+          , aotPrelude_
+          , "\n"
+          , preludeContents}));
+  }
+
+  return clingInterpreterImpl_;
+}
+
+const cling::Transaction* SquaretsTooling::beginClingExecution()
+{
+  clingLock_.AssertAcquired();
+
+  if(!findClingInterpreterIfRequired()) {
+    return nullptr;
+  }
+
+  return clingInterpreterImpl_->getLastTransaction();
+}
+
+void SquaretsTooling::finishClingExecution(
+  const cling::Transaction* lastTransaction)
+{
+  clingLock_.AssertAcquired();
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::finishClingExecution");
+
+  if(!clingInterpreterImpl_) {
+    return;
+  }
+
+  size_t unloadedTransactions = 0;
+  if(settings_.clingUnloadTransactions) {
+    // lambda of annotation and its template instantiations
+    unloadedTransactions
+      = countTransactionsAfter(*clingInterpreterImpl_, lastTransaction);
+    if(unloadedTransactions) {
+      clingInterpreterImpl_->unload(
+        static_cast<unsigned>(unloadedTransactions));
+    }
+  }
+
+  const clang::ASTContext& astContext
+    = clingInterpreterImpl_->getCI()->getASTContext();
+  stats_.AddInterpreterSample(
+    SquaretsStats::HeapBytesInUse()
+    , astContext.getASTAllocatedMemory()
+      + astContext.getSideTableAllocatedMemory()
+    , countTransactionsAfter(*clingInterpreterImpl_, nullptr)
+    , unloadedTransactions);
+}
+
+bool SquaretsTooling::executeAnnotationCode(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , const base::StringPiece& codeToExecute
+  , const std::string& extraVariables
+  , std::string* output
+  , bool* hasResult)
+{
+  DCHECK(output);
+  DCHECK(hasResult);
+
+  *hasResult = false;
+
+  // other thread may hold lock inherited by forked process
+  const bool isSingleThreaded
+    = translationUnits_.threadCount() <= 1;
+  if(clingWorkers_
+     && !isSingleThreaded
+     && !isWorkersWarningLogged_.exchange(true))
+  {
+    LOG(WARNING)
+      << "(squarets) translation units are processed"
+         " by several threads, cling_workers is not used"
+         " until next run";
+  }
+
+  if(clingWorkers_ && isSingleThreaded) {
+    ScopedAnnotationPhase interpretPhase(
+      &stats_, AnnotationPhase::kInterpret);
+    ScopedAllocationPhase interpretAllocations(
+      AllocationPhase::kInterpret);
+
+    // interpreter is locked only while worker is forked,
+    // so code of annotations is compiled in parallel
+    // and interpreter of current process stays unchanged
+    const WorkerStatus status
+      = clingWorkers_->Run(
+          &clingLock_
+          , base::BindOnce(
+              &executeCodeInWorker
+              , clingInterpreter_
+              , &processedAnnotation
+              , annotateAttr
+              , &matchResult
+              , &rewriter
+              , nodeDecl
+              , codeToExecute
+              , &extraVariables
+              , settings_.clingPerfMap)
+          , output);
+
+    *hasResult = status == WorkerStatus::kOk;
+    return status == WorkerStatus::kOk
+      || status == WorkerStatus::kNoResult;
+  }
+
+  cling::Value result;
+
+  bool isCompiled = false;
+  {
+    // Cling is not thread-safe
+    base::AutoLock clingLock(clingLock_);
+
+    const cling::Transaction* lastTransaction
+      = beginClingExecution();
+
+    {
+      ScopedAnnotationPhase interpretPhase(
+        &stats_, AnnotationPhase::kInterpret);
+      ScopedAllocationPhase interpretAllocations(
+        AllocationPhase::kInterpret);
+
+      isCompiled
+        = executeCodeInInterpreter(
+            clingInterpreter_
+            , processedAnnotation // for debug
+            , annotateAttr
+            , matchResult
+            , rewriter
+            , nodeDecl
+            , codeToExecute
+            , output
+            , result
+            , extraVariables
+            , settings_.clingPerfMap
+          );
+    }
+
+    // result must be captured before code is unloaded
+    *hasResult
+      = isCompiled
+        && takeInterpreterResult(result, output);
+    result = cling::Value();
+
+    finishClingExecution(lastTransaction);
+  }
+
+  return isCompiled;
+}
+#endif // CLING_IS_ON
+
+base::FilePath SquaretsTooling::resolveTemplatePath(
+  const base::FilePath& name
+  , bool* isIndexed)
+{
+  TemplateSearchIndex::Entry entry;
+  const bool found
+    = templateSearchIndex_
+      && templateSearchIndex_->Resolve(name, &entry);
+  if(isIndexed) {
+    *isIndexed = found;
+  }
+  return found ? entry.path : name;
+}
+
+std::string SquaretsTooling::templateOutputName(
+  const std::string& nodeName) const
+{
+  // generated functions use own output variable
+  if(!settings_.outOfLineDir.empty() || settings_.renderHelpers) {
+    return kRenderHelperOutputName;
+  }
+  return nodeName;
+}
+
+SquaretsTooling::TranslationUnitState&
+  SquaretsTooling::translationUnitState(
+    clang::SourceManager& SM
+    , bool* isNew)
+{
+  const std::string mainFile
+    = SM.getFilename(
+        SM.getLocForStartOfFile(SM.getMainFileID())).str();
+
+  return translationUnits_.Enter(
+    mainFile
+    , isNew
+    , [this, &mainFile]() {
+        std::unique_ptr<TranslationUnitState> state
+          = std::make_unique<TranslationUnitState>();
+        state->mainFile = mainFile;
+        if(settings_.prefetchThreads > 0) {
+          state->templatePrefetcher
+            = std::make_unique<TemplatePrefetcher>(
+                static_cast<size_t>(settings_.prefetchThreads)
+                , kMaxFileSizeInBytes
+                , &stats_);
+        }
+        return state;
+      });
+}
+
+void SquaretsTooling::beginTranslationUnitIfChanged(
+  const clang_utils::MatchResult& matchResult
+  , clang::SourceManager& SM)
+{
+  bool isNewTranslationUnit = false;
+  TranslationUnitState& translationUnit
+    = translationUnitState(SM, &isNewTranslationUnit);
+  if(!isNewTranslationUnit) {
+    return;
+  }
+
+  if(templateCache_) {
+    templateCache_->InvalidateChangedFiles();
+  }
+
+  if(!settings_.outOfLineDir.empty()) {
+    // companion file of translation unit is rewritten
+    // even if all out-of-line calls were removed from it,
+    // so it does not keep stale functions
+    base::AutoLock lock(outOfLineLock_);
+    outOfLineFiles_[outOfLineFilePath(translationUnit.mainFile)];
+  }
+
+  if(!translationUnit.templatePrefetcher) {
+    return;
+  }
+
+  DCHECK(matchResult.Context);
+  std::vector<PrefetchRequest> requests
+    = collectSquaretsFileAnnotations(*matchResult.Context);
+  for(PrefetchRequest& request : requests) {
+    request.first = resolveTemplatePath(request.first);
+    request.second = templateOutputName(request.second);
+  }
+
+  if(templateCache_) {
+    // unchanged files are already loaded
+    requests.erase(
+      std::remove_if(requests.begin(), requests.end()
+        , [this](const PrefetchRequest& request) {
+            return templateCache_->HasFile(request.first);
+          })
+      , requests.end());
+    for(const PrefetchRequest& request : requests) {
+      templateCache_->WatchFile(request.first);
+    }
+  }
+
+  translationUnit.templatePrefetcher->PrefetchAll(std::move(requests));
+}
+
+SquaretsTooling::ScopedHeaderAnnotation::ScopedHeaderAnnotation(
+  SquaretsTooling* tooling
+  , clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , const std::string& processedAnnotation)
+{
+  DCHECK(tooling);
+  DCHECK(nodeDecl);
+
+  if(!tooling->headerAnnotationCache_) {
+    return;
+  }
+
+  clang::SourceManager& SM
+    = rewriter.getSourceMgr();
+
+  const clang::SourceLocation annotationLoc
+    = SM.getExpansionLoc(nodeDecl->getLocStart());
+  const clang::FileID fileID
+    = SM.getFileID(annotationLoc);
+  const clang::FileEntry* fileEntry
+    = SM.getFileEntryForID(fileID);
+  // main file is not shared with other translation units
+  if(fileID == SM.getMainFileID() || !fileEntry) {
+    return;
+  }
+
+  TranslationUnitState& translationUnit
+    = tooling->translationUnitState(SM);
+
+  // header is hashed once per translation unit
+  std::string& contentHash
+    = translationUnit.fileHashes[fileID.getHashValue()];
+  if(contentHash.empty()) {
+    contentHash = hashToHex({SM.getBufferData(fileID)});
+  }
+
+  const clang::NamedDecl* namedDecl
+    = llvm::dyn_cast<clang::NamedDecl>(nodeDecl);
+
+  const std::string key
+    = HeaderAnnotationCache::MakeKey(
+        fileEntry->getName().str()
+        , contentHash
+        , SM.getFileOffset(annotationLoc)
+        , namedDecl ? namedDecl->getNameAsString() : ""
+        , processedAnnotation);
+
+  std::shared_ptr<const std::vector<AnnotationEdit>> edits
+    = tooling->headerAnnotationCache_->Find(key);
+  if(edits) {
+    ScopedAllocationPhase rewritePhase(
+      AllocationPhase::kRewrite);
+    replayEdits(
+      rewriter
+      , fileID
+      , *edits
+      , &translationUnit.renderHelpers);
+    isReplayed_ = true;
+    return;
+  }
+
+  DCHECK(!translationUnit.editRecorder)
+    << "nested annotations are not supported";
+  recorder_.fileID = fileID;
+  translationUnit.editRecorder = &recorder_;
+
+  cache_ = tooling->headerAnnotationCache_.get();
+  translationUnit_ = &translationUnit;
+  key_ = key;
+}
+
+SquaretsTooling::ScopedHeaderAnnotation::~ScopedHeaderAnnotation()
+{
+  if(!cache_) {
+    return;
+  }
+
+  DCHECK_EQ(translationUnit_->editRecorder, &recorder_);
+  translationUnit_->editRecorder = nullptr;
+
+  if(recorder_.isReplayable) {
+    cache_->Store(key_, std::move(recorder_.edits));
+  }
+}
+
+std::string SquaretsTooling::parseTemplate(
+  const TemplateEngine& engine
+  , const std::string& nodeName
+  , const base::StringPiece16& templateContents
+  , const std::string& processedAnnotation)
+{
+  ScopedAnnotationPhase parsePhase(
+    &stats_, AnnotationPhase::kParse);
+  ScopedAllocationPhase parseAllocations(
+    AllocationPhase::kParse);
+
+  std::shared_ptr<const std::string> cachedCode
+    = templateCache_
+      ? templateCache_->FindGenerated(
+          engine.prefix
+          , nodeName
+          , templateContents)
+      : nullptr;
+  if(cachedCode) {
+    return *cachedCode;
+  }
+
+  std::string generatedCode
+    = runTemplateParser(
+        engine
+        , nodeName
+        , templateContents
+        , processedAnnotation);
+
+  if(templateCache_ && !generatedCode.empty()) {
+    templateCache_->StoreGenerated(
+      engine.prefix
+      , nodeName
+      , templateContents
+      , generatedCode);
+  }
+
+  return generatedCode;
+}
+
+const std::string& SquaretsTooling::parseTemplateIfRequired(
+  const std::string* generatedCode
+  , const TemplateEngine& engine
+  , const std::string& nodeName
+  , const base::StringPiece16& templateContents
+  , const std::string& processedAnnotation
+  , std::string* parsedCode)
+{
+  DCHECK(parsedCode);
+
+  ScopedAllocationPhase parseAllocations(
+    AllocationPhase::kParse);
+
+  // text of `RAW;` is emitted as is by definition
+  const LiteralMinification minification
+    = templateEngines_.IsBuiltinRAW(engine)
+      ? LiteralMinification::kNone
+      : settings_.literalMinification;
+
+  if(settings_.emissionMode == EmissionMode::kTable
+     || minification != LiteralMinification::kNone)
+  {
+    std::string code
+      = generatedCode
+        ? emitLiterals(*generatedCode, nodeName, minification)
+        : emitLiterals(
+            parseTemplate(
+              engine
+              , nodeName
+              , templateContents
+              , processedAnnotation)
+            , nodeName
+            , minification);
+    *parsedCode = std::move(code);
+    return *parsedCode;
+  }
+
+  if(generatedCode) {
+    return *generatedCode;
+  }
+
+  *parsedCode
+    = parseTemplate(
+        engine
+        , nodeName
+        , templateContents
+        , processedAnnotation);
+  return *parsedCode;
+}
+
+std::string SquaretsTooling::emitLiterals(
+  const std::string& generatedCode
+  , const std::string& nodeName
+  , LiteralMinification minification)
+{
+  if(generatedCode.empty()) {
+    return generatedCode;
+  }
+
+  std::vector<GeneratedSegment> segments
+    = splitGeneratedCode(generatedCode, nodeName);
+
+  minifyLiterals(&segments, minification);
+
+  if(settings_.emissionMode != EmissionMode::kTable) {
+    return joinGeneratedCode(segments, nodeName);
+  }
+
+  // same for each run and translation unit (so code generated
+  // by parallel or server runs does not change), output variables
+  // in one scope have different names, so their tables do not collide
+  const std::string tableName
+    = kLiteralTablePrefix + hashToHex({nodeName, generatedCode});
+
+  return ::plugin::emitLiteralTable(
+    segments
+    , nodeName
+    , static_cast<size_t>(settings_.literalChunkSize)
+    , tableName);
 }
 
 void SquaretsTooling::interpretSquarets(
@@ -396,7 +1721,6 @@ void SquaretsTooling::interpretSquarets(
   , clang::Rewriter& rewriter
   , const clang::Decl* nodeDecl)
 {
-  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
   TRACE_EVENT0("toplevel",
                "plugin::FlexSquarets::interpretSquarets");
 
@@ -406,6 +1730,20 @@ void SquaretsTooling::interpretSquarets(
 
   DCHECK(nodeDecl);
 
+  beginTranslationUnitIfChanged(
+    matchResult, rewriter.getSourceMgr());
+
+  ScopedAnnotationRecord annotationRecord(
+    &stats_
+    , "interpretSquarets"
+    , nodeDecl->getLocStart().printToString(rewriter.getSourceMgr()));
+
+  ScopedHeaderAnnotation headerAnnotation(
+    this, rewriter, nodeDecl, processedAnnotation);
+  if(headerAnnotation.IsReplayed()) {
+    return;
+  }
+
   VLOG(9)
     << "squarets called...";
 
@@ -450,18 +1788,16 @@ void SquaretsTooling::interpretSquarets(
   DCHECK(nodeStartLoc != nodeEndLoc);
 
   base::string16 contentsUTF16
-    = base::UTF8ToUTF16(processedAnnotation);
+    = transcodeToUTF16(processedAnnotation);
 
   base::StringPiece16 clean_contents = contentsUTF16;
 
-  bool isCleaned
+  const TemplateEngine& engine
     = removeSyntaxPrefix(
         nodeStartLoc
-        , kAnnotationCXTPL
-        , base::size(kAnnotationCXTPL)
+        , templateEngines_
         , SM
         , clean_contents);
-  DCHECK(isCleaned);
 
   VLOG(9)
     << "(squarets) nodeVarDecl clean_contents: "
@@ -469,9 +1805,10 @@ void SquaretsTooling::interpretSquarets(
 
   DCHECK(!nodeName.empty());
   std::string squaretsProcessedAnnotation
-    = runTemplateParser(
+    = parseTemplate(
+        engine
         // name of output variable in generated code
-        nodeName
+        , nodeName
         // template to parse
         , clean_contents
         // initial annotation code, for logging
@@ -488,32 +1825,24 @@ void SquaretsTooling::interpretSquarets(
 
 #if defined(CLING_IS_ON)
   // execute code stored in annotation
-  cling::Value result;
-
-  std::string codeToExecute;
-
-  {
-    /// \note lambda will be returned
-    codeToExecute += "[&](){";
-
-    codeToExecute += "std::string ";
-
-    // name of output variable in generated code
-    codeToExecute += nodeName;
-
-    codeToExecute += ";";
-
-    DCHECK(!squaretsProcessedAnnotation.empty());
-    codeToExecute += squaretsProcessedAnnotation;
-
-    codeToExecute += "return new llvm::Optional<std::string>{"
-                     "std::move(";
-    codeToExecute += nodeName;
-    codeToExecute += ")"
-                     "}; ";
+  DCHECK(!squaretsProcessedAnnotation.empty());
+
+  // single allocation, generated code may take megabytes
+  const std::string codeToExecute
+    = base::StrCat({
+        "[&](){"
+        // generated code appends directly to |output|
+        , "std::string& "
+        // name of output variable in generated code
+        , nodeName
+        , " = *"
+        , kClingOutputName
+        , ";"
+        , squaretsProcessedAnnotation
+        , "}();"});
 
-    codeToExecute += "}();";
-  }
+  // filled by interpreted code
+  std::string output;
 
   std::ostringstream sstr;
 
@@ -528,12 +1857,16 @@ void SquaretsTooling::interpretSquarets(
 
   if(nodeRecordDecl)
   {
-    classInfoPtr
-      = reflector.ReflectClass(
-          nodeRecordDecl
-          , &m_namespaces
-          , false // recursive
-        );
+    {
+      ScopedAllocationPhase reflectionAllocations(
+        AllocationPhase::kReflection);
+      classInfoPtr
+        = reflector.ReflectClass(
+            nodeRecordDecl
+            , &m_namespaces
+            , false // recursive
+          );
+    }
     DCHECK(classInfoPtr);
 
     sstr << "const reflection::ClassInfo*"
@@ -547,31 +1880,67 @@ void SquaretsTooling::interpretSquarets(
   const std::string extraVarables
     = sstr.str();
 
-  base::string16 codeToExecuteUTF16
-    = base::UTF8ToUTF16(codeToExecute);
-
-  base::StringPiece16 codeToExecute16 = codeToExecuteUTF16;
+  // machine code built by previous runs
+  // (see |SquaretsSettings::aotCacheDir|)
+  std::string aotKey;
+  AotRenderFunction aotFunction = nullptr;
+  if(aotRenderCache_) {
+    {
+      base::AutoLock clingLock(clingLock_);
+      findClingInterpreterIfRequired();
+    }
+    aotKey = aotRenderCache_->KeyFor(codeToExecute);
+    if(!aotKey.empty()) {
+      aotFunction = reinterpret_cast<AotRenderFunction>(
+        aotRenderCache_->FindFunction(aotKey));
+    }
+  }
 
-  executeCodeInInterpreter(
-    clingInterpreter_
-    , processedAnnotation // for debug
-    , annotateAttr
-    , matchResult
-    , rewriter
-    , nodeDecl
-    , codeToExecute16
-    , result
-    , extraVarables
-  );
+  bool isCompiled = false;
+  bool hasResult = false;
+  if(aotFunction) {
+    ScopedAnnotationPhase interpretPhase(
+      &stats_, AnnotationPhase::kInterpret);
+    ScopedAllocationPhase interpretAllocations(
+      AllocationPhase::kInterpret);
+
+    aotFunction(
+      annotateAttr
+      , matchResult
+      , rewriter
+      , nodeDecl
+      , &output
+      , classInfoPtr.get());
+    isCompiled = true;
+    // function has no other way to report result
+    hasResult = true;
+  } else {
+    isCompiled
+      = executeAnnotationCode(
+          processedAnnotation
+          , annotateAttr
+          , matchResult
+          , rewriter
+          , nodeDecl
+          , codeToExecute
+          , extraVarables
+          , &output
+          , &hasResult);
+
+    if(isCompiled && !aotKey.empty()) {
+      aotRenderCache_->ScheduleBuild(
+        aotKey
+        , aotRenderSource(
+            aotPrelude_
+            , AotRenderCache::FunctionName(aotKey)
+            , codeToExecute));
+    }
+  }
 
-  if(result.hasValue() && result.isValid()
-        && !result.isVoid())
-  {
-    void* resOptionVoid = result.getAs<void*>();
-    auto resOption =
-    static_cast<llvm::Optional<std::string>*>(resOptionVoid);
-    if(resOption && resOption->hasValue()) {
-      DCHECK(!resOption->getValue().empty());
+  if(isCompiled) {
+    if(hasResult) {
+      /// \note |clang::Rewriter| copies text into own buffer,
+      /// so result is passed by reference
       replaceCodeAfterPos(
         processedAnnotation
         , annotateAttr
@@ -580,7 +1949,8 @@ void SquaretsTooling::interpretSquarets(
         , nodeDecl
         , nodeStartLoc
         , nodeEndLoc
-        , resOption->getValue()
+        , output
+        , translationUnitState(SM).editRecorder
       );
     } else {
       LOG(ERROR)
@@ -588,7 +1958,6 @@ void SquaretsTooling::interpretSquarets(
         << " Nothing provided";
       DCHECK(false);
     }
-    delete resOption; /// \note frees resOptionVoid memory
   } else {
     DLOG(INFO)
       << "ignored invalid "
@@ -610,12 +1979,25 @@ void SquaretsTooling::squaretsCodeAndReplace(
   , clang::Rewriter& rewriter
   , const clang::Decl* nodeDecl)
 {
-  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
   TRACE_EVENT0("toplevel",
                "plugin::FlexSquarets::process_squaretsCodeAndReplace");
 
   DCHECK(nodeDecl);
 
+  beginTranslationUnitIfChanged(
+    matchResult, rewriter.getSourceMgr());
+
+  ScopedAnnotationRecord annotationRecord(
+    &stats_
+    , "squaretsCodeAndReplace"
+    , nodeDecl->getLocStart().printToString(rewriter.getSourceMgr()));
+
+  ScopedHeaderAnnotation headerAnnotation(
+    this, rewriter, nodeDecl, processedAnnotation);
+  if(headerAnnotation.IsReplayed()) {
+    return;
+  }
+
 #if defined(CLING_IS_ON)
   DCHECK(clingInterpreter_);
 #endif // CLING_IS_ON
@@ -641,18 +2023,39 @@ void SquaretsTooling::squaretsCodeAndReplace(
   DCHECK(nodeStartLoc != nodeEndLoc);
 
   base::string16 contentsUTF16
-    = base::UTF8ToUTF16(processedAnnotation);
+    = transcodeToUTF16(processedAnnotation);
 
   base::StringPiece16 clean_contents = contentsUTF16;
 
-  bool isCleaned
+  // `PURE(input_files);` allows to cache result of executed code
+  std::vector<base::FilePath> pureInputFiles;
+  const bool isPure
+    = removePureDirective(clean_contents, &pureInputFiles);
+  if(isPure) {
+    // relative paths are relative to annotated file
+    const base::FilePath annotatedDir
+      = base::FilePath{
+          SM.getFilename(SM.getExpansionLoc(nodeStartLoc)).str()}
+        .DirName();
+    for(base::FilePath& inputFile : pureInputFiles) {
+      if(!inputFile.IsAbsolute()) {
+        inputFile = annotatedDir.Append(inputFile);
+      }
+      // resolved path is part of cache key
+      const base::FilePath absoluteInputFile
+        = base::MakeAbsoluteFilePath(inputFile);
+      if(!absoluteInputFile.empty()) {
+        inputFile = absoluteInputFile;
+      }
+    }
+  }
+
+  const TemplateEngine& engine
     = removeSyntaxPrefix(
         nodeStartLoc
-        , kAnnotationCXTPL
-        , base::size(kAnnotationCXTPL)
+        , templateEngines_
         , SM
         , clean_contents);
-  DCHECK(isCleaned);
 
   VLOG(9)
     << "(squarets) nodeVarDecl clean_contents: "
@@ -686,55 +2089,65 @@ void SquaretsTooling::squaretsCodeAndReplace(
     << "(squarets) nodeVarDecl name: "
     << nodeName;
 
+  const std::string codeToExecute
+    = transcodeToUTF8(clean_contents);
+
+  if(isPure && pureResultCache_) {
+    base::Optional<std::string> cachedResult
+      = pureResultCache_->Get(codeToExecute, pureInputFiles);
+    if(cachedResult) {
+      // Cling not required
+      insertGeneratedCode(
+        processedAnnotation
+        , annotateAttr
+        , matchResult
+        , rewriter
+        , nodeVarDecl
+        // template to parse
+        , transcodeToUTF16(cachedResult.value())
+        , engine
+      );
+      return;
+    }
+  }
+
 #if defined(CLING_IS_ON)
   // execute code stored in annotation
-  cling::Value result;
 
-  executeCodeInInterpreter(
-    clingInterpreter_
-    , processedAnnotation // for debug
-    , annotateAttr
-    , matchResult
-    , rewriter
-    , nodeDecl
-    , clean_contents // codeToExecute
-    , result
-  );
+  // filled by interpreted code
+  std::string output;
 
-  if(result.hasValue() && result.isValid()
-        && !result.isVoid())
-  {
-    void* resOptionVoid = result.getAs<void*>();
-    auto resOption =
-    static_cast<llvm::Optional<std::string>*>(resOptionVoid);
-    if(resOption && resOption->hasValue()) {
-      std::string squaretsProcessedAnnotation
-        = runTemplateParser(
-            // name of output variable in generated code
-            nodeName
-            // template to parse
-            , base::UTF8ToUTF16(resOption->getValue())
-            // initial annotation code, for logging
-            , processedAnnotation);
-
-      if(squaretsProcessedAnnotation.empty()) {
-        DCHECK(nodeStartLoc.isValid());
-        LOG(ERROR)
-          << "variable declaration with"
-             " annotation of type squarets"
-             " must be valid: "
-          << nodeStartLoc.printToString(SM);
+  bool hasResult = false;
+  const bool isCompiled
+    = executeAnnotationCode(
+        processedAnnotation
+        , annotateAttr
+        , matchResult
+        , rewriter
+        , nodeDecl
+        , codeToExecute
+        , ""
+        , &output
+        , &hasResult);
+
+  if(isCompiled) {
+    if(hasResult) {
+      if(isPure && pureResultCache_) {
+        pureResultCache_->Put(
+          codeToExecute
+          , pureInputFiles
+          , output);
       }
 
-      insertCodeAfterPos(
+      insertGeneratedCode(
         processedAnnotation
         , annotateAttr
         , matchResult
         , rewriter
-        , nodeDecl
-        , nodeStartLoc
-        , nodeEndLoc
-        , squaretsProcessedAnnotation
+        , nodeVarDecl
+        // template to parse
+        , transcodeToUTF16(output)
+        , engine
       );
     } else {
       LOG(ERROR)
@@ -742,7 +2155,6 @@ void SquaretsTooling::squaretsCodeAndReplace(
         << " Nothing provided";
       DCHECK(false);
     }
-    delete resOption; /// \note frees resOptionVoid memory
   } else {
     DLOG(INFO)
       << "ignored invalid "
@@ -764,7 +2176,6 @@ void SquaretsTooling::squaretsFile(
   , clang::Rewriter& rewriter
   , const clang::Decl* nodeDecl)
 {
-  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
   TRACE_EVENT0("toplevel",
                "plugin::FlexSquarets::squaretsFile");
 
@@ -774,6 +2185,20 @@ void SquaretsTooling::squaretsFile(
 
   DCHECK(nodeDecl);
 
+  beginTranslationUnitIfChanged(
+    matchResult, rewriter.getSourceMgr());
+
+  ScopedAnnotationRecord annotationRecord(
+    &stats_
+    , "squaretsFile"
+    , nodeDecl->getLocStart().printToString(rewriter.getSourceMgr()));
+
+  ScopedHeaderAnnotation headerAnnotation(
+    this, rewriter, nodeDecl, processedAnnotation);
+  if(headerAnnotation.IsReplayed()) {
+    return;
+  }
+
   VLOG(9)
     << "squaretsFile called...";
 
@@ -824,52 +2249,131 @@ void SquaretsTooling::squaretsFile(
   DCHECK(nodeStartLoc != nodeEndLoc);
 
   base::string16 contentsUTF16
-    = base::UTF8ToUTF16(processedAnnotation);
+    = transcodeToUTF16(processedAnnotation);
 
   base::StringPiece16 clean_contents = contentsUTF16;
 
-  bool isCleaned
+  const TemplateEngine& engine
     = removeSyntaxPrefix(
         nodeStartLoc
-        , kAnnotationCXTPL
-        , base::size(kAnnotationCXTPL)
+        , templateEngines_
         , SM
         , clean_contents);
-  DCHECK(isCleaned);
 
   VLOG(9)
     << "(squaretsFile) nodeVarDecl clean_contents: "
     << clean_contents;
 
-  base::FilePath filePath{
-    base::UTF16ToUTF8(clean_contents)};
-  if(!base::PathExists(filePath)) {
-    LOG(ERROR)
-      << "unable to find file: "
-      << filePath
-      << " see "
-      << nodeStartLoc.printToString(SM);
+  bool isIndexed = false;
+  const base::FilePath filePath
+    = resolveTemplatePath(
+        base::FilePath{transcodeToUTF8(clean_contents)}
+        , &isIndexed);
+
+  std::shared_ptr<const base::string16> cachedContents
+    = templateCache_
+      ? templateCache_->FindFile(filePath)
+      : nullptr;
+  if(cachedContents) {
+    VLOG(9)
+      << "(squaretsFile) using cached template: "
+      << filePath;
+    insertGeneratedCode(
+      processedAnnotation
+      , annotateAttr
+      , matchResult
+      , rewriter
+      , nodeVarDecl
+      // template to parse
+      , *cachedContents
+      , engine
+    );
+    return;
   }
-  else if(base::DirectoryExists(filePath)) {
-    LOG(ERROR)
-      << "expected file, not directory: "
-      << filePath
-      << " see "
-      << nodeStartLoc.printToString(SM);
+
+  TemplatePrefetcher* templatePrefetcher
+    = translationUnitState(SM).templatePrefetcher.get();
+
+  // prefetcher parses only `CXTPL;` templates
+  std::shared_ptr<const PrefetchedTemplate> prefetched
+    = templatePrefetcher && templateEngines_.IsBuiltinCXTPL(engine)
+      ? templatePrefetcher->Take(
+          PrefetchRequest{filePath, templateOutputName(nodeName)})
+      : nullptr;
+  if(prefetched
+     && prefetched->fileOk
+     && !prefetched->generatedCode.empty())
+  {
+    VLOG(9)
+      << "(squaretsFile) using prefetched template: "
+      << filePath;
+    if(templateCache_) {
+      // file is watched since start of translation unit
+      templateCache_->StoreFile(
+        filePath
+        , prefetched->contents);
+      templateCache_->StoreGenerated(
+        engine.prefix
+        , templateOutputName(nodeName)
+        , prefetched->contents
+        , prefetched->generatedCode);
+    }
+    insertGeneratedCode(
+      processedAnnotation
+      , annotateAttr
+      , matchResult
+      , rewriter
+      , nodeVarDecl
+      // template to parse
+      , prefetched->contents
+      , engine
+      , &prefetched->generatedCode
+    );
+    return;
+  }
+
+  // indexed file is known to exist
+  if(!isIndexed) {
+    if(!base::PathExists(filePath)) {
+      LOG(ERROR)
+        << "unable to find file: "
+        << filePath
+        << " see "
+        << nodeStartLoc.printToString(SM);
+    }
+    else if(base::DirectoryExists(filePath)) {
+      LOG(ERROR)
+        << "expected file, not directory: "
+        << filePath
+        << " see "
+        << nodeStartLoc.printToString(SM);
+    }
   }
 
   std::string file_contents;
 
-  // When the file size exceeds |max_size|, the
-  // function returns false with |contents|
-  // holding the file truncated to |max_size|.
-  const bool file_ok
-    = base::ReadFileToStringWithMaxSize(
-        filePath
-        , &file_contents
-        // |max_size| in bytes
-        , kMaxFileSizeInBytes
-      );
+  if(templateCache_) {
+    templateCache_->WatchFile(filePath);
+  }
+
+  bool file_ok = false;
+  {
+    ScopedAnnotationPhase readFilePhase(
+      &stats_, AnnotationPhase::kReadFile);
+    ScopedAllocationPhase readFileAllocations(
+      AllocationPhase::kReadFile);
+
+    // returns false if the file size exceeds |max_size|,
+    // `.gz` and `.zst` files are decompressed
+    file_ok
+      = readTemplateFile(
+          filePath
+          // |max_size| in bytes
+          , kMaxFileSizeInBytes
+          , &file_contents
+          , &stats_
+        );
+  }
 
   if(!file_ok)
   {
@@ -885,35 +2389,23 @@ void SquaretsTooling::squaretsFile(
   }
 
   base::string16 fileContentsUTF16
-    = base::UTF8ToUTF16(file_contents);
-
-  std::string squaretsProcessedAnnotation
-    = runTemplateParser(
-        // name of output variable in generated code
-        nodeName
-        // template to parse
-        , fileContentsUTF16
-        // initial annotation code, for logging
-        , processedAnnotation);
+    = transcodeToUTF16(file_contents);
 
-  if(squaretsProcessedAnnotation.empty()) {
-    DCHECK(nodeStartLoc.isValid());
-    LOG(ERROR)
-      << "variable declaration with"
-         " annotation of type squarets"
-         " must be valid: "
-      << nodeStartLoc.printToString(SM);
+  if(templateCache_ && file_ok) {
+    templateCache_->StoreFile(
+      filePath
+      , fileContentsUTF16);
   }
 
-  insertCodeAfterPos(
+  insertGeneratedCode(
     processedAnnotation
     , annotateAttr
     , matchResult
     , rewriter
-    , nodeDecl
-    , nodeStartLoc
-    , nodeEndLoc
-    , squaretsProcessedAnnotation
+    , nodeVarDecl
+    // template to parse
+    , fileContentsUTF16
+    , engine
   );
 }
 
@@ -924,7 +2416,6 @@ void SquaretsTooling::squarets(
   , clang::Rewriter& rewriter
   , const clang::Decl* nodeDecl)
 {
-  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
   TRACE_EVENT0("toplevel",
                "plugin::FlexSquarets::callFuncBySignature");
 
@@ -934,6 +2425,20 @@ void SquaretsTooling::squarets(
 
   DCHECK(nodeDecl);
 
+  beginTranslationUnitIfChanged(
+    matchResult, rewriter.getSourceMgr());
+
+  ScopedAnnotationRecord annotationRecord(
+    &stats_
+    , "squarets"
+    , nodeDecl->getLocStart().printToString(rewriter.getSourceMgr()));
+
+  ScopedHeaderAnnotation headerAnnotation(
+    this, rewriter, nodeDecl, processedAnnotation);
+  if(headerAnnotation.IsReplayed()) {
+    return;
+  }
+
   VLOG(9)
     << "squarets called...";
 
@@ -984,33 +2489,110 @@ void SquaretsTooling::squarets(
   DCHECK(nodeStartLoc != nodeEndLoc);
 
   base::string16 contentsUTF16
-    = base::UTF8ToUTF16(processedAnnotation);
+    = transcodeToUTF16(processedAnnotation);
 
   base::StringPiece16 clean_contents = contentsUTF16;
 
-  bool isCleaned
+  const TemplateEngine& engine
     = removeSyntaxPrefix(
         nodeStartLoc
-        , kAnnotationCXTPL
-        , base::size(kAnnotationCXTPL)
+        , templateEngines_
         , SM
         , clean_contents);
-  DCHECK(isCleaned);
 
   VLOG(9)
     << "(squarets) nodeVarDecl clean_contents: "
     << clean_contents;
 
-  std::string squaretsProcessedAnnotation
-    = runTemplateParser(
+  insertGeneratedCode(
+    processedAnnotation
+    , annotateAttr
+    , matchResult
+    , rewriter
+    , nodeVarDecl
+    // template to parse
+    , clean_contents
+    , engine
+  );
+}
+
+void SquaretsTooling::insertGeneratedCode(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::VarDecl* nodeVarDecl
+  , const base::StringPiece16& templateContents
+  , const TemplateEngine& engine
+  , const std::string* generatedCode)
+{
+  DCHECK(nodeVarDecl);
+
+  clang::SourceManager &SM
+    = rewriter.getSourceMgr();
+
+  const std::string nodeName = nodeVarDecl->getNameAsString();
+
+  DCHECK(!nodeName.empty());
+
+  clang::SourceLocation nodeStartLoc
+    = nodeVarDecl->getLocStart();
+  clang::SourceLocation nodeEndLoc
+    = nodeVarDecl->getLocEnd();
+  DCHECK(nodeStartLoc != nodeEndLoc);
+
+  if(!settings_.outOfLineDir.empty()) {
+    insertOutOfLineCall(
+      processedAnnotation
+      , annotateAttr
+      , matchResult
+      , rewriter
+      , nodeVarDecl
+      , templateContents
+      , engine
+      , nodeStartLoc
+      , nodeEndLoc
+      , generatedCode);
+    return;
+  }
+
+  if(settings_.renderHelpers) {
+    if(insertRenderHelperCall(
+         processedAnnotation
+         , annotateAttr
+         , matchResult
+         , rewriter
+         , nodeVarDecl
+         , templateContents
+         , engine
+         , nodeStartLoc
+         , nodeEndLoc
+         , generatedCode))
+    {
+      return;
+    }
+    // prefetched code appends to output variable of helper
+    generatedCode = nullptr;
+  }
+
+  DCHECK(!generatedCode || templateOutputName(nodeName) == nodeName);
+  // prefetched code is not copied
+  std::string parsedCode;
+  const std::string& squaretsProcessedAnnotation
+    = parseTemplateIfRequired(
+        generatedCode
+        , engine
         // name of output variable in generated code
-        nodeName
+        , nodeName
         // template to parse
-        , clean_contents
+        , templateContents
         // initial annotation code, for logging
-        , processedAnnotation);
+        , processedAnnotation
+        , &parsedCode);
 
-  if(squaretsProcessedAnnotation.empty()) {
+  // empty template (like empty result of
+  // `{squaretsCodeAndReplace};`) generates no code
+  if(squaretsProcessedAnnotation.empty() && !templateContents.empty()) {
     DCHECK(nodeStartLoc.isValid());
     LOG(ERROR)
       << "variable declaration with"
@@ -1024,11 +2606,398 @@ void SquaretsTooling::squarets(
     , annotateAttr
     , matchResult
     , rewriter
-    , nodeDecl
+    , nodeVarDecl
     , nodeStartLoc
     , nodeEndLoc
     , squaretsProcessedAnnotation
+    , translationUnitState(SM).editRecorder
+  );
+}
+
+void SquaretsTooling::insertOutOfLineCall(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::VarDecl* nodeVarDecl
+  , const base::StringPiece16& templateContents
+  , const TemplateEngine& engine
+  , clang::SourceLocation& nodeStartLoc
+  , clang::SourceLocation& nodeEndLoc
+  , const std::string* generatedCode)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::insertOutOfLineCall");
+
+  DCHECK(nodeVarDecl);
+  DCHECK(!settings_.outOfLineDir.empty());
+
+  clang::SourceManager &SM
+    = rewriter.getSourceMgr();
+
+  const clang::LangOptions& langOptions
+    = rewriter.getLangOpts();
+
+  TranslationUnitState& translationUnit
+    = translationUnitState(SM);
+
+  const base::FilePath outOfLinePath
+    = outOfLineFilePath(translationUnit.mainFile);
+
+  // type of output variable is part of function signature
+  const std::string sinkType
+    = sinkTypeName(nodeVarDecl->getType(), langOptions);
+
+  /// \note function name must be unique per generated file
+  /// to avoid duplicated symbols during linkage
+  const std::string functionName
+    = kOutOfLinePrefix
+      + renderHelperHash(
+          engine
+          , templateContents
+          , sinkType
+          , outOfLinePath.value());
+
+  std::string functionSignature;
+  functionSignature += "void ";
+  functionSignature += functionName;
+  functionSignature += "(";
+  functionSignature += sinkType;
+  functionSignature += "& ";
+  functionSignature += kRenderHelperOutputName;
+  functionSignature += ")";
+
+  bool isNewFunction = false;
+  {
+    base::AutoLock lock(outOfLineLock_);
+    isNewFunction
+      = outOfLineFiles_[outOfLinePath].functions.insert(
+          functionName).second;
+  }
+
+  if(isNewFunction) {
+    // prefetched code is not copied
+    std::string parsedCode;
+    const std::string& functionBody
+      = parseTemplateIfRequired(
+          generatedCode
+          , engine
+          // name of output variable in generated code
+          , kRenderHelperOutputName
+          // template to parse
+          , templateContents
+          // initial annotation code, for logging
+          , processedAnnotation
+          , &parsedCode);
+
+    if(functionBody.empty() && !templateContents.empty()) {
+      DCHECK(nodeStartLoc.isValid());
+      LOG(ERROR)
+        << "variable declaration with"
+           " annotation of type squarets"
+           " must be valid: "
+        << nodeStartLoc.printToString(SM);
+    }
+
+    // template is parsed without lock
+    base::AutoLock lock(outOfLineLock_);
+    std::string& code = outOfLineFiles_[outOfLinePath].code;
+    code += functionSignature;
+    code += " {\n";
+    code += functionBody;
+    code += "\n}\n\n";
+  }
+
+  // declaration must be placed into global namespace
+  // (generated file does not know about namespaces)
+  const clang::Decl* topLevelDecl
+    = getTopLevelDecl(nodeVarDecl
+        , true // untilTranslationUnit
+      );
+  DCHECK(topLevelDecl);
+
+  const clang::SourceLocation declarationLoc
+    = SM.getExpansionLoc(topLevelDecl->getLocStart());
+  DCHECK(declarationLoc.isValid());
+
+  const bool isNewDeclaration
+    = translationUnit.renderHelpers.emplace(
+        SM.getFileID(declarationLoc).getHashValue()
+        , functionName).second;
+
+  if(isNewDeclaration) {
+    VLOG(9)
+      << "(squarets) inserted declaration of "
+      << functionName
+      << " defined in "
+      << outOfLinePath;
+
+    ScopedAllocationPhase rewritePhase(
+      AllocationPhase::kRewrite);
+    insertRenderHelper(
+      rewriter
+      , declarationLoc
+      , functionSignature + ";\n\n"
+      , functionName
+      , translationUnit.editRecorder);
+  }
+
+  std::string callCode;
+  callCode += "\n::";
+  callCode += functionName;
+  callCode += "(";
+  callCode += nodeVarDecl->getNameAsString();
+  callCode += ");\n";
+
+  insertCodeAfterPos(
+    processedAnnotation
+    , annotateAttr
+    , matchResult
+    , rewriter
+    , nodeVarDecl
+    , nodeStartLoc
+    , nodeEndLoc
+    , callCode
+    , translationUnit.editRecorder
+  );
+}
+
+base::FilePath SquaretsTooling::outOfLineFilePath(
+  const std::string& mainFile) const
+{
+  DCHECK(!settings_.outOfLineDir.empty());
+
+  // `a/main.cc` -> `main.<hash of a/main.cc>.squarets.cc`,
+  // so files with same name from different directories
+  // do not overwrite each other
+  const base::FilePath mainFilePath{mainFile};
+  const base::FilePath absoluteMainFilePath
+    = base::MakeAbsoluteFilePath(mainFilePath);
+  return base::FilePath{settings_.outOfLineDir}.Append(
+    mainFilePath
+      .BaseName()
+      .RemoveFinalExtension()
+      .AddExtension(hashToHex({
+          absoluteMainFilePath.empty()
+            ? mainFilePath.value()
+            : absoluteMainFilePath.value()})
+            .substr(0, kOutOfLineHashLength))
+      .AddExtension(kOutOfLineExtension));
+}
+
+void SquaretsTooling::writeOutOfLineFiles()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::writeOutOfLineFiles");
+
+  base::AutoLock lock(outOfLineLock_);
+
+  if(outOfLineFiles_.empty()) {
+    return;
+  }
+
+  const base::FilePath outOfLineDir{settings_.outOfLineDir};
+  if(!base::CreateDirectory(outOfLineDir)) {
+    LOG(ERROR)
+      << "(squarets) unable to create directory: "
+      << outOfLineDir;
+    return;
+  }
+
+  for(const auto& it : outOfLineFiles_) {
+    // translation unit without out-of-line calls
+    // does not create new file
+    if(it.second.functions.empty() && !base::PathExists(it.first)) {
+      continue;
+    }
+
+    std::string contents;
+    contents += "// generated by flex_squarets_plugin, do not edit\n\n";
+    for(const std::string& include : settings_.outOfLineIncludes) {
+      contents += "#include ";
+      contents += include;
+      contents += "\n";
+    }
+    contents += "\n";
+    contents += it.second.code;
+
+    // unchanged file keeps its modification time,
+    // so build system does not recompile it
+    std::string existingContents;
+    if(base::ReadFileToString(it.first, &existingContents)
+       && existingContents == contents)
+    {
+      VLOG(9)
+        << "(squarets) generated file not changed: "
+        << it.first;
+      continue;
+    }
+
+    /// \note atomic write prevents partial file
+    /// if compiler reads it while plugin is running
+    if(!base::ImportantFileWriter::WriteFileAtomically(
+         it.first, contents))
+    {
+      LOG(ERROR)
+        << "(squarets) unable to write file: "
+        << it.first;
+      continue;
+    }
+
+    VLOG(9)
+      << "(squarets) generated file: "
+      << it.first;
+  }
+
+  outOfLineFiles_.clear();
+}
+
+bool SquaretsTooling::insertRenderHelperCall(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::VarDecl* nodeVarDecl
+  , const base::StringPiece16& templateContents
+  , const TemplateEngine& engine
+  , clang::SourceLocation& nodeStartLoc
+  , clang::SourceLocation& nodeEndLoc
+  , const std::string* generatedCode)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexSquarets::insertRenderHelperCall");
+
+  DCHECK(nodeVarDecl);
+
+  clang::SourceManager &SM
+    = rewriter.getSourceMgr();
+
+  const clang::LangOptions& langOptions
+    = rewriter.getLangOpts();
+
+  TranslationUnitState& translationUnit
+    = translationUnitState(SM);
+
+  // helper must be visible from function
+  // that contains annotated variable, so it is placed
+  // into translation unit (not into namespace of first user):
+  // users from other namespaces of same file reuse it
+  const clang::Decl* topLevelDecl
+    = getTopLevelDecl(nodeVarDecl
+        , true // untilTranslationUnit
+      );
+  DCHECK(topLevelDecl);
+
+  const clang::SourceLocation helperLoc
+    = SM.getExpansionLoc(topLevelDecl->getLocStart());
+  DCHECK(helperLoc.isValid());
+
+  // like class declared in same namespace as user of helper
+  if(!isTypeDefinedBefore(nodeVarDecl->getType(), helperLoc, SM)) {
+    VLOG(9)
+      << "(squarets) type of "
+      << nodeVarDecl->getNameAsString()
+      << " is not defined before render helper, code is inserted"
+         " into annotated variable: "
+      << helperLoc.printToString(SM);
+    return false;
+  }
+
+  // type of output variable is part of helper signature
+  const std::string sinkType
+    = sinkTypeName(nodeVarDecl->getType(), langOptions);
+
+  const std::string helperName
+    = kRenderHelperPrefix
+      + renderHelperHash(engine, templateContents, sinkType);
+
+  // header and main file of translation unit may both define helper
+  const std::string helperGuard
+    = base::ToUpperASCII(helperName);
+
+  const bool isNewHelper
+    = translationUnit.renderHelpers.emplace(
+        SM.getFileID(helperLoc).getHashValue()
+        , helperName).second;
+
+  if(isNewHelper) {
+    // prefetched code is not copied
+    std::string parsedCode;
+    const std::string& helperBody
+      = parseTemplateIfRequired(
+          generatedCode
+          , engine
+          // name of output variable in generated code
+          , kRenderHelperOutputName
+          // template to parse
+          , templateContents
+          // initial annotation code, for logging
+          , processedAnnotation
+          , &parsedCode);
+
+    if(helperBody.empty() && !templateContents.empty()) {
+      DCHECK(nodeStartLoc.isValid());
+      LOG(ERROR)
+        << "variable declaration with"
+           " annotation of type squarets"
+           " must be valid: "
+        << nodeStartLoc.printToString(SM);
+    }
+
+    std::string helperCode;
+    // declaration may start in middle of line
+    helperCode += "\n#ifndef ";
+    helperCode += helperGuard;
+    helperCode += "\n#define ";
+    helperCode += helperGuard;
+    helperCode += "\ninline void ";
+    helperCode += helperName;
+    helperCode += "(";
+    helperCode += sinkType;
+    helperCode += "& ";
+    helperCode += kRenderHelperOutputName;
+    helperCode += ") {\n";
+    helperCode += helperBody;
+    helperCode += "\n}\n#endif // ";
+    helperCode += helperGuard;
+    helperCode += "\n\n";
+
+    VLOG(9)
+      << "(squarets) inserted render helper: "
+      << helperName
+      << " at "
+      << helperLoc.printToString(SM);
+
+    ScopedAllocationPhase rewritePhase(
+      AllocationPhase::kRewrite);
+    insertRenderHelper(
+      rewriter
+      , helperLoc
+      , helperCode
+      , helperName
+      , translationUnit.editRecorder);
+  }
+
+  std::string callCode;
+  callCode += "\n";
+  callCode += helperName;
+  callCode += "(";
+  callCode += nodeVarDecl->getNameAsString();
+  callCode += ");\n";
+
+  insertCodeAfterPos(
+    processedAnnotation
+    , annotateAttr
+    , matchResult
+    , rewriter
+    , nodeVarDecl
+    , nodeStartLoc
+    , nodeEndLoc
+    , callCode
+    , translationUnit.editRecorder
   );
+  return true;
 }
 
 } // namespace plugin
@@ -1,4 +1,5 @@
 #include <flex_squarets_plugin/EventHandler.hpp>
+#include <flex_squarets_plugin/Settings.hpp>
 
 #include <flexlib/ToolPlugin.hpp>
 #include <flexlib/core/errors/errors.hpp>
@@ -45,6 +46,8 @@ class FlexSquarets
     ::plugin::AbstractManager& manager
     , const std::string& plugin)
     : ::plugin::ToolPlugin{manager, plugin}
+    , eventHandler_{
+        SquaretsSettings::FromConfiguration(configuration())}
   {
     DETACH_FROM_SEQUENCE(sequence_checker_);
   }
@@ -148,6 +151,8 @@ class FlexSquarets
     TRACE_EVENT0("toplevel",
                  "plugin::FlexSquarets::unload()");
 
+    eventHandler_.Unload();
+
     DLOG(INFO)
       << "unloaded plugin with title = "
       << title()
@@ -158,12 +163,36 @@ class FlexSquarets
     return true;
   }
 
+  // see |RegisterSquaretsTemplateEngine|
+  void RegisterTemplateEngine(
+    const std::string& prefix
+    , TemplateEngineCallback generate)
+  {
+    DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+    eventHandler_.RegisterTemplateEngine(prefix, std::move(generate));
+  }
+
 private:
-  FlexSquaretsEventHandler eventHandler_{};
+  FlexSquaretsEventHandler eventHandler_;
 
   DISALLOW_COPY_AND_ASSIGN(FlexSquarets);
 };
 
+bool RegisterSquaretsTemplateEngine(
+  ::plugin::ToolPlugin& toolPlugin
+  , const std::string& prefix
+  , TemplateEngineCallback generate)
+{
+  FlexSquarets* squaretsPlugin
+    = dynamic_cast<FlexSquarets*>(&toolPlugin);
+  if(!squaretsPlugin) {
+    return false;
+  }
+  squaretsPlugin->RegisterTemplateEngine(prefix, std::move(generate));
+  return true;
+}
+
 } // namespace plugin
 
 REGISTER_PLUGIN(/*name*/ FlexSquarets
@@ -34,6 +34,23 @@
   /* generate definition required to use __attribute__ */ \
   __attribute__((annotate("{gen};{squaretsCodeAndReplace};CXTPL;" #__VA_ARGS__)))
 
+// same as _squaretsCodeAndReplace, but code must be pure function
+// of its own text and of INPUT_FILES (comma-separated list of paths).
+// Result of executed code will be cached on disk
+// and Cling will be skipped on next runs.
+// example:
+//   _squaretsPureCodeAndReplace("data/a.txt,data/b.txt", ...)
+#define _squaretsPureCodeAndReplace(INPUT_FILES, ...) \
+  /* generate definition required to use __attribute__ */ \
+  __attribute__((annotate("{gen};{squaretsCodeAndReplace};PURE(" INPUT_FILES ");CXTPL;" #__VA_ARGS__)))
+
+// text without template tags,
+// appended as is (template is not parsed)
+// example:
+//   _squaretsRaw("[[+ not a tag +]]")
+#define _squaretsRaw(...) \
+  __attribute__((annotate("{gen};{squarets};RAW;" __VA_ARGS__)))
+
 static void somefunc()
 {
   {
@@ -86,7 +103,7 @@ static void somefunc()
     /// to return template code combined from multiple std::string
     /// at compile-time
     _squaretsCodeAndReplace(
-      [&clangMatchResult, &clangRewriter, &clangDecl]() {
+      [&clangMatchResult, &clangRewriter, &clangDecl, squaretsOutput]() {
         std::string a = R"raw(int g = 123;)raw";
         std::string b = R"raw(int s = 354;)raw";
         std::string c =
@@ -100,14 +117,54 @@ static void somefunc()
         // or download template from network, etc.
         // ...
 
+        // result is written into string owned by plugin
+        *squaretsOutput = a + b + c;
+      }();
+    )
+    std::string out{""};
+  }
+
+  {
+    // empty result is valid,
+    // annotated variable is replaced by nothing
+    _squaretsCodeAndReplace(
+      [squaretsOutput]() {
+        squaretsOutput->clear();
+      }();
+    )
+    std::string out{""};
+  }
+
+  {
+    // same as _squaretsCodeAndReplace,
+    // but result will be cached between runs
+    /// \note code does not depend on any file
+    /// \note returning `new llvm::Optional<std::string>`
+    /// instead of writing into `squaretsOutput` is deprecated
+    _squaretsPureCodeAndReplace(
+      "",
+      [&clangMatchResult, &clangRewriter, &clangDecl]() {
+        std::string a = R"raw(int g = 123;)raw";
+        std::string b = R"raw(int s = 354;)raw";
+
         return new llvm::Optional<std::string>{
-          a + b + c
+          a + b
         };
       }();
     )
     std::string out{""};
   }
 
+  {
+    // text will be appended as is,
+    // `[[+` is not treated as tag
+    _squaretsRaw(
+      R"raw(int a;
+      [[+ std::to_string(1) +]];)raw"
+    )
+    std::string out{""};
+  }
+
 #if FILE_CONTENTS_COMMENT
 int example1 = 1;
 [[~]] std::cout << example1;
@@ -141,4 +198,15 @@ std::cout << [[+ std::to_string(example1) +]];
     SomeStruct
     {};
   }
+
+  {
+    // template that renders empty string
+    // removes annotated declaration
+    struct
+    _interpretSquarets(
+      R"raw([[~ if(false) { ~]] struct [[+ classInfoPtr->name +]] {}; [[~ } ~]])raw"
+    )
+    EmptyStruct
+    {};
+  }
 }
@@ -0,0 +1,238 @@
+// libFuzzer target for template parsing,
+// build with `-DENABLE_FUZZING=ON` (requires clang)
+//
+// Usage:
+//   flex_squarets_plugin-fuzz_template_parser tests/fuzzing/corpus
+//
+// Besides crashes, reports inputs that take superlinear time
+// and saves them into directory from `SQUARETS_FUZZ_SLOW_DIR`
+// (`slow_inputs` by default). Each input is grown |kGrowthFactor| times
+// in several shapes (see |kShapes|): repeated, nested into tags
+// and placed after unterminated tags, so parse time must not grow
+// faster than |kMaxTimeGrowth| with both size and depth of tags.
+// Set `SQUARETS_FUZZ_FAIL_ON_SLOW=1` to abort on such input,
+// so libFuzzer will minimize it.
+//
+// Parser sources are compiled into fuzz target
+// (see `tests/CMakeLists.txt`), so they are instrumented
+// by `-fsanitize=fuzzer`.
+
+#include <flex_squarets_plugin/TemplateParser.hpp>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/sha1.h>
+#include <base/stl_util.h>
+#include <base/strings/string16.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/utf_string_conversions.h>
+#include <base/time/time.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+static const char kAnnotationCXTPL[] = "CXTPL;";
+
+static const char kOutputName[] = "out";
+
+static const char kSlowDirEnv[] = "SQUARETS_FUZZ_SLOW_DIR";
+
+static const char kDefaultSlowDir[] = "slow_inputs";
+
+static const char kFailOnSlowEnv[] = "SQUARETS_FUZZ_FAIL_ON_SLOW";
+
+// size or depth of input is multiplied by that value
+static const size_t kGrowthFactor = 4;
+
+// linear parser is expected to slow down
+// about |kGrowthFactor| times, quadratic - 16 times
+static const double kMaxTimeGrowth = 2.0 * kGrowthFactor;
+
+// shorter time is dominated by noise
+static const base::TimeDelta kMinMeasurableTime
+  = base::TimeDelta::FromMilliseconds(2);
+
+// limits time spent on single input
+static const size_t kMaxRepeatedSize = 4 * 1024 * 1024;
+
+static base::TimeDelta measureParse(
+  const base::StringPiece16& contents)
+{
+  std::string generatedCode;
+  const base::TimeTicks startTime = base::TimeTicks::Now();
+  plugin::generateTemplateCode(
+    kOutputName, contents, &generatedCode, nullptr);
+  return base::TimeTicks::Now() - startTime;
+}
+
+static const base::char16 kOpenTag[] = u"[[~ ";
+
+static const base::char16 kCloseTag[] = u" ~]]";
+
+// input repeated |times| times
+static base::string16 repeat(
+  const base::StringPiece16& contents
+  , size_t times)
+{
+  base::string16 result;
+  result.reserve(contents.size() * times);
+  for(size_t i = 0; i < times; ++i) {
+    contents.AppendToString(&result);
+  }
+  return result;
+}
+
+// input nested into |times| tags,
+// each level of nesting starts with copy of input
+static base::string16 nest(
+  const base::StringPiece16& contents
+  , size_t times)
+{
+  base::string16 result;
+  for(size_t i = 0; i < times; ++i) {
+    result += kOpenTag;
+    contents.AppendToString(&result);
+  }
+  for(size_t i = 0; i < times; ++i) {
+    result += kCloseTag;
+  }
+  return result;
+}
+
+// same as |nest|, but tags are never closed
+static base::string16 nestUnterminated(
+  const base::StringPiece16& contents
+  , size_t times)
+{
+  base::string16 result;
+  for(size_t i = 0; i < times; ++i) {
+    result += kOpenTag;
+    contents.AppendToString(&result);
+  }
+  return result;
+}
+
+struct Shape {
+  const char* name;
+  base::string16 (*grow)(const base::StringPiece16&, size_t);
+  // code units added by |grow| per copy of input
+  size_t tagsSize;
+};
+
+static const Shape kShapes[] = {
+  {"repeated", &repeat, 0}
+  , {"nested", &nest
+      , base::size(kOpenTag) - 1 + base::size(kCloseTag) - 1}
+  , {"unterminated", &nestUnterminated, base::size(kOpenTag) - 1}
+};
+
+static void saveSlowInput(
+  const uint8_t* data
+  , size_t size
+  , const Shape& shape
+  , double timeGrowth)
+{
+  const char* slowDir = std::getenv(kSlowDirEnv);
+  const base::FilePath dir{
+    slowDir ? slowDir : kDefaultSlowDir};
+  const std::string input(
+    reinterpret_cast<const char*>(data), size);
+  const base::FilePath path
+    = dir.AppendASCII(base::HexEncode(
+        base::SHA1HashString(input).data(), base::kSHA1Length));
+
+  LOG(ERROR)
+    << "(squarets fuzzer) parse time grows "
+    << timeGrowth
+    << " times if input is "
+    << shape.name
+    << " "
+    << kGrowthFactor
+    << " times more, saved input to "
+    << path;
+
+  if(!base::CreateDirectory(dir)
+     || base::WriteFile(path, input.data(), static_cast<int>(input.size()))
+        != static_cast<int>(input.size()))
+  {
+    LOG(ERROR)
+      << "(squarets fuzzer) unable to write file: "
+      << path;
+  }
+
+  const char* failOnSlow = std::getenv(kFailOnSlowEnv);
+  if(failOnSlow && std::string(failOnSlow) == "1") {
+    CHECK(false);
+  }
+}
+
+// grows input until parse time can be measured,
+// so that both measurements are above noise,
+// then compares it with time of |kGrowthFactor| times larger input
+static void checkTimeGrowth(
+  const uint8_t* data
+  , size_t size
+  , const base::StringPiece16& contents
+  , const Shape& shape)
+{
+  const size_t unitSize = contents.size() + shape.tagsSize;
+  size_t times = 1;
+  base::TimeDelta baseTime = measureParse(shape.grow(contents, times));
+  while(baseTime < kMinMeasurableTime
+        && unitSize * times * kGrowthFactor * 2 <= kMaxRepeatedSize)
+  {
+    times *= 2;
+    baseTime = measureParse(shape.grow(contents, times));
+  }
+  if(baseTime < kMinMeasurableTime
+     || unitSize * times * kGrowthFactor > kMaxRepeatedSize)
+  {
+    return;
+  }
+
+  const base::TimeDelta grownTime
+    = measureParse(shape.grow(contents, times * kGrowthFactor));
+  const double timeGrowth
+    = grownTime.InMicrosecondsF() / baseTime.InMicrosecondsF();
+  if(timeGrowth > kMaxTimeGrowth) {
+    saveSlowInput(data, size, shape, timeGrowth);
+  }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(
+  const uint8_t* data
+  , size_t size)
+{
+  base::string16 annotation;
+  if(!base::UTF8ToUTF16(
+        reinterpret_cast<const char*>(data), size, &annotation))
+  {
+    // annotations are valid UTF-8
+    return 0;
+  }
+
+  base::StringPiece16 contents = annotation;
+  // same as `removeSyntaxPrefix` in `Tooling.cc`,
+  // input without prefix is parsed as is
+  plugin::removeTemplatePrefix(kAnnotationCXTPL, contents);
+
+  // crashes are found by parse of input as is
+  measureParse(contents);
+
+  if(contents.empty()) {
+    return 0;
+  }
+
+  for(const Shape& shape : kShapes) {
+    checkTimeGrowth(data, size, contents, shape);
+  }
+
+  return 0;
+}
@@ -0,0 +1,353 @@
+#include "testsCommon.h"
+
+#if !defined(USE_GTEST_TEST)
+#warning "use USE_GTEST_TEST"
+// default
+#define USE_GTEST_TEST 1
+#endif // !defined(USE_GTEST_TEST)
+
+#include <flex_squarets_plugin/GeneratedCode.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using plugin::GeneratedSegment;
+using plugin::LiteralMinification;
+
+static const char kOutputName[] = "out";
+
+static const char kTableName[] = "squarets_table";
+
+// segments as pairs of (is literal, text)
+static std::vector<std::pair<bool, std::string>> describe(
+  const std::vector<GeneratedSegment>& segments)
+{
+  std::vector<std::pair<bool, std::string>> result;
+  for(const GeneratedSegment& segment : segments) {
+    result.emplace_back(
+      segment.kind == GeneratedSegment::Kind::kLiteral
+      , segment.text);
+  }
+  return result;
+}
+
+static std::vector<std::pair<bool, std::string>> split(
+  const std::string& code)
+{
+  return describe(plugin::splitGeneratedCode(code, kOutputName));
+}
+
+// literals of |code| that are not detected as appends
+static void expectNoLiterals(const std::string& code)
+{
+  const std::vector<std::pair<bool, std::string>> segments = split(code);
+  ASSERT_EQ(segments.size(), 1u) << code;
+  EXPECT_FALSE(segments[0].first) << code;
+  EXPECT_EQ(segments[0].second, code);
+}
+
+// code segment of |minify| inputs
+static const char kCode[] = "\nout += x;\n";
+
+// minifies |literals| separated by |kCode|
+// (element equal to |kCode| is code segment)
+static std::vector<std::pair<bool, std::string>> minify(
+  const std::vector<std::string>& literals
+  , LiteralMinification mode)
+{
+  std::vector<GeneratedSegment> segments;
+  for(const std::string& text : literals) {
+    segments.push_back({
+      text == kCode
+        ? GeneratedSegment::Kind::kCode
+        : GeneratedSegment::Kind::kLiteral
+      , text});
+  }
+  plugin::minifyLiterals(&segments, mode);
+  return describe(segments);
+}
+
+} // namespace
+
+TEST(GeneratedCode, SplitsLiteralsAndCode) {
+  const std::string code
+    = "out += R\"raw(a)raw\";\n"
+      "out += std::to_string(x);\n"
+      "out += R\"raw(b)raw\";\n";
+  EXPECT_EQ(split(code), (std::vector<std::pair<bool, std::string>>{
+    {true, "a"}
+    , {false, "\nout += std::to_string(x);\n"}
+    , {true, "b"}
+    , {false, "\n"}}));
+}
+
+TEST(GeneratedCode, MergesLiteralsSeparatedByWhitespace) {
+  const std::string code
+    = "out += R\"raw(a)raw\";\n  out\n +=\nR\"raw(b)raw\"\n ;";
+  EXPECT_EQ(split(code), (std::vector<std::pair<bool, std::string>>{
+    {true, "ab"}}));
+}
+
+TEST(GeneratedCode, RawStringDelimiters) {
+  // `)raw"` inside literal requires other delimiter
+  EXPECT_EQ(split("out += R\"raw0(x)raw\")raw0\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {true, "x)raw\""}}));
+  EXPECT_EQ(split("out += R\"(plain)\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {true, "plain"}}));
+  // unterminated raw string is code
+  expectNoLiterals("out += R\"raw(x)oops\";");
+  // delimiter longer than 16 chars is invalid
+  expectNoLiterals("out += R\"aaaaaaaaaaaaaaaaa(x)aaaaaaaaaaaaaaaaa\";");
+
+  // append inside raw string of code is not literal
+  expectNoLiterals(
+    "auto s = R\"x(out += R\"raw(a)raw\";)x\";");
+  expectNoLiterals(
+    "auto s = u8R\"x(out += R\"raw(a)raw\";)x\";");
+
+  // literal survives round trip with any contents
+  for(const std::string& text : {
+        std::string{")raw\""}
+        , std::string{")raw\" )raw0\" )raw1\""}
+        , std::string{"\"\\n'//"}})
+  {
+    const std::string literal = plugin::makeRawStringLiteral(text);
+    EXPECT_EQ(split("out += " + literal + ";"),
+      (std::vector<std::pair<bool, std::string>>{{true, text}}))
+      << literal;
+  }
+}
+
+TEST(GeneratedCode, CommentsInsideStringsAreCode) {
+  // `//` and `/*` inside strings do not start comments,
+  // so following literal is found
+  EXPECT_EQ(split("f(\"//\"); out += R\"raw(a)raw\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "f(\"//\"); "}
+      , {true, "a"}}));
+  EXPECT_EQ(split("f(\"/*\"); out += R\"raw(a)raw\"; f(\"*/\");"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "f(\"/*\"); "}
+      , {true, "a"}
+      , {false, " f(\"*/\");"}}));
+  EXPECT_EQ(split("f('\"'); out += R\"raw(a)raw\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "f('\"'); "}
+      , {true, "a"}}));
+  EXPECT_EQ(split("f(\"\\\"//\"); out += R\"raw(a)raw\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "f(\"\\\"//\"); "}
+      , {true, "a"}}));
+
+  // appends inside comments are code
+  expectNoLiterals("// out += R\"raw(a)raw\";\n");
+  expectNoLiterals("/* out += R\"raw(a)raw\"; */");
+  expectNoLiterals("/* \" */ // out += R\"raw(a)raw\";");
+}
+
+TEST(GeneratedCode, DigitSeparators) {
+  // `'` of `1'000` does not start character literal
+  EXPECT_EQ(split("int n = 1'000; out += R\"raw(a)raw\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "int n = 1'000; "}
+      , {true, "a"}}));
+  EXPECT_EQ(split("f(0x1'00'00, 'x'); out += R\"raw(a)raw\";"),
+    (std::vector<std::pair<bool, std::string>>{
+      {false, "f(0x1'00'00, 'x'); "}
+      , {true, "a"}}));
+}
+
+TEST(GeneratedCode, OutputNameIsWholeIdentifier) {
+  expectNoLiterals("myout += R\"raw(a)raw\";");
+  expectNoLiterals("out2 += R\"raw(a)raw\";");
+  expectNoLiterals("out = R\"raw(a)raw\";");
+}
+
+TEST(GeneratedCode, ChunkLength) {
+  EXPECT_EQ(plugin::chunkLength("", 4), 0u);
+  EXPECT_EQ(plugin::chunkLength("abc", 4), 3u);
+  EXPECT_EQ(plugin::chunkLength("abcdef", 4), 4u);
+
+  // U+00E9 (2 bytes), U+20AC (3 bytes), U+1F600 (4 bytes)
+  // placed so that chunk boundary splits them
+  const std::string twoBytes = "abc\xC3\xA9z";
+  EXPECT_EQ(plugin::chunkLength(twoBytes, 4), 3u);
+  EXPECT_EQ(plugin::chunkLength(twoBytes, 5), 5u);
+
+  const std::string threeBytes = "ab\xE2\x82\xACz";
+  EXPECT_EQ(plugin::chunkLength(threeBytes, 3), 2u);
+  EXPECT_EQ(plugin::chunkLength(threeBytes, 4), 2u);
+  EXPECT_EQ(plugin::chunkLength(threeBytes, 5), 5u);
+
+  const std::string fourBytes = "a\xF0\x9F\x98\x80z";
+  for(size_t chunkSize = 2; chunkSize <= 4; ++chunkSize) {
+    EXPECT_EQ(plugin::chunkLength(fourBytes, chunkSize), 1u)
+      << chunkSize;
+  }
+  EXPECT_EQ(plugin::chunkLength(fourBytes, 5), 5u);
+
+  // chunk smaller than character, invalid UTF-8 is split anywhere
+  EXPECT_EQ(plugin::chunkLength("\xF0\x9F\x98\x80", 2), 2u);
+  EXPECT_EQ(plugin::chunkLength("\x80\x80\x80\x80", 2), 2u);
+}
+
+TEST(GeneratedCode, LiteralTableKeepsCharacters) {
+  const std::string text = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80z";
+  const std::vector<GeneratedSegment> segments{
+    {GeneratedSegment::Kind::kLiteral, text}
+    , {GeneratedSegment::Kind::kCode, "\nout += x;\n"}
+    , {GeneratedSegment::Kind::kLiteral, "tail"}};
+
+  for(size_t chunkSize = 1; chunkSize <= text.size() + 1; ++chunkSize) {
+    const std::string code = plugin::emitLiteralTable(
+      segments, kOutputName, chunkSize, kTableName);
+
+    // chunks are raw string literals of table
+    const size_t tableEnd = code.find("};\n");
+    ASSERT_NE(tableEnd, std::string::npos);
+    std::string joined;
+    size_t pos = 0;
+    while((pos = code.find("R\"raw(", pos)) < tableEnd) {
+      const size_t begin = pos + 6;
+      const size_t end = code.find(")raw\"", begin);
+      ASSERT_LT(end, tableEnd);
+      const std::string chunk = code.substr(begin, end - begin);
+      EXPECT_LE(chunk.size(), chunkSize);
+      // chunk that can hold any character
+      // does not start inside of it
+      if(chunkSize >= 4) {
+        ASSERT_FALSE(chunk.empty());
+        EXPECT_NE(static_cast<unsigned char>(chunk[0]) & 0xC0, 0x80)
+          << "chunk size " << chunkSize;
+      }
+      joined += chunk;
+      pos = end;
+    }
+    EXPECT_EQ(joined, text + "tail") << "chunk size " << chunkSize;
+
+    // code segment is kept, each literal is loop over its chunks
+    EXPECT_NE(code.find("\nout += x;\n"), std::string::npos);
+    EXPECT_NE(code.find("squarets_table_bounds[0]"), std::string::npos);
+    EXPECT_NE(code.find("squarets_table_bounds[1]"), std::string::npos);
+    EXPECT_EQ(code.find("squarets_table_bounds[2]"), std::string::npos);
+  }
+}
+
+TEST(GeneratedCode, LiteralTableWithoutLiterals) {
+  const std::vector<GeneratedSegment> segments{
+    {GeneratedSegment::Kind::kCode, "out += x;"}};
+  EXPECT_EQ(
+    plugin::emitLiteralTable(segments, kOutputName, 16, kTableName)
+    , "out += x;");
+}
+
+TEST(GeneratedCode, LiteralTableBounds) {
+  const std::vector<GeneratedSegment> segments{
+    {GeneratedSegment::Kind::kLiteral, "abcdefgh"}
+    , {GeneratedSegment::Kind::kCode, "f();"}
+    , {GeneratedSegment::Kind::kLiteral, "ij"}};
+  const std::string code
+    = plugin::emitLiteralTable(segments, kOutputName, 4, kTableName);
+  EXPECT_NE(
+    code.find("static constexpr unsigned squarets_table_bounds[]"
+              " = {0, 2, 3};")
+    , std::string::npos) << code;
+  EXPECT_NE(code.find("f();"), std::string::npos);
+}
+
+TEST(GeneratedCode, MinifyNoneKeepsLiterals) {
+  std::vector<GeneratedSegment> segments{
+    {GeneratedSegment::Kind::kLiteral, "  a  \n\n  b "}};
+  plugin::minifyLiterals(&segments, LiteralMinification::kNone);
+  EXPECT_EQ(describe(segments), (std::vector<std::pair<bool, std::string>>{
+    {true, "  a  \n\n  b "}}));
+}
+
+TEST(GeneratedCode, MinifyIndent) {
+  EXPECT_EQ(minify({"\n    <ul>\n\n  \t<li> x </li>  \n"}
+                   , LiteralMinification::kIndent)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "\n<ul>\n\n<li> x </li>  \n"}}));
+}
+
+TEST(GeneratedCode, MinifyLines) {
+  EXPECT_EQ(minify({"\n    <ul>  \n\n  \t<li> x </li>  \n  "}
+                   , LiteralMinification::kLines)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "<ul>\n<li> x </li>\n"}}));
+
+  // text after code continues its line, so indentation is kept
+  // until next newline
+  EXPECT_EQ(minify({"  a\n", kCode, "  b\n  c"}
+                   , LiteralMinification::kLines)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "a\n"}
+        , {false, kCode}
+        , {true, "  b\nc"}}));
+}
+
+TEST(GeneratedCode, MinifyAll) {
+  EXPECT_EQ(minify({"\n  <ul>\n\n   <li> x </li> \n"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "<ul> <li> x </li> "}}));
+
+  // literal that became empty is removed
+  EXPECT_EQ(minify({" \n ", kCode, " a"}, LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {false, kCode}
+        , {true, " a"}}));
+}
+
+TEST(GeneratedCode, MinifyAllKeepsNewlinesOfComments) {
+  // newline ends `//` comment, `/* */` does not need it
+  EXPECT_EQ(minify({"int a; // a\n  int b;\n  /* c */\n  int c;\n"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "int a; // a\nint b; /* c */ int c; "}}));
+
+  // comment continues after code
+  EXPECT_EQ(minify({"int a; // ", kCode, "\n  int b;"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "int a; // "}
+        , {false, kCode}
+        , {true, "\nint b;"}}));
+}
+
+TEST(GeneratedCode, MinifyAllKeepsDirectiveLines) {
+  EXPECT_EQ(minify({"int a;\n  #include <b>\n  int c;\n"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "int a;\n#include <b>\nint c; "}}));
+
+  // directive at start of output, indented directive
+  EXPECT_EQ(minify({"#pragma once\n\n  # define A 1\n  int a;"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "#pragma once\n# define A 1\nint a;"}}));
+
+  // line continuation of directive
+  EXPECT_EQ(minify({"#define A \\\n  1 + \\\n  2\n  int a;\n  int b;"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "#define A \\\n1 + \\\n2\nint a; int b;"}}));
+
+  // code may end line, so `#` after it starts directive
+  EXPECT_EQ(minify({"int a;", kCode, "#endif\n  int b;"}
+                   , LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "int a;"}
+        , {false, kCode}
+        , {true, "#endif\nint b;"}}));
+
+  // `#` inside of line is not directive
+  EXPECT_EQ(minify({"a # b\n  c\n"}, LiteralMinification::kAll)
+    , (std::vector<std::pair<bool, std::string>>{
+        {true, "a # b c "}}));
+}
@@ -0,0 +1,230 @@
+#include "testsCommon.h"
+
+#if !defined(USE_GTEST_TEST)
+#warning "use USE_GTEST_TEST"
+// default
+#define USE_GTEST_TEST 1
+#endif // !defined(USE_GTEST_TEST)
+
+#include <flex_squarets_plugin/TemplateFile.hpp>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+
+#include <zlib.h>
+
+#if defined(SQUARETS_HAS_ZSTD)
+#include <zstd.h>
+#endif // SQUARETS_HAS_ZSTD
+
+#include <random>
+#include <string>
+
+namespace {
+
+static const size_t kMB = 1024 * 1024;
+
+// larger than chunks read by |readTemplateFile|,
+// so output buffer grows several times
+static const size_t kLargeSize = 3 * kMB + 123;
+
+// text that compresses well, but not to few bytes
+static std::string makeText(size_t size, unsigned seed)
+{
+  static const char* const kWords[] = {
+    "[[+ a +]]", "std", "string", "out", " ", "\n", "{", "}"};
+  std::mt19937 generator(seed);
+  std::uniform_int_distribution<size_t> distribution(
+    0, sizeof(kWords) / sizeof(kWords[0]) - 1);
+  std::string text;
+  text.reserve(size + 16);
+  while(text.size() < size) {
+    text += kWords[distribution(generator)];
+  }
+  text.resize(size);
+  return text;
+}
+
+// single gzip member
+static std::string gzipCompress(const std::string& text)
+{
+  z_stream stream{};
+  // 16 writes gzip header instead of zlib header
+  EXPECT_EQ(deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED
+    , 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+  std::string compressed(deflateBound(&stream, text.size()), '\0');
+  stream.next_in
+    = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+  stream.avail_in = static_cast<uInt>(text.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  EXPECT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+#if defined(SQUARETS_HAS_ZSTD)
+// single zstd frame
+static std::string zstdCompress(const std::string& text)
+{
+  std::string compressed(ZSTD_compressBound(text.size()), '\0');
+  const size_t size = ZSTD_compress(
+    &compressed[0], compressed.size(), text.data(), text.size(), 1);
+  EXPECT_FALSE(ZSTD_isError(size));
+  compressed.resize(size);
+  return compressed;
+}
+#endif // SQUARETS_HAS_ZSTD
+
+class TemplateFileTest : public ::testing::Test {
+protected:
+  void SetUp() override
+  {
+    ASSERT_TRUE(tempDir_.CreateUniqueTempDir());
+  }
+
+  base::FilePath writeFile(
+    const std::string& name
+    , const std::string& data)
+  {
+    const base::FilePath path = tempDir_.GetPath().AppendASCII(name);
+    EXPECT_EQ(
+      base::WriteFile(path, data.data(), static_cast<int>(data.size()))
+      , static_cast<int>(data.size()));
+    return path;
+  }
+
+  // reads |data| written into file |name|
+  bool read(
+    const std::string& name
+    , const std::string& data
+    , size_t maxSizeInBytes
+    , std::string* contents)
+  {
+    return plugin::readTemplateFile(
+      writeFile(name, data), maxSizeInBytes, contents);
+  }
+
+private:
+  base::ScopedTempDir tempDir_;
+};
+
+} // namespace
+
+TEST_F(TemplateFileTest, DetectsCompressedFiles) {
+  EXPECT_TRUE(plugin::isCompressedTemplateFile(
+    base::FilePath{FILE_PATH_LITERAL("a.cxtpl.gz")}));
+  EXPECT_TRUE(plugin::isCompressedTemplateFile(
+    base::FilePath{FILE_PATH_LITERAL("a.cxtpl.zst")}));
+  EXPECT_FALSE(plugin::isCompressedTemplateFile(
+    base::FilePath{FILE_PATH_LITERAL("a.cxtpl")}));
+}
+
+TEST_F(TemplateFileTest, Gzip) {
+  const std::string text = makeText(kLargeSize, 1);
+  std::string contents;
+  ASSERT_TRUE(read("large.gz", gzipCompress(text), 4 * kMB, &contents));
+  EXPECT_EQ(contents, text);
+
+  ASSERT_TRUE(read("empty.gz", gzipCompress(""), kMB, &contents));
+  EXPECT_TRUE(contents.empty());
+}
+
+TEST_F(TemplateFileTest, GzipMultipleMembers) {
+  // like `cat a.gz b.gz c.gz`
+  const std::string first = makeText(100 * 1024, 2);
+  const std::string second = makeText(10, 3);
+  const std::string third = makeText(kLargeSize, 4);
+  std::string contents;
+  ASSERT_TRUE(read("members.gz"
+    , gzipCompress(first) + gzipCompress(second) + gzipCompress(third)
+    , 4 * kMB
+    , &contents));
+  EXPECT_EQ(contents, first + second + third);
+}
+
+TEST_F(TemplateFileTest, GzipTruncated) {
+  const std::string compressed = gzipCompress(makeText(kLargeSize, 5));
+  std::string contents;
+  // without trailer (CRC and size), inside of data, inside of header
+  for(const size_t size : {compressed.size() - 4, compressed.size() / 2
+                           , size_t{5}, size_t{0}})
+  {
+    EXPECT_FALSE(read("truncated.gz", compressed.substr(0, size)
+      , 4 * kMB, &contents)) << size;
+  }
+  // second member is truncated
+  const std::string member = gzipCompress("abc");
+  EXPECT_FALSE(read("truncated_member.gz"
+    , member + member.substr(0, member.size() - 1), kMB, &contents));
+}
+
+TEST_F(TemplateFileTest, GzipCorrupted) {
+  std::string compressed = gzipCompress(makeText(64 * 1024, 6));
+  // breaks CRC32 of trailer
+  compressed[compressed.size() - 8] ^= 0x55;
+  std::string contents;
+  EXPECT_FALSE(read("corrupted.gz", compressed, kMB, &contents));
+}
+
+TEST_F(TemplateFileTest, GzipSizeLimit) {
+  const std::string text = makeText(kLargeSize, 7);
+  const std::string compressed = gzipCompress(text);
+  std::string contents;
+  EXPECT_TRUE(read("exact.gz", compressed, text.size(), &contents));
+  EXPECT_EQ(contents, text);
+  EXPECT_FALSE(read("limit.gz", compressed, text.size() - 1, &contents));
+  EXPECT_FALSE(read("small_limit.gz", compressed, 1024, &contents));
+  // limit applies to all members together
+  const std::string member = gzipCompress(makeText(1000, 8));
+  EXPECT_FALSE(read("members_limit.gz", member + member, 1500, &contents));
+}
+
+#if defined(SQUARETS_HAS_ZSTD)
+TEST_F(TemplateFileTest, Zstd) {
+  const std::string text = makeText(kLargeSize, 9);
+  std::string contents;
+  ASSERT_TRUE(read("large.zst", zstdCompress(text), 4 * kMB, &contents));
+  EXPECT_EQ(contents, text);
+}
+
+TEST_F(TemplateFileTest, ZstdConcatenatedFrames) {
+  const std::string first = makeText(100 * 1024, 10);
+  const std::string second = makeText(10, 11);
+  const std::string third = makeText(kLargeSize, 12);
+  std::string contents;
+  ASSERT_TRUE(read("frames.zst"
+    , zstdCompress(first) + zstdCompress(second) + zstdCompress(third)
+    , 4 * kMB
+    , &contents));
+  EXPECT_EQ(contents, first + second + third);
+}
+
+TEST_F(TemplateFileTest, ZstdTruncated) {
+  const std::string compressed = zstdCompress(makeText(kLargeSize, 13));
+  std::string contents;
+  for(const size_t size : {compressed.size() - 1, compressed.size() / 2
+                           , size_t{3}})
+  {
+    EXPECT_FALSE(read("truncated.zst", compressed.substr(0, size)
+      , 4 * kMB, &contents)) << size;
+  }
+  const std::string frame = zstdCompress("abc");
+  EXPECT_FALSE(read("truncated_frame.zst"
+    , frame + frame.substr(0, frame.size() - 1), kMB, &contents));
+}
+
+TEST_F(TemplateFileTest, ZstdSizeLimit) {
+  const std::string text = makeText(kLargeSize, 14);
+  const std::string compressed = zstdCompress(text);
+  std::string contents;
+  EXPECT_TRUE(read("exact.zst", compressed, text.size(), &contents));
+  EXPECT_EQ(contents, text);
+  EXPECT_FALSE(read("limit.zst", compressed, text.size() - 1, &contents));
+  EXPECT_FALSE(read("small_limit.zst", compressed, 1024, &contents));
+  const std::string frame = zstdCompress(makeText(1000, 15));
+  EXPECT_FALSE(read("frames_limit.zst", frame + frame, 1500, &contents));
+}
+#endif // SQUARETS_HAS_ZSTD
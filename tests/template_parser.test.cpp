@@ -0,0 +1,136 @@
+#include "testsCommon.h"
+
+#if !defined(USE_GTEST_TEST)
+#warning "use USE_GTEST_TEST"
+// default
+#define USE_GTEST_TEST 1
+#endif // !defined(USE_GTEST_TEST)
+
+#include <flex_squarets_plugin/TemplateParser.hpp>
+
+#include <base/strings/string16.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+
+// counts allocations made by current test
+// between |Start| and |Stop|
+std::atomic<bool> gCountAllocations{false};
+
+std::atomic<size_t> gAllocations{0};
+
+std::atomic<size_t> gAllocatedBytes{0};
+
+class ScopedAllocationCounter {
+public:
+  ScopedAllocationCounter()
+  {
+    gAllocations = 0;
+    gAllocatedBytes = 0;
+    gCountAllocations = true;
+  }
+
+  ~ScopedAllocationCounter()
+  {
+    gCountAllocations = false;
+  }
+
+  size_t allocations() const
+  {
+    return gAllocations;
+  }
+
+  size_t allocatedBytes() const
+  {
+    return gAllocatedBytes;
+  }
+};
+
+static const char kOutputName[] = "out";
+
+static const size_t kMB = 1024 * 1024;
+
+// allocations that do not depend on size of template
+// (output string, UTF-8 copy of template, small strings)
+static const size_t kMaxAllocationsPerAnnotation = 8;
+
+} // namespace
+
+void* operator new(size_t size)
+{
+  if(gCountAllocations) {
+    gAllocations++;
+    gAllocatedBytes += size;
+  }
+  void* ptr = std::malloc(size ? size : 1);
+  if(!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  std::free(ptr);
+}
+
+TEST(TemplateParser, RemovesPrefixWithoutAllocations) {
+  const base::string16 annotation = u"cxtpl;int a;";
+  base::StringPiece16 contents = annotation;
+
+  ScopedAllocationCounter counter;
+  EXPECT_TRUE(plugin::removeTemplatePrefix("CXTPL;", contents));
+  EXPECT_EQ(counter.allocations(), 0u);
+  EXPECT_EQ(contents, base::StringPiece16{u"int a;"});
+}
+
+TEST(TemplateParser, KeepsContentsWithoutPrefix) {
+  const base::string16 annotation = u"CXTP";
+  base::StringPiece16 contents = annotation;
+
+  EXPECT_FALSE(plugin::removeTemplatePrefix("CXTPL;", contents));
+  EXPECT_EQ(contents, base::StringPiece16{annotation});
+}
+
+TEST(TemplateParser, LiteralTemplateIsNotCopied) {
+  const base::string16 templateContents(4 * kMB, u'x');
+
+  std::string generatedCode;
+  ScopedAllocationCounter counter;
+  EXPECT_TRUE(plugin::generateTemplateCode(
+    kOutputName, templateContents, &generatedCode, nullptr));
+
+  EXPECT_LE(counter.allocations(), kMaxAllocationsPerAnnotation);
+  // UTF-8 copy of template and output
+  EXPECT_LE(counter.allocatedBytes(), 2 * generatedCode.size() + kMB);
+  EXPECT_NE(generatedCode.find(kOutputName), std::string::npos);
+}
+
+TEST(TemplateParser, AllocationsDoNotGrowWithTemplateSize) {
+  const base::string16 tag = u"[[~ int a = 1; ~]]";
+
+  size_t allocations[2] = {0, 0};
+  for(size_t i = 0; i < 2; ++i) {
+    const base::string16 templateContents
+      = tag + base::string16((i + 1) * kMB, u'x');
+
+    std::string generatedCode;
+    ScopedAllocationCounter counter;
+    EXPECT_TRUE(plugin::generateTemplateCode(
+      kOutputName, templateContents, &generatedCode, nullptr));
+    allocations[i] = counter.allocations();
+    EXPECT_FALSE(generatedCode.empty());
+  }
+
+  // growth of buffers may require one more reallocation
+  EXPECT_LE(allocations[1], allocations[0] + kMaxAllocationsPerAnnotation);
+}
@@ -0,0 +1,173 @@
+#include "testsCommon.h"
+
+#if !defined(USE_GTEST_TEST)
+#warning "use USE_GTEST_TEST"
+// default
+#define USE_GTEST_TEST 1
+#endif // !defined(USE_GTEST_TEST)
+
+#include <flex_squarets_plugin/TemplateScan.hpp>
+
+#include <base/strings/string16.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using plugin::DelimiterScanMode;
+
+static const DelimiterScanMode kVectorModes[] = {
+  DelimiterScanMode::kSSE2
+  , DelimiterScanMode::kAVX2
+};
+
+// block sizes of vectorized modes (in code units)
+static const size_t kBlockSizes[] = {8, 16};
+
+// straightforward implementation of |scanTemplateDelimiters|
+static std::vector<size_t> expectedDelimiters(
+  const base::StringPiece16& contents)
+{
+  std::vector<size_t> positions;
+  for(size_t i = 0; i + 1 < contents.size(); ++i) {
+    if((contents[i] == u'[' || contents[i] == u']')
+       && contents[i + 1] == contents[i])
+    {
+      positions.push_back(i);
+      // pair can not overlap with next one
+      ++i;
+    }
+  }
+  return positions;
+}
+
+// compares early exit of each supported mode with expected result
+static void expectSameHasDelimiter(
+  const base::StringPiece16& contents
+  , bool expected)
+{
+  bool scalar = !expected;
+  ASSERT_TRUE(plugin::hasTemplateDelimiterWithMode(
+    DelimiterScanMode::kScalar, contents, &scalar));
+  EXPECT_EQ(scalar, expected);
+
+  for(const DelimiterScanMode mode : kVectorModes) {
+    bool hasDelimiter = !expected;
+    if(!plugin::hasTemplateDelimiterWithMode(
+         mode, contents, &hasDelimiter))
+    {
+      // not supported by build or CPU
+      continue;
+    }
+    EXPECT_EQ(hasDelimiter, expected)
+      << "mode " << static_cast<int>(mode)
+      << ", size " << contents.size();
+  }
+
+  EXPECT_EQ(plugin::hasTemplateDelimiter(contents), expected);
+}
+
+// compares each supported mode with expected result
+static void expectSameDelimiters(
+  const base::StringPiece16& contents)
+{
+  const std::vector<size_t> expected = expectedDelimiters(contents);
+  expectSameHasDelimiter(contents, !expected.empty());
+
+  std::vector<size_t> scalar;
+  ASSERT_TRUE(plugin::scanTemplateDelimitersWithMode(
+    DelimiterScanMode::kScalar, contents, &scalar));
+  EXPECT_EQ(scalar, expected);
+
+  for(const DelimiterScanMode mode : kVectorModes) {
+    std::vector<size_t> positions;
+    if(!plugin::scanTemplateDelimitersWithMode(
+         mode, contents, &positions))
+    {
+      // not supported by build or CPU
+      continue;
+    }
+    EXPECT_EQ(positions, expected)
+      << "mode " << static_cast<int>(mode)
+      << ", size " << contents.size();
+  }
+
+  std::vector<size_t> automatic;
+  plugin::scanTemplateDelimiters(contents, &automatic);
+  EXPECT_EQ(automatic, expected);
+}
+
+} // namespace
+
+TEST(TemplateScan, FindsPairsWithoutOverlap) {
+  const base::string16 contents = u"[[[ a ]]] [[+ b +]]";
+  std::vector<size_t> positions;
+  plugin::scanTemplateDelimiters(contents, &positions);
+  EXPECT_EQ(positions, (std::vector<size_t>{0, 6, 10, 17}));
+  expectSameDelimiters(contents);
+}
+
+TEST(TemplateScan, EmptyAndShortInputs) {
+  expectSameDelimiters(u"");
+  expectSameDelimiters(u"[");
+  expectSameDelimiters(u"[[");
+  expectSameDelimiters(u"[]");
+  expectSameDelimiters(u"]]]");
+}
+
+// delimiter placed at each offset around block boundaries
+// and in tail that does not fill whole block
+TEST(TemplateScan, DelimitersAtBlockBoundaries) {
+  for(const size_t blockSize : kBlockSizes) {
+    for(size_t size = 2; size <= 3 * blockSize + 3; ++size) {
+      for(size_t offset = 0; offset + 2 <= size; ++offset) {
+        for(const base::char16 bracket : {u'[', u']'}) {
+          base::string16 contents(size, u'x');
+          contents[offset] = bracket;
+          contents[offset + 1] = bracket;
+          expectSameDelimiters(contents);
+        }
+      }
+    }
+  }
+}
+
+// runs of brackets make pairs overlap block boundaries
+TEST(TemplateScan, BracketRunsAcrossBlocks) {
+  for(size_t prefix = 0; prefix < 34; ++prefix) {
+    for(size_t run = 1; run < 40; ++run) {
+      base::string16 contents(prefix, u'x');
+      contents.append(run, u'[');
+      contents.append(5, u'x');
+      contents.append(run, u']');
+      expectSameDelimiters(contents);
+    }
+  }
+}
+
+TEST(TemplateScan, RandomInputsMatchScalar) {
+  // fixed seed, so failures are reproducible
+  std::mt19937 generator(20201019);
+  // brackets are frequent, code units with bracket in one of bytes
+  // (like U+5B5B) must not match
+  const base::char16 alphabet[] = {
+    u'[', u'[', u']', u']', u'x', u' ', u'\n'
+    , u'\u5b5b', u'\u5d5d', u'\u015b'};
+  std::uniform_int_distribution<size_t> sizeDistribution(0, 200);
+  std::uniform_int_distribution<size_t> charDistribution(
+    0, sizeof(alphabet) / sizeof(alphabet[0]) - 1);
+
+  for(size_t iteration = 0; iteration < 2000; ++iteration) {
+    base::string16 contents(sizeDistribution(generator), u'x');
+    for(base::char16& c : contents) {
+      c = alphabet[charDistribution(generator)];
+    }
+    expectSameDelimiters(contents);
+    // unaligned start of data
+    if(!contents.empty()) {
+      expectSameDelimiters(base::StringPiece16(contents).substr(1));
+    }
+  }
+}
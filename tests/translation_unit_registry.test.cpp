@@ -0,0 +1,157 @@
+#include "testsCommon.h"
+
+#if !defined(USE_GTEST_TEST)
+#warning "use USE_GTEST_TEST"
+// default
+#define USE_GTEST_TEST 1
+#endif // !defined(USE_GTEST_TEST)
+
+#include <flex_squarets_plugin/TranslationUnitRegistry.hpp>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// number of |TestState| objects that are not destroyed
+std::atomic<int> gLiveStates{0};
+
+struct TestState {
+  explicit TestState(const std::string& file)
+    : mainFile(file)
+  {
+    ++gLiveStates;
+  }
+
+  ~TestState()
+  {
+    // detects use after destruction
+    mainFile.clear();
+    --gLiveStates;
+  }
+
+  std::string mainFile;
+
+  // changed only by threads that process translation unit
+  std::atomic<int> uses{0};
+};
+
+using Registry = plugin::TranslationUnitRegistry<TestState>;
+
+static TestState& enter(
+  Registry& registry
+  , const std::string& mainFile
+  , bool* isNew = nullptr)
+{
+  return registry.Enter(
+    mainFile
+    , isNew
+    , [&mainFile]() {
+        return std::make_unique<TestState>(mainFile);
+      });
+}
+
+} // namespace
+
+TEST(TranslationUnitRegistry, StateIsDestroyedWhenThreadStartsNextUnit) {
+  Registry registry;
+  bool isNew = false;
+
+  TestState& first = enter(registry, "a.cc", &isNew);
+  EXPECT_TRUE(isNew);
+  EXPECT_EQ(&enter(registry, "a.cc", &isNew), &first);
+  EXPECT_FALSE(isNew);
+  EXPECT_EQ(registry.size(), 1u);
+
+  TestState& second = enter(registry, "b.cc", &isNew);
+  EXPECT_TRUE(isNew);
+  EXPECT_EQ(second.mainFile, "b.cc");
+  EXPECT_EQ(registry.size(), 1u);
+  EXPECT_EQ(gLiveStates, 1);
+
+  // same unit processed again gets new state
+  enter(registry, "a.cc", &isNew);
+  EXPECT_TRUE(isNew);
+
+  registry.Clear();
+  EXPECT_EQ(registry.size(), 0u);
+  EXPECT_EQ(gLiveStates, 0);
+}
+
+TEST(TranslationUnitRegistry, SharedUnitIsKeptUntilLastThreadLeaves) {
+  Registry registry;
+
+  TestState& shared = enter(registry, "shared.cc");
+
+  std::promise<void> mainLeft;
+  std::promise<void> otherEntered;
+  std::thread other([&]() {
+    TestState& otherShared = enter(registry, "shared.cc");
+    otherEntered.set_value();
+    mainLeft.get_future().wait();
+    // main thread left `shared.cc`, but this thread still uses it
+    EXPECT_EQ(&otherShared, &shared);
+    EXPECT_EQ(otherShared.mainFile, "shared.cc");
+    enter(registry, "other.cc");
+  });
+
+  otherEntered.get_future().wait();
+  enter(registry, "main.cc");
+  EXPECT_EQ(registry.size(), 2u);
+  mainLeft.set_value();
+  other.join();
+
+  // `shared.cc` destroyed by last thread
+  EXPECT_EQ(registry.size(), 2u);
+  EXPECT_EQ(gLiveStates, 2);
+
+  registry.Clear();
+  EXPECT_EQ(gLiveStates, 0);
+}
+
+// threads process own translation units and one shared unit,
+// state must stay valid while thread uses it
+TEST(TranslationUnitRegistry, ConcurrentThreads) {
+  static const size_t kThreads = 8;
+  static const size_t kUnitsPerThread = 200;
+
+  Registry registry;
+  std::atomic<size_t> failures{0};
+
+  std::vector<std::thread> threads;
+  for(size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&registry, &failures, t]() {
+      for(size_t i = 0; i < kUnitsPerThread; ++i) {
+        const std::string mainFile
+          = (i % 3 == 0)
+            ? std::string{"shared.cc"}
+            : "unit_" + std::to_string(t)
+              + "_" + std::to_string(i) + ".cc";
+        // each annotation of unit looks up its state again
+        for(size_t annotation = 0; annotation < 4; ++annotation) {
+          TestState& state = enter(registry, mainFile);
+          ++state.uses;
+          std::this_thread::yield();
+          if(state.mainFile != mainFile) {
+            ++failures;
+          }
+        }
+      }
+    });
+  }
+  for(std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(failures, 0u);
+  // at most one unit per thread is not finished
+  EXPECT_LE(registry.size(), kThreads);
+  EXPECT_EQ(gLiveStates, static_cast<int>(registry.size()));
+
+  registry.Clear();
+  EXPECT_EQ(gLiveStates, 0);
+}